@@ -21,6 +21,7 @@
 
 #define BPF_ENV_UDS	"TC_BPF_UDS"
 #define BPF_ENV_MNT	"TC_BPF_MNT"
+#define BPF_ENV_PROG_CACHE	"TC_BPF_PROG_CACHE"
 
 #ifndef BPF_MAX_LOG
 # define BPF_MAX_LOG	4096
@@ -282,6 +282,44 @@ int rtnl_listen(struct rtnl_handle *, rtnl_listen_filter_t handler,
 int rtnl_from_file(FILE *, rtnl_listen_filter_t handler,
 		   void *jarg);
 
+/*
+ * Pipelined request submission. Requests are packed into one buffer and
+ * sent together; replies and ACKs are collected only once @window
+ * requests are outstanding, instead of one round trip per request.
+ * The filter is called for every reply: data messages are passed with
+ * @error set to 0, the final ACK of each request is passed as the
+ * NLMSG_ERROR message with @error set to its (negative) errno or 0.
+ * @cookie is the one given to rtnl_pipe_send() for that request.
+ */
+typedef int (*rtnl_pipe_filter_t)(struct nlmsghdr *n, int error,
+				  void *cookie, void *arg);
+
+#define RTNL_PIPE_BUFSIZ	16384
+#define RTNL_PIPE_MAX_WINDOW	4096
+
+struct rtnl_pipe {
+	struct rtnl_handle	*rth;
+	rtnl_pipe_filter_t	filter;
+	void			*arg;
+	unsigned int		window;
+	unsigned int		inflight;
+	unsigned int		sent;
+	unsigned int		errors;
+	unsigned int		len;
+	struct {
+		__u32		seq;
+		void		*cookie;
+	}			cookies[RTNL_PIPE_MAX_WINDOW];
+	char			buf[RTNL_PIPE_BUFSIZ];
+};
+
+void rtnl_pipe_init(struct rtnl_pipe *p, struct rtnl_handle *rth,
+		    unsigned int window, rtnl_pipe_filter_t filter, void *arg);
+int rtnl_pipe_send(struct rtnl_pipe *p, struct nlmsghdr *n, void *cookie)
+	__attribute__((warn_unused_result));
+int rtnl_pipe_flush(struct rtnl_pipe *p)
+	__attribute__((warn_unused_result));
+
 //定位到nlmsg消息尾部
 #define NLMSG_TAIL(nmsg) \
 	((struct rtattr *) (((void *) (nmsg)) + NLMSG_ALIGN((nmsg)->nlmsg_len)))
@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _NETEM_DIST_H_
+#define _NETEM_DIST_H_
+
+#include <linux/types.h>
+
+/*
+ * Binary netem distribution table (.distb).  It carries the same values
+ * as the text .dist format, little endian and behind a small header, so
+ * that tc can map it instead of parsing text.
+ */
+#define NETEM_DIST_MAGIC	0x7464656e	/* "nedt" */
+#define NETEM_DIST_VERSION	1
+
+struct netem_dist_hdr {
+	__u32	magic;
+	__u16	version;
+	__u16	hdr_len;	/* offset of the first entry */
+	__u32	count;		/* number of __s16 entries */
+	__u32	reserved;
+};
+
+#endif /* _NETEM_DIST_H_ */
@@ -180,6 +180,8 @@ const char *format_host_r(int af, int len, const void *addr,
 		      buf, buflen)
 
 const char *format_host(int af, int lne, const void *addr);
+void resolve_address_want(int af, int len, const void *addr);
+void resolve_addresses(unsigned int timeout_ms);
 #define format_host_rta(af, rta) \
 	format_host(af, RTA_PAYLOAD(rta), RTA_DATA(rta))
 const char *rt_addr_n2a_r(int af, int len, const void *addr,
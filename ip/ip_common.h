@@ -8,6 +8,7 @@
 #include "json_print.h"
 
 extern int use_iec;
+extern int force;
 
 struct link_filter {
 	int ifindex;
@@ -15,6 +15,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <limits.h>
 #include <linux/limits.h>
 
 #include <linux/net_namespace.h>
@@ -156,16 +157,22 @@ out:
 struct nsid_cache {
 	struct hlist_node	nsid_hash;
 	struct hlist_node	name_hash;
+	struct hlist_node	ino_hash;
+	dev_t			dev;
+	ino_t			ino;
 	int			nsid;
 	char			name[0];
 };
 
-#define NSIDMAP_SIZE		128
+#define NSIDMAP_SIZE		1024
 #define NSID_HASH_NSID(nsid)	(nsid & (NSIDMAP_SIZE - 1))
 #define NSID_HASH_NAME(name)	(namehash(name) & (NSIDMAP_SIZE - 1))
+#define NSID_HASH_INO(ino)	((unsigned int)(ino) & (NSIDMAP_SIZE - 1))
 
 static struct hlist_head	nsid_head[NSIDMAP_SIZE];
 static struct hlist_head	name_head[NSIDMAP_SIZE];
+static struct hlist_head	ino_head[NSIDMAP_SIZE];
+static int			nsid_map_initialized;
 
 static struct nsid_cache *netns_map_get_by_nsid(int nsid)
 {
@@ -186,6 +193,38 @@ static struct nsid_cache *netns_map_get_by_nsid(int nsid)
 	return NULL;
 }
 
+static struct nsid_cache *netns_map_get_by_name(const char *name)
+{
+	struct hlist_node *n;
+	uint32_t h;
+
+	h = NSID_HASH_NAME(name);
+	hlist_for_each(n, &name_head[h]) {
+		struct nsid_cache *c = container_of(n, struct nsid_cache,
+						    name_hash);
+		if (strcmp(c->name, name) == 0)
+			return c;
+	}
+
+	return NULL;
+}
+
+static struct nsid_cache *netns_map_get_by_ino(dev_t dev, ino_t ino)
+{
+	struct hlist_node *n;
+	uint32_t h;
+
+	h = NSID_HASH_INO(ino);
+	hlist_for_each(n, &ino_head[h]) {
+		struct nsid_cache *c = container_of(n, struct nsid_cache,
+						    ino_hash);
+		if (c->ino == ino && c->dev == dev)
+			return c;
+	}
+
+	return NULL;
+}
+
 char *get_name_from_nsid(int nsid)
 {
 	struct nsid_cache *c;
@@ -203,38 +242,61 @@ char *get_name_from_nsid(int nsid)
 	return NULL;
 }
 
-static int netns_map_add(int nsid, const char *name)
+static struct nsid_cache *netns_map_add(int nsid, const char *name,
+					const struct stat *st)
 {
 	struct nsid_cache *c;
 	uint32_t h;
 
-	if (netns_map_get_by_nsid(nsid) != NULL)
-		return -EEXIST;
-
-	c = malloc(sizeof(*c) + strlen(name) + 1);
+	c = calloc(1, sizeof(*c) + strlen(name) + 1);
 	if (c == NULL) {
 		perror("malloc");
-		return -ENOMEM;
+		return NULL;
 	}
 	c->nsid = nsid;
 	strcpy(c->name, name);
 
-	h = NSID_HASH_NSID(nsid);
-	hlist_add_head(&c->nsid_hash, &nsid_head[h]);
+	/* Aliases of one namespace share the id, keep the first name */
+	if (nsid >= 0 && netns_map_get_by_nsid(nsid) == NULL) {
+		h = NSID_HASH_NSID(nsid);
+		hlist_add_head(&c->nsid_hash, &nsid_head[h]);
+	}
 
 	h = NSID_HASH_NAME(name);
 	hlist_add_head(&c->name_hash, &name_head[h]);
 
-	return 0;
+	if (st && netns_map_get_by_ino(st->st_dev, st->st_ino) == NULL) {
+		c->dev = st->st_dev;
+		c->ino = st->st_ino;
+		h = NSID_HASH_INO(c->ino);
+		hlist_add_head(&c->ino_hash, &ino_head[h]);
+	}
+
+	return c;
 }
 
 static void netns_map_del(struct nsid_cache *c)
 {
 	hlist_del(&c->name_hash);
-	hlist_del(&c->nsid_hash);
+	if (c->nsid_hash.pprev)
+		hlist_del(&c->nsid_hash);
+	if (c->ino_hash.pprev)
+		hlist_del(&c->ino_hash);
 	free(c);
 }
 
+static void netns_map_flush(void)
+{
+	struct hlist_node *n, *tmp;
+	int i;
+
+	for (i = 0; i < NSIDMAP_SIZE; i++)
+		hlist_for_each_safe(n, tmp, &name_head[i])
+			netns_map_del(container_of(n, struct nsid_cache,
+						   name_hash));
+	nsid_map_initialized = 0;
+}
+
 void netns_nsid_socket_init(void)
 {
 	if (rtnsh.fd > -1 || !ipnetns_have_nsid())
@@ -247,62 +309,212 @@ void netns_nsid_socket_init(void)
 
 }
 
-void netns_map_init(void)
+/* Number of RTM_GETNSID requests kept in flight while building the map */
+#define NSID_MAP_BATCH		256
+
+struct nsid_map_req {
+	char		*name;
+	struct stat	st;
+	int		fd;
+	int		nsid;
+	int		alias;
+};
+
+struct nsid_map_ctx {
+	struct nsid_map_req	*reqs;
+	unsigned int		count;
+	unsigned int		assigned;
+	unsigned int		resolved;
+};
+
+static int netns_map_dump_req(struct nlmsghdr *nlh, int reqlen)
 {
-	static int initialized;
-	struct dirent *entry;
-	DIR *dir;
-	int nsid;
+	return 0;
+}
 
-	if (initialized || !ipnetns_have_nsid())
-		return;
+static int netns_map_count_nsid(struct nlmsghdr *n, void *arg)
+{
+	struct nsid_map_ctx *ctx = arg;
 
-	dir = opendir(NETNS_RUN_DIR);
-	if (!dir)
-		return;
+	if (n->nlmsg_type == RTM_NEWNSID)
+		ctx->assigned++;
+	return 0;
+}
 
-	while ((entry = readdir(dir)) != NULL) {
-		if (strcmp(entry->d_name, ".") == 0)
-			continue;
-		if (strcmp(entry->d_name, "..") == 0)
+static int netns_map_reply(struct nlmsghdr *n, int error, void *cookie,
+			   void *arg)
+{
+	struct nsid_map_ctx *ctx = arg;
+	struct nsid_map_req *r = cookie;
+	struct rtgenmsg *rthdr = NLMSG_DATA(n);
+	struct rtattr *tb[NETNSA_MAX + 1];
+	int len = n->nlmsg_len - NLMSG_SPACE(sizeof(*rthdr));
+
+	if (n->nlmsg_type != RTM_NEWNSID || len < 0 || !r)
+		return 0;
+
+	parse_rtattr(tb, NETNSA_MAX, NETNS_RTA(rthdr), len);
+	if (!tb[NETNSA_NSID])
+		return 0;
+
+	r->nsid = rta_getattr_s32(tb[NETNSA_NSID]);
+	if (r->nsid >= 0)
+		ctx->resolved++;
+	return 0;
+}
+
+/* Resolve nsids of one batch of opened namespace files in a single
+ * pipelined exchange; requests are only sent for inodes not seen yet.
+ */
+static void netns_map_resolve(struct nsid_map_ctx *ctx)
+{
+	struct rtnl_pipe *pipe;
+	unsigned int i;
+
+	pipe = malloc(sizeof(*pipe));
+	if (!pipe) {
+		perror("malloc");
+		return;
+	}
+	rtnl_pipe_init(pipe, &rtnsh, NSID_MAP_BATCH, netns_map_reply, ctx);
+	rtnsh.flags |= RTNL_HANDLE_F_SUPPRESS_NLERR;
+
+	for (i = 0; i < ctx->count; i++) {
+		struct nsid_map_req *r = &ctx->reqs[i];
+		struct {
+			struct nlmsghdr n;
+			struct rtgenmsg g;
+			char            buf[64];
+		} req = {
+			.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg)),
+			.n.nlmsg_type = RTM_GETNSID,
+			.g.rtgen_family = AF_UNSPEC,
+		};
+
+		if (r->fd < 0)
 			continue;
-		nsid = get_netnsid_from_name(entry->d_name);
 
-		if (nsid >= 0)
-			netns_map_add(nsid, entry->d_name);
+		addattr32(&req.n, sizeof(req), NETNSA_FD, r->fd);
+		if (rtnl_pipe_send(pipe, &req.n, r) < 0)
+			break;
 	}
-	closedir(dir);
-	initialized = 1;
+	if (rtnl_pipe_flush(pipe) < 0)
+		fprintf(stderr, "Cannot resolve nsid of named namespaces\n");
+
+	rtnsh.flags &= ~RTNL_HANDLE_F_SUPPRESS_NLERR;
+	free(pipe);
+
+	for (i = 0; i < ctx->count; i++) {
+		struct nsid_map_req *r = &ctx->reqs[i];
+
+		if (r->alias >= 0)
+			r->nsid = ctx->reqs[r->alias].nsid;
+		if (r->fd >= 0) {
+			close(r->fd);
+			r->fd = -1;
+		}
+		netns_map_add(r->nsid, r->name,
+				r->st.st_ino ? &r->st : NULL);
+		free(r->name);
+	}
+	ctx->count = 0;
 }
 
-static int netns_get_name(int nsid, char *name)
+/* Build the name/nsid/inode map of NETNS_RUN_DIR. One RTM_GETNSID dump
+ * tells how many peers have an id at all, so resolution stops as soon as
+ * every assigned id has been matched with a file, and namespaces bound
+ * under several names are only queried once.
+ */
+void netns_map_init(void)
 {
+	struct nsid_map_ctx ctx = {};
 	struct dirent *entry;
 	DIR *dir;
-	int id;
 
-	if (nsid < 0)
-		return -EINVAL;
+	if (nsid_map_initialized || !ipnetns_have_nsid())
+		return;
 
 	dir = opendir(NETNS_RUN_DIR);
 	if (!dir)
-		return -ENOENT;
+		return;
+
+	if (rtnl_nsiddump_req_filter_fn(&rtnsh, AF_UNSPEC,
+					netns_map_dump_req) < 0 ||
+	    rtnl_dump_filter(&rtnsh, netns_map_count_nsid, &ctx) < 0)
+		ctx.assigned = UINT_MAX;
+
+	ctx.reqs = calloc(NSID_MAP_BATCH, sizeof(*ctx.reqs));
+	if (!ctx.reqs) {
+		perror("calloc");
+		closedir(dir);
+		return;
+	}
 
 	while ((entry = readdir(dir)) != NULL) {
+		struct nsid_map_req *r;
+		struct nsid_cache *c;
+		unsigned int i;
+
 		if (strcmp(entry->d_name, ".") == 0)
 			continue;
 		if (strcmp(entry->d_name, "..") == 0)
 			continue;
-		id = get_netnsid_from_name(entry->d_name);
 
-		if (id >= 0 && nsid == id) {
-			strcpy(name, entry->d_name);
-			closedir(dir);
-			return 0;
+		r = &ctx.reqs[ctx.count];
+		memset(r, 0, sizeof(*r));
+		r->fd = -1;
+		r->nsid = -1;
+		r->alias = -1;
+		r->name = strdup(entry->d_name);
+		if (!r->name)
+			break;
+		ctx.count++;
+
+		/* Every id is accounted for, the rest are unassigned */
+		if (ctx.resolved >= ctx.assigned)
+			goto next;
+
+		r->fd = netns_get_fd(entry->d_name);
+		if (r->fd < 0)
+			goto next;
+
+		if (fstat(r->fd, &r->st) < 0) {
+			memset(&r->st, 0, sizeof(r->st));
+			goto next;
 		}
+
+		c = netns_map_get_by_ino(r->st.st_dev, r->st.st_ino);
+		if (c)
+			r->nsid = c->nsid;
+		for (i = 0; !c && i < ctx.count - 1; i++) {
+			if (ctx.reqs[i].fd >= 0 &&
+			    ctx.reqs[i].st.st_ino == r->st.st_ino &&
+			    ctx.reqs[i].st.st_dev == r->st.st_dev) {
+				r->alias = i;
+				break;
+			}
+		}
+		if (c || r->alias >= 0) {
+			close(r->fd);
+			r->fd = -1;
+		}
+next:
+		if (ctx.count == NSID_MAP_BATCH)
+			netns_map_resolve(&ctx);
 	}
+	if (ctx.count)
+		netns_map_resolve(&ctx);
+
+	free(ctx.reqs);
 	closedir(dir);
-	return -ENOENT;
+	nsid_map_initialized = 1;
+}
+
+static int netns_map_refresh(void)
+{
+	netns_map_flush();
+	netns_map_init();
+	return nsid_map_initialized ? 0 : -1;
 }
 
 int print_nsid(struct nlmsghdr *n, void *arg)
@@ -312,7 +524,6 @@ int print_nsid(struct nlmsghdr *n, void *arg)
 	int len = n->nlmsg_len;
 	FILE *fp = (FILE *)arg;
 	struct nsid_cache *c;
-	char name[NAME_MAX];
 	int nsid, current;
 
 	if (n->nlmsg_type != RTM_NEWNSID && n->nlmsg_type != RTM_DELNSID)
@@ -352,20 +563,19 @@ int print_nsid(struct nlmsghdr *n, void *arg)
 	}
 
 	c = netns_map_get_by_nsid(tb[NETNSA_CURRENT_NSID] ? current : nsid);
+
+	/* A new nsid notification might not be in cache yet, rebuild it */
+	if (c == NULL && n->nlmsg_type == RTM_NEWNSID && n->nlmsg_seq == 0 &&
+	    !tb[NETNSA_CURRENT_NSID] && netns_map_refresh() == 0)
+		c = netns_map_get_by_nsid(nsid);
+
 	if (c != NULL) {
 		print_string(PRINT_ANY, "name",
 			     "(iproute2 netns name: %s)", c->name);
-		netns_map_del(c);
+		if (n->nlmsg_type == RTM_DELNSID)
+			netns_map_del(c);
 	}
 
-	/* nsid might not be in cache */
-	if (c == NULL && n->nlmsg_type == RTM_NEWNSID)
-		if (netns_get_name(nsid, name) == 0) {
-			print_string(PRINT_ANY, "name",
-				     "(iproute2 netns name: %s)", name);
-			netns_map_add(nsid, name);
-		}
-
 	print_string(PRINT_FP, NULL, "\n", NULL);
 	close_json_object();
 	fflush(fp);
@@ -489,8 +699,8 @@ static int netns_list_id(int argc, char **argv)
 static int netns_list(int argc, char **argv)
 {
 	struct dirent *entry;
+	struct nsid_cache *c;
 	DIR *dir;
-	int id;
 
 	dir = opendir(NETNS_RUN_DIR);
 	if (!dir)
@@ -507,9 +717,10 @@ static int netns_list(int argc, char **argv)
 		print_string(PRINT_ANY, "name",
 			     "%s", entry->d_name);
 		if (ipnetns_have_nsid()) {
-			id = get_netnsid_from_name(entry->d_name);
-			if (id >= 0)
-				print_int(PRINT_ANY, "id", " (id: %d)", id);
+			c = netns_map_get_by_name(entry->d_name);
+			if (c && c->nsid >= 0)
+				print_int(PRINT_ANY, "id", " (id: %d)",
+					  c->nsid);
 		}
 		print_string(PRINT_FP, NULL, "\n", NULL);
 		close_json_object();
@@ -6,6 +6,10 @@
 #include <string.h>
 #include <sys/param.h>
 #include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/if_bridge.h>
+#include <linux/if_bonding.h>
 
 #include "list.h"
 #include "utils.h"
@@ -740,12 +744,21 @@ static void ipstats_show_group(const struct ipstats_sel *sel)
 	}
 }
 
+static bool
+ipstats_desc_has_rates(const struct ipstats_stat_desc *desc,
+		       const __u64 *nonzero);
+
+/* When @nonzero is given, only suites with a nonzero counter are shown
+ * and the return value is the number of suites printed.
+ */
 static int
-ipstats_process_ifsm(struct nlmsghdr *answer,
-		     struct ipstats_stat_enabled *enabled)
+__ipstats_process_ifsm(struct nlmsghdr *answer,
+		       struct ipstats_stat_enabled *enabled,
+		       const __u64 *nonzero)
 {
 	struct ipstats_stat_show_attrs show_attrs = {};
 	const char *dev;
+	int shown = 0;
 	int err = 0;
 	int i;
 
@@ -766,6 +779,9 @@ ipstats_process_ifsm(struct nlmsghdr *answer,
 	for (i = 0; i < enabled->nenabled; i++) {
 		const struct ipstats_stat_desc *desc = enabled->enabled[i].desc;
 
+		if (nonzero && !ipstats_desc_has_rates(desc, nonzero))
+			continue;
+
 		open_json_object(NULL);
 		print_int(PRINT_ANY, "ifindex", "%d:",
 			  show_attrs.ifsm->ifindex);
@@ -777,13 +793,23 @@ ipstats_process_ifsm(struct nlmsghdr *answer,
 			goto out;
 		close_json_object();
 		print_nl();
+		shown++;
 	}
 
 out:
 	ipstats_stat_show_attrs_free(&show_attrs);
+	if (err == 0 && nonzero)
+		return shown;
 	return err;
 }
 
+static int
+ipstats_process_ifsm(struct nlmsghdr *answer,
+		     struct ipstats_stat_enabled *enabled)
+{
+	return __ipstats_process_ifsm(answer, enabled, NULL);
+}
+
 static bool
 ipstats_req_should_filter_at(struct ipstats_stat_dump_filters *filters, int at)
 {
@@ -899,6 +925,356 @@ ipstats_show_do(int ifindex, struct ipstats_stat_enabled *enabled)
 	return rc;
 }
 
+/* Periodic sampling. The previous RTM_GETSTATS answer of every netdevice
+ * is kept in a table keyed by ifindex. Each tick, a copy of the new answer
+ * has its counters replaced by the per-second rate (or the delta) against
+ * the previous one, and the regular suite printers show that copy.
+ */
+#define IPSTATS_SAMPLE_HSIZE	1024
+
+struct ipstats_sample {
+	struct hlist_node	hash;
+	int			ifindex;
+	unsigned int		gen;
+	struct nlmsghdr		*n;
+};
+
+struct ipstats_sampler {
+	struct ipstats_stat_enabled	*enabled;
+	struct hlist_head		ht[IPSTATS_SAMPLE_HSIZE];
+	unsigned int			gen;
+	__u64				elapsed_ms;
+	bool				delta;
+	__u64				nonzero[IFLA_STATS_MAX + 1];
+};
+
+enum ipstats_rate_kind {
+	IPSTATS_RATE_COPY,
+	IPSTATS_RATE_NEST,
+	IPSTATS_RATE_COUNTERS,
+};
+
+#define IPSTATS_RATE_DEPTH	4
+
+/* Classify the attribute at @path: a nest to descend into, a block of
+ * __u64 counters, or state that is passed through unchanged.
+ */
+static enum ipstats_rate_kind ipstats_rate_kind(const int *path, int depth)
+{
+	switch (path[0]) {
+	case IFLA_STATS_LINK_64:
+		return IPSTATS_RATE_COUNTERS;
+	case IFLA_STATS_LINK_XSTATS:
+	case IFLA_STATS_LINK_XSTATS_SLAVE:
+		if (depth <= 2)
+			return IPSTATS_RATE_NEST;
+		if (depth == 3 && path[1] == LINK_XSTATS_TYPE_BOND &&
+		    path[2] == BOND_XSTATS_3AD)
+			return IPSTATS_RATE_NEST;
+		if (path[1] == LINK_XSTATS_TYPE_BRIDGE &&
+		    path[2] == BRIDGE_XSTATS_VLAN)
+			return IPSTATS_RATE_COPY;
+		return IPSTATS_RATE_COUNTERS;
+	case IFLA_STATS_LINK_OFFLOAD_XSTATS:
+		if (depth == 1)
+			return IPSTATS_RATE_NEST;
+		if (path[1] == IFLA_OFFLOAD_XSTATS_HW_S_INFO)
+			return IPSTATS_RATE_COPY;
+		return IPSTATS_RATE_COUNTERS;
+	case IFLA_STATS_AF_SPEC:
+		if (depth <= 2)
+			return IPSTATS_RATE_NEST;
+		return IPSTATS_RATE_COUNTERS;
+	}
+
+	return IPSTATS_RATE_COPY;
+}
+
+static const struct rtattr *
+ipstats_rate_find(const struct rtattr *rta, int len, unsigned short type)
+{
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+		if ((rta->rta_type & NLA_TYPE_MASK) == type)
+			return rta;
+
+	return NULL;
+}
+
+static bool ipstats_rate_counters(struct ipstats_sampler *sampler,
+				  struct rtattr *rta,
+				  const struct rtattr *old)
+{
+	size_t n = RTA_PAYLOAD(rta) / sizeof(__u64);
+	bool nonzero = false;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		__u64 *p = (__u64 *)RTA_DATA(rta) + i;
+		__u64 cur, prev = 0, d;
+
+		memcpy(&cur, p, sizeof(cur));
+		if (old && RTA_PAYLOAD(old) == RTA_PAYLOAD(rta))
+			memcpy(&prev, (__u64 *)RTA_DATA(old) + i,
+			       sizeof(prev));
+		else
+			prev = cur;
+
+		/* A counter going backwards was reset, count from zero */
+		d = cur >= prev ? cur - prev : cur;
+		if (!sampler->delta && sampler->elapsed_ms)
+			d = d * 1000 / sampler->elapsed_ms;
+
+		memcpy(p, &d, sizeof(d));
+		if (d)
+			nonzero = true;
+	}
+
+	return nonzero;
+}
+
+static void ipstats_rate_walk(struct ipstats_sampler *sampler,
+			      struct rtattr *rta, int len,
+			      const struct rtattr *orta, int olen,
+			      int *path, int depth)
+{
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		unsigned short type = rta->rta_type & NLA_TYPE_MASK;
+		const struct rtattr *old;
+		bool nonzero = false;
+
+		old = orta ? ipstats_rate_find(orta, olen, type) : NULL;
+		path[depth] = type;
+
+		switch (ipstats_rate_kind(path, depth + 1)) {
+		case IPSTATS_RATE_COPY:
+			continue;
+		case IPSTATS_RATE_NEST:
+			if (depth + 1 >= IPSTATS_RATE_DEPTH)
+				continue;
+			ipstats_rate_walk(sampler, RTA_DATA(rta),
+					  RTA_PAYLOAD(rta),
+					  old ? RTA_DATA(old) : NULL,
+					  old ? RTA_PAYLOAD(old) : 0,
+					  path, depth + 1);
+			continue;
+		case IPSTATS_RATE_COUNTERS:
+			nonzero = ipstats_rate_counters(sampler, rta, old);
+			break;
+		}
+
+		if (!nonzero || path[0] > IFLA_STATS_MAX)
+			continue;
+
+		/* Remember which (group, subgroup) saw traffic, in the
+		 * layout of the dump filter masks.
+		 */
+		if (depth == 0 || path[1] == 0 || path[1] > 64)
+			sampler->nonzero[path[0]] = ~0ULL;
+		else
+			sampler->nonzero[path[0]] |= 1ULL << (path[1] - 1);
+	}
+}
+
+static bool
+ipstats_desc_has_rates(const struct ipstats_stat_desc *desc,
+		       const __u64 *nonzero)
+{
+	struct ipstats_stat_dump_filters filters = {};
+	int at;
+
+	desc->pack(&filters, desc);
+	for (at = 1; at <= IFLA_STATS_MAX; at++) {
+		if (!(filters.mask[0] & IFLA_STATS_FILTER_BIT(at)))
+			continue;
+		if (filters.mask[at] == 0 && nonzero[at])
+			return true;
+		if (filters.mask[at] & nonzero[at])
+			return true;
+	}
+
+	return false;
+}
+
+static struct ipstats_sample *
+ipstats_sample_get(struct ipstats_sampler *sampler, int ifindex)
+{
+	struct hlist_head *head;
+	struct ipstats_sample *sample;
+	struct hlist_node *n;
+
+	head = &sampler->ht[ifindex & (IPSTATS_SAMPLE_HSIZE - 1)];
+	hlist_for_each(n, head) {
+		sample = container_of(n, struct ipstats_sample, hash);
+		if (sample->ifindex == ifindex)
+			return sample;
+	}
+
+	sample = calloc(1, sizeof(*sample));
+	if (!sample)
+		return NULL;
+	sample->ifindex = ifindex;
+	hlist_add_head(&sample->hash, head);
+	return sample;
+}
+
+static void ipstats_sampler_purge(struct ipstats_sampler *sampler, bool all)
+{
+	struct hlist_node *n, *tmp;
+	int i;
+
+	for (i = 0; i < IPSTATS_SAMPLE_HSIZE; i++) {
+		hlist_for_each_safe(n, tmp, &sampler->ht[i]) {
+			struct ipstats_sample *sample;
+
+			sample = container_of(n, struct ipstats_sample, hash);
+			if (!all && sample->gen == sampler->gen)
+				continue;
+			hlist_del(&sample->hash);
+			free(sample->n);
+			free(sample);
+		}
+	}
+}
+
+static int ipstats_sample_one(struct nlmsghdr *n, void *arg)
+{
+	struct ipstats_sampler *sampler = arg;
+	struct if_stats_msg *ifsm = NLMSG_DATA(n);
+	int path[IPSTATS_RATE_DEPTH] = {};
+	struct ipstats_sample *sample;
+	struct if_stats_msg *oifsm;
+	struct nlmsghdr *rate;
+	int len, olen;
+	int rc = 0;
+
+	len = n->nlmsg_len - NLMSG_LENGTH(sizeof(*ifsm));
+	if (len < 0) {
+		fprintf(stderr, "BUG: wrong nlmsg len %d\n", len);
+		return -EINVAL;
+	}
+
+	sample = ipstats_sample_get(sampler, ifsm->ifindex);
+	if (!sample)
+		return -ENOMEM;
+	sample->gen = sampler->gen;
+
+	rate = malloc(n->nlmsg_len);
+	if (!rate)
+		return -ENOMEM;
+	memcpy(rate, n, n->nlmsg_len);
+
+	/* The first answer of a netdevice only primes the table */
+	if (sample->n) {
+		oifsm = NLMSG_DATA(sample->n);
+		olen = sample->n->nlmsg_len - NLMSG_LENGTH(sizeof(*oifsm));
+
+		ifsm = NLMSG_DATA(rate);
+		memset(sampler->nonzero, 0, sizeof(sampler->nonzero));
+		ipstats_rate_walk(sampler, IFLA_STATS_RTA(ifsm), len,
+				  IFLA_STATS_RTA(oifsm), olen, path, 0);
+
+		rc = __ipstats_process_ifsm(rate, sampler->enabled,
+					    sampler->nonzero);
+		if (rc > 0) {
+			print_nl();
+			rc = 0;
+		}
+
+		/* Keep the answer just received as the next baseline */
+		memcpy(rate, n, n->nlmsg_len);
+	}
+
+	free(sample->n);
+	sample->n = rate;
+	return rc;
+}
+
+static int ipstats_sample_tick(struct ipstats_sampler *sampler, int ifindex)
+{
+	struct ipstats_req req = {
+		.nlh.nlmsg_flags = NLM_F_REQUEST,
+		.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct if_stats_msg)),
+		.nlh.nlmsg_type = RTM_GETSTATS,
+		.ifsm.family = PF_UNSPEC,
+		.ifsm.ifindex = ifindex,
+	};
+	struct nlmsghdr *answer;
+	int rc;
+
+	sampler->gen++;
+	if (ifindex) {
+		ipstats_req_add_filters(&req, sampler->enabled);
+		if (rtnl_talk(&rth, &req.nlh, &answer) < 0)
+			return -2;
+		rc = ipstats_sample_one(answer, sampler);
+		free(answer);
+	} else {
+		if (rtnl_statsdump_req_filter(&rth, PF_UNSPEC, 0,
+					      ipstats_req_add_filters,
+					      sampler->enabled) < 0) {
+			perror("Cannot send dump request");
+			return -2;
+		}
+
+		rc = rtnl_dump_filter(&rth, ipstats_sample_one, sampler);
+		if (rc < 0)
+			fprintf(stderr, "Dump terminated\n");
+	}
+
+	/* Forget netdevices that went away */
+	ipstats_sampler_purge(sampler, false);
+	return rc;
+}
+
+static __u64 ipstats_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (__u64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int
+ipstats_sample_do(int ifindex, struct ipstats_stat_enabled *enabled,
+		  unsigned int interval, unsigned int count, bool delta)
+{
+	struct ipstats_sampler *sampler;
+	__u64 last, next, now;
+	unsigned int i;
+	int rc;
+
+	sampler = calloc(1, sizeof(*sampler));
+	if (!sampler)
+		return -ENOMEM;
+	sampler->enabled = enabled;
+	sampler->delta = delta;
+
+	last = next = ipstats_now_ms();
+	rc = ipstats_sample_tick(sampler, ifindex);
+
+	for (i = 0; rc >= 0 && (!count || i < count); i++) {
+		next += (__u64)interval * 1000;
+		now = ipstats_now_ms();
+		if (next > now)
+			usleep((next - now) * 1000);
+
+		now = ipstats_now_ms();
+		sampler->elapsed_ms = now - last;
+		last = now;
+
+		new_json_obj(json);
+		if (timestamp)
+			print_timestamp(stdout);
+		rc = ipstats_sample_tick(sampler, ifindex);
+		delete_json_obj();
+		fflush(stdout);
+	}
+
+	ipstats_sampler_purge(sampler, true);
+	free(sampler);
+	return rc;
+}
+
 static int ipstats_add_enabled(struct ipstats_stat_enabled_one ens[],
 			       size_t nens,
 			       struct ipstats_stat_enabled *enabled)
@@ -1094,6 +1470,7 @@ static int do_help(void)
 	fprintf(stderr,
 		"Usage: ip stats help\n"
 		"       ip stats show [ dev DEV ] [ group GROUP [ subgroup SUBGROUP [ suite SUITE ] ... ] ... ] ...\n"
+		"                     [ interval SECONDS [ count COUNT ] [ delta ] ]\n"
 		"       ip stats set dev DEV l3_stats { on | off }\n"
 		);
 
@@ -1176,7 +1553,10 @@ static int ipstats_show(int argc, char **argv)
 {
 	struct ipstats_stat_enabled enabled = {};
 	struct ipstats_sel sel = {};
+	unsigned int interval = 0;
+	unsigned int count = 0;
 	const char *dev = NULL;
+	bool delta = false;
 	int ifindex;
 	int err;
 	int i;
@@ -1189,6 +1569,20 @@ static int ipstats_show(int argc, char **argv)
 			if (check_ifname(*argv))
 				invarg("\"dev\" not a valid ifname", *argv);
 			dev = *argv;
+		} else if (strcmp(*argv, "interval") == 0) {
+			NEXT_ARG();
+			if (interval)
+				duparg2("interval", *argv);
+			if (get_unsigned(&interval, *argv, 0) || !interval)
+				invarg("\"interval\" value is invalid", *argv);
+		} else if (strcmp(*argv, "count") == 0) {
+			NEXT_ARG();
+			if (count)
+				duparg2("count", *argv);
+			if (get_unsigned(&count, *argv, 0) || !count)
+				invarg("\"count\" value is invalid", *argv);
+		} else if (strcmp(*argv, "delta") == 0) {
+			delta = true;
 		} else if (strcmp(*argv, "help") == 0) {
 			do_help();
 			return 0;
@@ -1233,8 +1627,18 @@ static int ipstats_show(int argc, char **argv)
 		ifindex = 0;
 	}
 
+	if ((count || delta) && !interval) {
+		fprintf(stderr, "Error: \"%s\" requires \"interval\".\n",
+			count ? "count" : "delta");
+		err = -EINVAL;
+		goto err;
+	}
 
-	err = ipstats_show_do(ifindex, &enabled);
+	if (interval)
+		err = ipstats_sample_do(ifindex, &enabled, interval, count,
+					delta);
+	else
+		err = ipstats_show_do(ifindex, &enabled);
 
 err:
 	ipstats_enabled_free(&enabled);
@@ -9,6 +9,7 @@
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/mount.h>
+#include <sys/vfs.h>
 #include <linux/bpf.h>
 #include <linux/if.h>
 #include <fcntl.h>
@@ -26,6 +27,7 @@
 #include "bpf_util.h"
 
 #define CGRP_PROC_FILE  "/cgroup.procs"
+#define VRF_PROG_DIR	BPF_DIR_MNT "/ip/vrf"
 
 static struct link_filter vrf_filter;
 
@@ -257,6 +259,113 @@ static int prog_load(int idx)
 				"GPL", bpf_log_buf, sizeof(bpf_log_buf));
 }
 
+/*
+ * The program only depends on the ifindex it writes, so a loaded copy is
+ * pinned in bpffs under VRF_PROG_DIR/sk_bind_IFINDEX and picked up by
+ * later execs instead of going through the verifier again.  A VRF that
+ * is recreated with a new ifindex simply maps to a different pin; the
+ * pins of ifindexes that are no VRF any more are swept whenever a new
+ * one is made.  Caching is skipped silently when bpffs is not mounted.
+ */
+static int prog_pin_path(char *path, size_t len, int idx)
+{
+	struct statfs st;
+
+	if (statfs(BPF_DIR_MNT, &st) < 0 || st.f_type != BPF_FS_MAGIC)
+		return -1;
+
+	snprintf(path, len, "%s/sk_bind_%d", VRF_PROG_DIR, idx);
+	return 0;
+}
+
+static int prog_get_pinned(const char *path)
+{
+	struct bpf_prog_info info = {};
+	union bpf_attr attr = {};
+	int fd;
+
+	attr.pathname = (unsigned long)path;
+	fd = bpf(BPF_OBJ_GET, &attr, sizeof(attr));
+	if (fd < 0)
+		return -1;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.info.bpf_fd = fd;
+	attr.info.info_len = sizeof(info);
+	attr.info.info = (unsigned long)&info;
+	if (bpf(BPF_OBJ_GET_INFO_BY_FD, &attr, sizeof(attr)) < 0 ||
+	    info.type != BPF_PROG_TYPE_CGROUP_SOCK) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void prog_pin(int fd, const char *path)
+{
+	union bpf_attr attr = {};
+
+	if (make_path(VRF_PROG_DIR, 0700))
+		return;
+
+	attr.pathname = (unsigned long)path;
+	attr.bpf_fd = fd;
+
+	/* losing a race with a concurrent exec (EEXIST) is harmless */
+	bpf(BPF_OBJ_PIN, &attr, sizeof(attr));
+}
+
+/*
+ * Drop the pins of ifindexes that are not a VRF (here).  Attached copies
+ * are held by their cgroups, so a pin removed for a VRF of another netns
+ * only costs that netns one more load.
+ */
+static void prog_sweep_pins(void)
+{
+	char path[PATH_MAX];
+	struct dirent *de;
+	DIR *d;
+	int idx;
+
+	d = opendir(VRF_PROG_DIR);
+	if (!d)
+		return;
+
+	while ((de = readdir(d)) != NULL) {
+		if (sscanf(de->d_name, "sk_bind_%d", &idx) != 1)
+			continue;
+		if (name_is_vrf(ll_index_to_name(idx)) == idx)
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", VRF_PROG_DIR,
+			 de->d_name);
+		unlink(path);
+	}
+	closedir(d);
+}
+
+static int prog_load_cached(int idx)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	if (prog_pin_path(path, sizeof(path), idx) < 0)
+		return prog_load(idx);
+
+	fd = prog_get_pinned(path);
+	if (fd >= 0)
+		return fd;
+
+	fd = prog_load(idx);
+	if (fd >= 0) {
+		prog_sweep_pins();
+		unlink(path);
+		prog_pin(fd, path);
+	}
+
+	return fd;
+}
+
 static int vrf_configure_cgroup(const char *path, int ifindex)
 {
 	int rc = -1, cg_fd, prog_fd = -1;
@@ -273,7 +382,7 @@ static int vrf_configure_cgroup(const char *path, int ifindex)
 	 * Load bpf program into kernel and attach to cgroup to affect
 	 * socket creates
 	 */
-	prog_fd = prog_load(ifindex);
+	prog_fd = prog_load_cached(ifindex);
 	if (prog_fd < 0) {
 		fprintf(stderr, "Failed to load BPF prog: '%s'\n%s",
 			strerror(errno), bpf_log_buf);
@@ -9,6 +9,7 @@
  */
 
 #include <alloca.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,6 +35,7 @@ static void usage(void)
 {
 	fprintf(stderr,
 		"Usage: ip xfrm XFRM-OBJECT { COMMAND | help }\n"
+		"       ip xfrm bulk { FILE | - } [ window NUMBER ]\n"
 		"where  XFRM-OBJECT := state | policy | monitor\n");
 	exit(-1);
 }
@@ -481,67 +483,79 @@ void xfrm_selector_print(struct xfrm_selector *sel, __u16 family,
 	fprintf(fp, "%s", _SL_);
 }
 
-static void __xfrm_algo_print(struct xfrm_algo *algo, int type, int len,
-			      FILE *fp, const char *prefix, int newline,
-			      bool nokeys)
+static void __xfrm_algo_print(const char *name, const char *key,
+			      unsigned int key_bits, int type, int len,
+			      FILE *fp, const char *prefix, bool nokeys)
 {
+	static const char hex[] = "0123456789abcdef";
+	char kbuf[2 * 64 + 1];
 	int keylen;
-	int i;
+	int i, j;
 
 	if (prefix)
 		fputs(prefix, fp);
 
 	fprintf(fp, "%s ", strxf_algotype(type));
 
-	if (len < sizeof(*algo)) {
+	if (len < 0) {
 		fprintf(fp, "(ERROR truncated)");
-		goto fin;
+		return;
 	}
-	len -= sizeof(*algo);
 
-	fprintf(fp, "%s ", algo->alg_name);
+	fprintf(fp, "%s ", name);
 
-	keylen = algo->alg_key_len / 8;
+	keylen = key_bits / 8;
 	if (len < keylen) {
 		fprintf(fp, "(ERROR truncated)");
-		goto fin;
+		return;
 	}
 
-	if (nokeys)
+	/* Keys are neither copied nor formatted when they are hidden */
+	if (nokeys) {
 		fprintf(fp, "<<Keys hidden>>");
-	else if (keylen > 0) {
-		fprintf(fp, "0x");
-		for (i = 0; i < keylen; i++)
-			fprintf(fp, "%.2x", (unsigned char)algo->alg_key[i]);
+		return;
+	}
+	if (keylen <= 0)
+		return;
 
-		if (show_stats > 0)
-			fprintf(fp, " (%d bits)", algo->alg_key_len);
+	fputs("0x", fp);
+	for (i = 0; i < keylen; ) {
+		for (j = 0; i < keylen && j < sizeof(kbuf) - 1; i++) {
+			kbuf[j++] = hex[(unsigned char)key[i] >> 4];
+			kbuf[j++] = hex[(unsigned char)key[i] & 0xf];
+		}
+		fwrite(kbuf, 1, j, fp);
 	}
 
- fin:
-	if (newline)
-		fprintf(fp, "%s", _SL_);
+	if (show_stats > 0)
+		fprintf(fp, " (%u bits)", key_bits);
 }
 
 static inline void xfrm_algo_print(struct xfrm_algo *algo, int type, int len,
 				   FILE *fp, const char *prefix, bool nokeys)
 {
-	return __xfrm_algo_print(algo, type, len, fp, prefix, 1, nokeys);
+	if (len < sizeof(*algo))
+		__xfrm_algo_print(NULL, NULL, 0, type, -1, fp, prefix, nokeys);
+	else
+		__xfrm_algo_print(algo->alg_name, algo->alg_key,
+				  algo->alg_key_len, type,
+				  len - sizeof(*algo), fp, prefix, nokeys);
+
+	fprintf(fp, "%s", _SL_);
 }
 
 static void xfrm_aead_print(struct xfrm_algo_aead *algo, int len,
 			    FILE *fp, const char *prefix, bool nokeys)
 {
-	struct xfrm_algo *base_algo = alloca(sizeof(*base_algo) + algo->alg_key_len / 8);
-
-	memcpy(base_algo->alg_name, algo->alg_name, sizeof(base_algo->alg_name));
-	base_algo->alg_key_len = algo->alg_key_len;
-	memcpy(base_algo->alg_key, algo->alg_key, algo->alg_key_len / 8);
-
-	__xfrm_algo_print(base_algo, XFRMA_ALG_AEAD, len, fp, prefix, 0,
-			  nokeys);
-
-	fprintf(fp, " %d", algo->alg_icv_len);
+	if (len < sizeof(*algo)) {
+		__xfrm_algo_print(NULL, NULL, 0, XFRMA_ALG_AEAD, -1, fp,
+				  prefix, nokeys);
+	} else {
+		__xfrm_algo_print(algo->alg_name, algo->alg_key,
+				  algo->alg_key_len, XFRMA_ALG_AEAD,
+				  len - sizeof(*algo), fp, prefix, nokeys);
+		fprintf(fp, " %d", algo->alg_icv_len);
+	}
 
 	fprintf(fp, "%s", _SL_);
 }
@@ -549,16 +563,15 @@ static void xfrm_aead_print(struct xfrm_algo_aead *algo, int len,
 static void xfrm_auth_trunc_print(struct xfrm_algo_auth *algo, int len,
 				  FILE *fp, const char *prefix, bool nokeys)
 {
-	struct xfrm_algo *base_algo = alloca(sizeof(*base_algo) + algo->alg_key_len / 8);
-
-	memcpy(base_algo->alg_name, algo->alg_name, sizeof(base_algo->alg_name));
-	base_algo->alg_key_len = algo->alg_key_len;
-	memcpy(base_algo->alg_key, algo->alg_key, algo->alg_key_len / 8);
-
-	__xfrm_algo_print(base_algo, XFRMA_ALG_AUTH_TRUNC, len, fp, prefix, 0,
-			  nokeys);
-
-	fprintf(fp, " %d", algo->alg_trunc_len);
+	if (len < sizeof(*algo)) {
+		__xfrm_algo_print(NULL, NULL, 0, XFRMA_ALG_AUTH_TRUNC, -1, fp,
+				  prefix, nokeys);
+	} else {
+		__xfrm_algo_print(algo->alg_name, algo->alg_key,
+				  algo->alg_key_len, XFRMA_ALG_AUTH_TRUNC,
+				  len - sizeof(*algo), fp, prefix, nokeys);
+		fprintf(fp, " %d", algo->alg_trunc_len);
+	}
 
 	fprintf(fp, "%s", _SL_);
 }
@@ -1530,6 +1543,138 @@ int xfrm_lifetime_cfg_parse(struct xfrm_lifetime_cfg *lft,
 	return 0;
 }
 
+/*
+ * Bulk mode: every line of FILE is a "state" or "policy" add, update or
+ * delete command. The regular parsers build each request, which is then
+ * queued on one NETLINK_XFRM socket and pipelined with up to WINDOW
+ * requests in flight instead of waiting for every ACK.
+ */
+struct rtnl_pipe *xfrm_bulk_pipe;
+
+struct xfrm_bulk_ctx {
+	int		orig_family;
+};
+
+/* The cookie of each request is the batch line it was read from */
+static int xfrm_bulk_reply(struct nlmsghdr *n, int error, void *cookie,
+			   void *arg)
+{
+	if (n->nlmsg_type != NLMSG_ERROR || !error)
+		return 0;
+
+	fprintf(stderr, "line %u: RTNETLINK answers: %s\n",
+		(unsigned int)(uintptr_t)cookie, strerror(-error));
+	return 0;
+}
+
+int xfrm_bulk_send(struct nlmsghdr *n)
+{
+	void *line = (void *)(uintptr_t)cmdlineno;
+
+	if (rtnl_pipe_send(xfrm_bulk_pipe, n, line) < 0)
+		exit(2);
+	return 0;
+}
+
+static int xfrm_bulk_cmd(int argc, char **argv, void *data)
+{
+	struct xfrm_bulk_ctx *ctx = data;
+	const char *cmd;
+
+	preferred_family = ctx->orig_family;
+	memset(&filter, 0, sizeof(filter));
+
+	if (argc < 2)
+		goto unsupported;
+
+	cmd = argv[1];
+	if (matches(cmd, "add") != 0 && matches(cmd, "update") != 0 &&
+	    matches(cmd, "delete") != 0)
+		goto unsupported;
+
+	if (matches(*argv, "state") == 0 || matches(*argv, "sa") == 0)
+		return do_xfrm_state(argc - 1, argv + 1);
+	if (matches(*argv, "policy") == 0)
+		return do_xfrm_policy(argc - 1, argv + 1);
+
+unsupported:
+	fprintf(stderr, "line %d: only state or policy add, update and delete are supported in bulk mode\n",
+		cmdlineno);
+	return -1;
+}
+
+static int xfrm_bulk(int argc, char **argv)
+{
+	struct xfrm_bulk_ctx ctx = { .orig_family = preferred_family };
+	unsigned int window = XFRM_BULK_WINDOW;
+	struct rtnl_handle xrth;
+	const char *name;
+	int ret;
+
+	if (argc < 1) {
+		fprintf(stderr, "Not enough information: FILE is required.\n");
+		exit(-1);
+	}
+	name = *argv;
+	NEXT_ARG_FWD();
+
+	while (argc > 0) {
+		if (strcmp(*argv, "window") == 0) {
+			NEXT_ARG();
+			if (get_unsigned(&window, *argv, 0) || !window)
+				invarg("WINDOW value is invalid", *argv);
+		} else {
+			invarg("unknown", *argv);
+		}
+		argc--; argv++;
+	}
+
+	xfrm_bulk_pipe = malloc(sizeof(*xfrm_bulk_pipe));
+	if (!xfrm_bulk_pipe) {
+		perror("malloc");
+		exit(1);
+	}
+
+	if (rtnl_open_byproto(&xrth, 0, NETLINK_XFRM) < 0)
+		exit(1);
+	rtnl_pipe_init(xfrm_bulk_pipe, &xrth, window, xfrm_bulk_reply, &ctx);
+
+	ret = do_batch(name, force, xfrm_bulk_cmd, &ctx);
+
+	if (rtnl_pipe_flush(xfrm_bulk_pipe) < 0)
+		ret = EXIT_FAILURE;
+	if (xfrm_bulk_pipe->errors)
+		ret = EXIT_FAILURE;
+	if (show_stats || xfrm_bulk_pipe->errors)
+		fprintf(stderr, "%u requests sent, %u failed\n",
+			xfrm_bulk_pipe->sent, xfrm_bulk_pipe->errors);
+
+	rtnl_close(&xrth);
+	free(xfrm_bulk_pipe);
+	xfrm_bulk_pipe = NULL;
+	return ret;
+}
+
+/* Wait for the delete requests of one delete-all round. Returns -1 when
+ * none of them succeeded, so that a round cannot repeat forever.
+ */
+int xfrm_deleteall_flush(struct rtnl_pipe *pipe, int count)
+{
+	if (rtnl_pipe_flush(pipe) < 0)
+		return -1;
+
+	if (show_stats > 1)
+		fprintf(stderr, "Delete-all nlmsg count = %d, failed = %u\n",
+			count, pipe->errors);
+
+	if (count && pipe->errors >= count)
+		return -1;
+
+	pipe->errors = 0;
+	pipe->sent = 0;
+	return 0;
+}
+
 int do_xfrm(int argc, char **argv)
 {
 	memset(&filter, 0, sizeof(filter));
@@ -1544,6 +1689,8 @@ int do_xfrm(int argc, char **argv)
 		return do_xfrm_policy(argc-1, argv+1);
 	else if (matches(*argv, "monitor") == 0)
 		return do_xfrm_monitor(argc-1, argv+1);
+	else if (matches(*argv, "bulk") == 0)
+		return xfrm_bulk(argc-1, argv+1);
 	else if (matches(*argv, "help") == 0) {
 		usage();
 		fprintf(stderr, "xfrm Object \"%s\" is unknown.\n", *argv);
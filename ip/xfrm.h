@@ -47,14 +47,19 @@
 	} while(0)
 
 struct xfrm_buffer {
-	char *buf;
-	int size;
-	int offset;
+	/* scratch for the delete request being built */
+	struct {
+		struct nlmsghdr	n;
+		char		buf[512];
+	} req;
 
 	int nlmsg_count;
-	struct rtnl_handle *rth;
+	struct rtnl_pipe *pipe;
 };
 
+/* Requests kept in flight by bulk installation and delete-all */
+#define XFRM_BULK_WINDOW	1024
+
 struct xfrm_filter {
 	int use;
 
@@ -95,6 +100,10 @@ int do_xfrm_state(int argc, char **argv);
 int do_xfrm_policy(int argc, char **argv);
 int do_xfrm_monitor(int argc, char **argv);
 
+extern struct rtnl_pipe *xfrm_bulk_pipe;
+int xfrm_bulk_send(struct nlmsghdr *n);
+int xfrm_deleteall_flush(struct rtnl_pipe *pipe, int count);
+
 int xfrm_addr_match(xfrm_address_t *x1, xfrm_address_t *x2, int bits);
 int xfrm_xfrmproto_is_ipsec(__u8 proto);
 int xfrm_xfrmproto_is_ro(__u8 proto);
@@ -17,9 +17,6 @@
 #include "xfrm.h"
 #include "ip_common.h"
 
-/* #define NLMSG_DELETEALL_BUF_SIZE (4096-512) */
-#define NLMSG_DELETEALL_BUF_SIZE 8192
-
 /*
  * Receiving buffer defines:
  * nlmsg
@@ -397,12 +394,15 @@ static int xfrm_policy_modify(int cmd, unsigned int flags, int argc, char **argv
 			  sizeof(xuo));
 	}
 
-	if (rtnl_open_byproto(&rth, 0, NETLINK_XFRM) < 0)
-		exit(1);
-
 	if (req.xpinfo.sel.family == AF_UNSPEC)
 		req.xpinfo.sel.family = AF_INET;
 
+	if (xfrm_bulk_pipe)
+		return xfrm_bulk_send(&req.n);
+
+	if (rtnl_open_byproto(&rth, 0, NETLINK_XFRM) < 0)
+		exit(1);
+
 	if (rtnl_talk(&rth, &req.n, NULL) < 0)
 		exit(2);
 
@@ -668,9 +668,6 @@ static int xfrm_policy_get_or_delete(int argc, char **argv, int delete,
 	if (selp && indexp)
 		duparg2("SELECTOR", "INDEX");
 
-	if (rtnl_open_byproto(&rth, 0, NETLINK_XFRM) < 0)
-		exit(1);
-
 	if (req.xpid.sel.family == AF_UNSPEC)
 		req.xpid.sel.family = AF_INET;
 
@@ -691,6 +688,12 @@ static int xfrm_policy_get_or_delete(int argc, char **argv, int delete,
 	if (is_if_id_set)
 		addattr32(&req.n, sizeof(req.buf), XFRMA_IF_ID, if_id);
 
+	if (delete && xfrm_bulk_pipe)
+		return xfrm_bulk_send(&req.n);
+
+	if (rtnl_open_byproto(&rth, 0, NETLINK_XFRM) < 0)
+		exit(1);
+
 	if (rtnl_talk(&rth, &req.n, answer) < 0)
 		exit(2);
 
@@ -721,12 +724,11 @@ static int xfrm_policy_get(int argc, char **argv)
 
 /*
  * With an existing policy of nlmsg, make new nlmsg for deleting the policy
- * and store it to buffer.
+ * and queue it on the delete pipe while the dump goes on.
  */
 static int xfrm_policy_keep(struct nlmsghdr *n, void *arg)
 {
 	struct xfrm_buffer *xb = (struct xfrm_buffer *)arg;
-	struct rtnl_handle *rth = xb->rth;
 	struct xfrm_userpolicy_info *xpinfo = NLMSG_DATA(n);
 	int len = n->nlmsg_len;
 	struct rtattr *tb[XFRMA_MAX+1];
@@ -766,14 +768,10 @@ static int xfrm_policy_keep(struct nlmsghdr *n, void *arg)
 	if (xpinfo->dir >= XFRM_POLICY_MAX)
 		return 0;
 
-	if (xb->offset + NLMSG_LENGTH(sizeof(*xpid)) > xb->size)
-		return 0;
-
-	new_n = (struct nlmsghdr *)(xb->buf + xb->offset);
+	new_n = &xb->req.n;
 	new_n->nlmsg_len = NLMSG_LENGTH(sizeof(*xpid));
 	new_n->nlmsg_flags = NLM_F_REQUEST;
 	new_n->nlmsg_type = XFRM_MSG_DELPOLICY;
-	new_n->nlmsg_seq = ++rth->seq;
 
 	xpid = NLMSG_DATA(new_n);
 	memcpy(&xpid->sel, &xpinfo->sel, sizeof(xpid->sel));
@@ -781,7 +779,7 @@ static int xfrm_policy_keep(struct nlmsghdr *n, void *arg)
 	xpid->index = xpinfo->index;
 
 	if (tb[XFRMA_MARK]) {
-		int r = addattr_l(new_n, xb->size, XFRMA_MARK,
+		int r = addattr_l(new_n, sizeof(xb->req), XFRMA_MARK,
 				(void *)RTA_DATA(tb[XFRMA_MARK]), tb[XFRMA_MARK]->rta_len);
 		if (r < 0) {
 			fprintf(stderr, "%s: XFRMA_MARK failed\n", __func__);
@@ -790,16 +788,60 @@ static int xfrm_policy_keep(struct nlmsghdr *n, void *arg)
 	}
 
 	if (tb[XFRMA_IF_ID]) {
-		addattr32(new_n, xb->size, XFRMA_IF_ID,
+		addattr32(new_n, sizeof(xb->req), XFRMA_IF_ID,
 			  rta_getattr_u32(tb[XFRMA_IF_ID]));
 	}
 
-	xb->offset += new_n->nlmsg_len;
+	if (rtnl_pipe_send(xb->pipe, new_n, NULL) < 0)
+		return -1;
 	xb->nlmsg_count++;
 
 	return 0;
 }
 
+/*
+ * Policy indexes are unique, so "list index N" can be answered with a
+ * single XFRM_MSG_GETPOLICY instead of walking the whole SPD.  The kernel
+ * lookup also matches mark and if_id, so a miss falls back to the dump.
+ */
+static int xfrm_policy_list_by_index(struct rtnl_handle *rth)
+{
+	struct {
+		struct nlmsghdr			n;
+		struct xfrm_userpolicy_id	xpid;
+		char				buf[RTA_BUF_SIZE];
+	} req = {
+		.n.nlmsg_len = NLMSG_LENGTH(sizeof(req.xpid)),
+		.n.nlmsg_flags = NLM_F_REQUEST,
+		.n.nlmsg_type = XFRM_MSG_GETPOLICY,
+		.xpid.index = filter.xpinfo.index,
+		.xpid.dir = filter.xpinfo.index & 7,
+	};
+	struct nlmsghdr *answer;
+
+	if (!filter.index_mask || filter.filter_socket ||
+	    req.xpid.dir >= XFRM_POLICY_MAX)
+		return -1;
+
+	if (filter.ptype_mask) {
+		struct xfrm_userpolicy_type upt = { .type = filter.ptype };
+
+		addattr_l(&req.n, sizeof(req), XFRMA_POLICY_TYPE,
+			  &upt, sizeof(upt));
+	}
+
+	if (rtnl_talk_suppress_rtnl_errmsg(rth, &req.n, &answer) < 0)
+		return -1;
+
+	if (xfrm_policy_print(answer, stdout) < 0) {
+		fprintf(stderr, "An error :-)\n");
+		exit(1);
+	}
+	free(answer);
+
+	return 0;
+}
+
 static int xfrm_policy_list_or_deleteall(int argc, char **argv, int deleteall)
 {
 	char *selp = NULL;
@@ -876,12 +918,19 @@ static int xfrm_policy_list_or_deleteall(int argc, char **argv, int deleteall)
 
 	if (deleteall) {
 		struct xfrm_buffer xb;
-		char buf[NLMSG_DELETEALL_BUF_SIZE];
+		struct rtnl_handle drth;
 		int i;
 
-		xb.buf = buf;
-		xb.size = sizeof(buf);
-		xb.rth = &rth;
+		/* Deletes go out on their own socket while the dump runs */
+		if (rtnl_open_byproto(&drth, 0, NETLINK_XFRM) < 0)
+			exit(1);
+
+		xb.pipe = malloc(sizeof(*xb.pipe));
+		if (!xb.pipe) {
+			perror("malloc");
+			exit(1);
+		}
+		rtnl_pipe_init(xb.pipe, &drth, XFRM_BULK_WINDOW, NULL, NULL);
 
 		for (i = 0; ; i++) {
 			struct {
@@ -894,7 +943,6 @@ static int xfrm_policy_list_or_deleteall(int argc, char **argv, int deleteall)
 				.n.nlmsg_seq = rth.dump = ++rth.seq,
 			};
 
-			xb.offset = 0;
 			xb.nlmsg_count = 0;
 
 			if (show_stats > 1)
@@ -915,17 +963,15 @@ static int xfrm_policy_list_or_deleteall(int argc, char **argv, int deleteall)
 				break;
 			}
 
-			if (rtnl_send_check(&rth, xb.buf, xb.offset) < 0) {
-				perror("Failed to send delete-all request");
+			if (xfrm_deleteall_flush(xb.pipe, xb.nlmsg_count) < 0) {
+				fprintf(stderr, "Failed to send delete-all request\n");
 				exit(1);
 			}
-			if (show_stats > 1)
-				fprintf(stderr, "Delete-all nlmsg count = %d\n", xb.nlmsg_count);
-
-			xb.offset = 0;
-			xb.nlmsg_count = 0;
 		}
-	} else {
+
+		free(xb.pipe);
+		rtnl_close(&drth);
+	} else if (xfrm_policy_list_by_index(&rth) < 0) {
 		struct {
 			struct nlmsghdr n;
 			char buf[NLMSG_BUF_SIZE];
@@ -16,9 +16,6 @@
 #include "xfrm.h"
 #include "ip_common.h"
 
-/* #define NLMSG_DELETEALL_BUF_SIZE (4096-512) */
-#define NLMSG_DELETEALL_BUF_SIZE 8192
-
 /*
  * Receiving buffer defines:
  * nlmsg
@@ -760,12 +757,15 @@ static int xfrm_state_modify(int cmd, unsigned int flags, int argc, char **argv)
 	if (output_mark.m)
 		addattr32(&req.n, sizeof(req.buf), XFRMA_SET_MARK_MASK, output_mark.m);
 
-	if (rtnl_open_byproto(&rth, 0, NETLINK_XFRM) < 0)
-		exit(1);
-
 	if (req.xsinfo.family == AF_UNSPEC)
 		req.xsinfo.family = AF_INET;
 
+	if (xfrm_bulk_pipe)
+		return xfrm_bulk_send(&req.n);
+
+	if (rtnl_open_byproto(&rth, 0, NETLINK_XFRM) < 0)
+		exit(1);
+
 	if (rtnl_talk(&rth, &req.n, NULL) < 0)
 		exit(2);
 
@@ -1086,12 +1086,15 @@ static int xfrm_state_get_or_delete(int argc, char **argv, int delete)
 		}
 	}
 
-	if (rtnl_open_byproto(&rth, 0, NETLINK_XFRM) < 0)
-		exit(1);
-
 	if (req.xsid.family == AF_UNSPEC)
 		req.xsid.family = AF_INET;
 
+	if (delete && xfrm_bulk_pipe)
+		return xfrm_bulk_send(&req.n);
+
+	if (rtnl_open_byproto(&rth, 0, NETLINK_XFRM) < 0)
+		exit(1);
+
 	if (delete) {
 		if (rtnl_talk(&rth, &req.n, NULL) < 0)
 			exit(2);
@@ -1116,12 +1119,11 @@ static int xfrm_state_get_or_delete(int argc, char **argv, int delete)
 
 /*
  * With an existing state of nlmsg, make new nlmsg for deleting the state
- * and store it to buffer.
+ * and queue it on the delete pipe while the dump goes on.
  */
 static int xfrm_state_keep(struct nlmsghdr *n, void *arg)
 {
 	struct xfrm_buffer *xb = (struct xfrm_buffer *)arg;
-	struct rtnl_handle *rth = xb->rth;
 	struct xfrm_usersa_info *xsinfo = NLMSG_DATA(n);
 	int len = n->nlmsg_len;
 	struct nlmsghdr *new_n;
@@ -1147,16 +1149,10 @@ static int xfrm_state_keep(struct nlmsghdr *n, void *arg)
 	    xsinfo->id.proto == IPPROTO_IPV6)
 		return 0;
 
-	if (xb->offset > xb->size) {
-		fprintf(stderr, "State buffer overflow\n");
-		return -1;
-	}
-
-	new_n = (struct nlmsghdr *)(xb->buf + xb->offset);
+	new_n = &xb->req.n;
 	new_n->nlmsg_len = NLMSG_LENGTH(sizeof(*xsid));
 	new_n->nlmsg_flags = NLM_F_REQUEST;
 	new_n->nlmsg_type = XFRM_MSG_DELSA;
-	new_n->nlmsg_seq = ++rth->seq;
 
 	xsid = NLMSG_DATA(new_n);
 	xsid->family = xsinfo->family;
@@ -1164,13 +1160,13 @@ static int xfrm_state_keep(struct nlmsghdr *n, void *arg)
 	xsid->spi = xsinfo->id.spi;
 	xsid->proto = xsinfo->id.proto;
 
-	addattr_l(new_n, xb->size, XFRMA_SRCADDR, &xsinfo->saddr,
+	addattr_l(new_n, sizeof(xb->req), XFRMA_SRCADDR, &xsinfo->saddr,
 		  sizeof(xsid->daddr));
 
 	parse_rtattr(tb, XFRMA_MAX, XFRMS_RTA(xsinfo), len);
 
 	if (tb[XFRMA_MARK]) {
-		int r = addattr_l(new_n, xb->size, XFRMA_MARK,
+		int r = addattr_l(new_n, sizeof(xb->req), XFRMA_MARK,
 				(void *)RTA_DATA(tb[XFRMA_MARK]), tb[XFRMA_MARK]->rta_len);
 		if (r < 0) {
 			fprintf(stderr, "%s: XFRMA_MARK failed\n", __func__);
@@ -1178,12 +1174,40 @@ static int xfrm_state_keep(struct nlmsghdr *n, void *arg)
 		}
 	}
 
-	xb->offset += new_n->nlmsg_len;
+	if (rtnl_pipe_send(xb->pipe, new_n, NULL) < 0)
+		return -1;
 	xb->nlmsg_count++;
 
 	return 0;
 }
 
+/*
+ * Push the selectors the kernel can evaluate during the walk (address
+ * prefixes, family and protocol) into the dump request so that only
+ * candidate SAs are copied to userspace.  The remaining ones (SPI, mode,
+ * reqid, flags) are still applied by xfrm_state_filter_match().
+ */
+static void xfrm_state_dump_filter(struct nlmsghdr *n, int maxlen)
+{
+	struct xfrm_address_filter addrfilter = {
+		.saddr = filter.xsinfo.saddr,
+		.daddr = filter.xsinfo.id.daddr,
+		.family = filter.xsinfo.family,
+		.splen = filter.id_src_mask,
+		.dplen = filter.id_dst_mask,
+	};
+
+	if (!filter.use)
+		return;
+
+	if (filter.id_proto_mask && filter.xsinfo.id.proto)
+		addattr8(n, maxlen, XFRMA_PROTO, filter.xsinfo.id.proto);
+	if (addrfilter.family != AF_UNSPEC || addrfilter.splen ||
+	    addrfilter.dplen)
+		addattr_l(n, maxlen, XFRMA_ADDRESS_FILTER,
+			  &addrfilter, sizeof(addrfilter));
+}
+
 static int xfrm_state_list_or_deleteall(int argc, char **argv, int deleteall)
 {
 	char *idp = NULL;
@@ -1234,12 +1258,19 @@ static int xfrm_state_list_or_deleteall(int argc, char **argv, int deleteall)
 
 	if (deleteall) {
 		struct xfrm_buffer xb;
-		char buf[NLMSG_DELETEALL_BUF_SIZE];
+		struct rtnl_handle drth;
 		int i;
 
-		xb.buf = buf;
-		xb.size = sizeof(buf);
-		xb.rth = &rth;
+		/* Deletes go out on their own socket while the dump runs */
+		if (rtnl_open_byproto(&drth, 0, NETLINK_XFRM) < 0)
+			exit(1);
+
+		xb.pipe = malloc(sizeof(*xb.pipe));
+		if (!xb.pipe) {
+			perror("malloc");
+			exit(1);
+		}
+		rtnl_pipe_init(xb.pipe, &drth, XFRM_BULK_WINDOW, NULL, NULL);
 
 		for (i = 0; ; i++) {
 			struct {
@@ -1252,7 +1283,8 @@ static int xfrm_state_list_or_deleteall(int argc, char **argv, int deleteall)
 				.n.nlmsg_seq = rth.dump = ++rth.seq,
 			};
 
-			xb.offset = 0;
+			xfrm_state_dump_filter(&req.n, sizeof(req));
+
 			xb.nlmsg_count = 0;
 
 			if (show_stats > 1)
@@ -1273,25 +1305,15 @@ static int xfrm_state_list_or_deleteall(int argc, char **argv, int deleteall)
 				break;
 			}
 
-			if (rtnl_send_check(&rth, xb.buf, xb.offset) < 0) {
-				perror("Failed to send delete-all request\n");
+			if (xfrm_deleteall_flush(xb.pipe, xb.nlmsg_count) < 0) {
+				fprintf(stderr, "Failed to send delete-all request\n");
 				exit(1);
 			}
-			if (show_stats > 1)
-				fprintf(stderr, "Delete-all nlmsg count = %d\n", xb.nlmsg_count);
-
-			xb.offset = 0;
-			xb.nlmsg_count = 0;
 		}
 
+		free(xb.pipe);
+		rtnl_close(&drth);
 	} else {
-		struct xfrm_address_filter addrfilter = {
-			.saddr = filter.xsinfo.saddr,
-			.daddr = filter.xsinfo.id.daddr,
-			.family = filter.xsinfo.family,
-			.splen = filter.id_src_mask,
-			.dplen = filter.id_dst_mask,
-		};
 		struct {
 			struct nlmsghdr n;
 			char buf[NLMSG_BUF_SIZE];
@@ -1302,11 +1324,7 @@ static int xfrm_state_list_or_deleteall(int argc, char **argv, int deleteall)
 			.n.nlmsg_seq = rth.dump = ++rth.seq,
 		};
 
-		if (filter.xsinfo.id.proto)
-			addattr8(&req.n, sizeof(req), XFRMA_PROTO,
-				 filter.xsinfo.id.proto);
-		addattr_l(&req.n, sizeof(req), XFRMA_ADDRESS_FILTER,
-			  &addrfilter, sizeof(addrfilter));
+		xfrm_state_dump_filter(&req.n, sizeof(req));
 
 		if (rtnl_send(&rth, (void *)&req, req.n.nlmsg_len) < 0) {
 			perror("Cannot send dump request");
@@ -116,10 +116,12 @@ const char *bpf_prog_to_default_section(enum bpf_prog_type type)
 
 #ifdef HAVE_ELF
 static int bpf_obj_open(const char *path, enum bpf_prog_type type,
-			const char *sec, __u32 ifindex, bool verbose);
+			const char *sec, __u32 ifindex, bool verbose,
+			bool cache);
 #else
 static int bpf_obj_open(const char *path, enum bpf_prog_type type,
-			const char *sec, __u32 ifindex, bool verbose)
+			const char *sec, __u32 ifindex, bool verbose,
+			bool cache)
 {
 	fprintf(stderr, "No ELF library support compiled in.\n");
 	errno = ENOSYS;
@@ -1003,7 +1005,10 @@ static int bpf_do_parse(struct bpf_cfg_in *cfg, const bool *opt_tbl/*支持哪
 }
 
 //加载bpf
-static int bpf_do_load(struct bpf_cfg_in *cfg)
+/* Cached program fds are owned by the cache, so callers that close the
+ * fd once done with it must not take it from there.
+ */
+static int bpf_do_load(struct bpf_cfg_in *cfg, bool cache)
 {
 	if (cfg->mode == EBPF_OBJECT) {
 #ifdef HAVE_LIBBPF
@@ -1011,9 +1016,10 @@ static int bpf_do_load(struct bpf_cfg_in *cfg)
 		return iproute2_load_libbpf(cfg);
 #endif
 	    /*obj文件加载*/
+		/* exported map fds are taken from the load, never share it */
 		cfg->prog_fd = bpf_obj_open(cfg->object, cfg->type,
 					    cfg->section, cfg->ifindex,
-					    cfg->verbose);
+					    cfg->verbose, cache && !cfg->uds);
 		return cfg->prog_fd;
 	}
 	return 0;
@@ -1026,7 +1032,7 @@ int bpf_load_common(struct bpf_cfg_in *cfg, const struct bpf_cfg_ops *ops,
 	int ret;
 
 	//obj类型bpf程序加载
-	ret = bpf_do_load(cfg);
+	ret = bpf_do_load(cfg, true);
 	if (ret < 0)
 		return ret;
 
@@ -1101,7 +1107,8 @@ int bpf_graft_map(const char *map_path, uint32_t *key, int argc, char **argv)
 	if (ret < 0)
 		return ret;
 
-	ret = bpf_do_load(&cfg);
+	/* prog_fd is closed below */
+	ret = bpf_do_load(&cfg, false);
 	if (ret < 0)
 		return ret;
 
@@ -3218,10 +3225,141 @@ static void bpf_elf_ctx_destroy(struct bpf_elf_ctx *ctx, bool failure)
 
 static struct bpf_elf_ctx __ctx;
 
+/*
+ * Programs loaded from an object stay cached for the lifetime of the
+ * process, keyed by object hash, section, type and device, so that a
+ * batch attaching the same classifier many times runs the verifier
+ * once.  Only objects whose maps are all pinned qualify: with private
+ * maps every load must keep getting maps of its own.
+ */
+struct bpf_prog_cache {
+	struct bpf_prog_cache	*next;
+	char			obj_uid[64];
+	char			*section;
+	enum bpf_prog_type	type;
+	__u32			ifindex;
+	int			fd;
+};
+
+static struct bpf_prog_cache *bpf_prog_cache;
+
+static struct bpf_prog_cache *bpf_prog_cache_find(const char *obj_uid,
+						  const char *section,
+						  enum bpf_prog_type type,
+						  __u32 ifindex)
+{
+	struct bpf_prog_cache *pc;
+
+	for (pc = bpf_prog_cache; pc; pc = pc->next) {
+		if (pc->type == type && pc->ifindex == ifindex &&
+		    !strcmp(pc->obj_uid, obj_uid) &&
+		    !strcmp(pc->section, section))
+			return pc;
+	}
+
+	return NULL;
+}
+
+static void bpf_prog_cache_add(const char *obj_uid, const char *section,
+			       enum bpf_prog_type type, __u32 ifindex, int fd)
+{
+	struct bpf_prog_cache *pc = calloc(1, sizeof(*pc));
+
+	if (!pc)
+		return;
+	pc->section = strdup(section);
+	if (!pc->section) {
+		free(pc);
+		return;
+	}
+	strlcpy(pc->obj_uid, obj_uid, sizeof(pc->obj_uid));
+	pc->type = type;
+	pc->ifindex = ifindex;
+	pc->fd = fd;
+	pc->next = bpf_prog_cache;
+	bpf_prog_cache = pc;
+}
+
+static bool bpf_maps_all_pinned(const struct bpf_elf_ctx *ctx)
+{
+	int i;
+
+	for (i = 0; i < ctx->map_num; i++) {
+		if (bpf_no_pinning(ctx, ctx->maps[i].pinning))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * With BPF_ENV_PROG_CACHE set, cached programs are also pinned as
+ * <obj_uid>/prog.<section> in the work dir of their type, so that later
+ * invocations loading the same object skip the verifier as well.
+ */
+static bool bpf_prog_pin_wanted(const char *obj_uid, __u32 ifindex)
+{
+	return getenv(BPF_ENV_PROG_CACHE) && obj_uid[0] && !ifindex;
+}
+
+static void bpf_prog_pin_path(char *pathname, size_t len, const char *obj_uid,
+			      const char *section, enum bpf_prog_type type)
+{
+	char *p;
+	int off;
+
+	off = snprintf(pathname, len, "%s/%s/prog.", bpf_get_work_dir(type),
+		       obj_uid);
+	strlcpy(pathname + off, section, len - off);
+	for (p = pathname + off; *p; p++) {
+		if (*p == '/')
+			*p = '_';
+	}
+}
+
+static int bpf_prog_pin_get(const char *obj_uid, const char *section,
+			    enum bpf_prog_type type)
+{
+	struct bpf_prog_info info = {};
+	uint32_t len = sizeof(info);
+	char pathname[PATH_MAX];
+	int fd;
+
+	bpf_prog_pin_path(pathname, sizeof(pathname), obj_uid, section, type);
+	fd = bpf_obj_get(pathname, type);
+	if (fd < 0)
+		return fd;
+
+	if (bpf_prog_info_by_fd(fd, &info, &len) || info.type != type) {
+		close(fd);
+		return -EINVAL;
+	}
+
+	return fd;
+}
+
+static void bpf_prog_pin_put(const struct bpf_elf_ctx *ctx, const char *section,
+			     int fd)
+{
+	char pathname[PATH_MAX];
+
+	if (bpf_make_obj_path(ctx))
+		return;
+
+	bpf_prog_pin_path(pathname, sizeof(pathname), ctx->obj_uid, section,
+			  ctx->type);
+	/* losing a race with a concurrent tc (EEXIST) is harmless */
+	if (bpf_obj_pin(fd, pathname) && errno != EEXIST && ctx->verbose)
+		fprintf(stderr, "Could not pin program %s: %s\n", pathname,
+			strerror(errno));
+}
+
 static int bpf_obj_open(const char *pathname/*要加载的程序路径*/, enum bpf_prog_type type/*程序类型*/,
-			const char *section/*加载的段名称*/, __u32 ifindex/*关联的设备index*/, bool verbose/*是否冗余输出*/)
+			const char *section/*加载的段名称*/, __u32 ifindex/*关联的设备index*/, bool verbose/*是否冗余输出*/,
+			bool cache)
 {
 	struct bpf_elf_ctx *ctx = &__ctx;
+	struct bpf_prog_cache *pc;
 	int fd = 0, ret;
 
 	/*初始化ctx*/
@@ -3231,6 +3369,25 @@ static int bpf_obj_open(const char *pathname/*要加载的程序路径*/, enum b
 		return ret;
 	}
 
+	cache = cache && !ctx->noafalg;
+	if (cache) {
+		pc = bpf_prog_cache_find(ctx->obj_uid, section, type, ifindex);
+		if (pc) {
+			fd = pc->fd;
+			goto cached;
+		}
+		if (bpf_prog_pin_wanted(ctx->obj_uid, ifindex) &&
+		    bpf_get_work_dir(type)) {
+			fd = bpf_prog_pin_get(ctx->obj_uid, section, type);
+			if (fd >= 0) {
+				bpf_prog_cache_add(ctx->obj_uid, section, type,
+						   ifindex, fd);
+				goto cached;
+			}
+			fd = 0;
+		}
+	}
+
 	//加载elf文件中的map,btf,strsym
 	ret = bpf_fetch_ancillary(ctx, strcmp(section, ".text"));
 	if (ret < 0) {
@@ -3247,8 +3404,17 @@ static int bpf_obj_open(const char *pathname/*要加载的程序路径*/, enum b
 	}
 
 	ret = bpf_fill_prog_arrays(ctx);
-	if (ret < 0)
+	if (ret < 0) {
 		fprintf(stderr, "Error filling program arrays!\n");
+		goto out;
+	}
+
+	if (cache && bpf_maps_all_pinned(ctx)) {
+		bpf_prog_cache_add(ctx->obj_uid, section, type, ifindex, fd);
+		if (bpf_prog_pin_wanted(ctx->obj_uid, ifindex) &&
+		    bpf_get_work_dir(type))
+			bpf_prog_pin_put(ctx, section, fd);
+	}
 out:
 	bpf_elf_ctx_destroy(ctx, ret < 0);
 	if (ret < 0) {
@@ -3257,6 +3423,12 @@ out:
 		return ret;
 	}
 
+	return fd;
+cached:
+	if (verbose)
+		fprintf(stderr, "Program section \'%s\' reused from cache!\n",
+			section);
+	bpf_elf_ctx_destroy(ctx, false);
 	return fd;
 }
 
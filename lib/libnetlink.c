@@ -1344,6 +1344,154 @@ int rtnl_from_file(FILE *rtnl, rtnl_listen_filter_t handler,
 	}
 }
 
+void rtnl_pipe_init(struct rtnl_pipe *p, struct rtnl_handle *rth,
+		    unsigned int window, rtnl_pipe_filter_t filter, void *arg)
+{
+	memset(p, 0, offsetof(struct rtnl_pipe, buf));
+	p->rth = rth;
+	/* outstanding requests each hold a cookie slot */
+	if (window > RTNL_PIPE_MAX_WINDOW)
+		window = RTNL_PIPE_MAX_WINDOW;
+	p->window = window ? : 1;
+	p->filter = filter;
+	p->arg = arg;
+}
+
+static int rtnl_pipe_xmit(struct rtnl_pipe *p)
+{
+	int status;
+
+	if (!p->len)
+		return 0;
+
+	status = send(p->rth->fd, p->buf, p->len, 0);
+	if (status < 0) {
+		perror("Cannot talk to rtnetlink");
+		return -1;
+	}
+	p->len = 0;
+	return 0;
+}
+
+static void *rtnl_pipe_cookie(struct rtnl_pipe *p, __u32 seq)
+{
+	unsigned int i = seq % RTNL_PIPE_MAX_WINDOW;
+
+	return p->cookies[i].seq == seq ? p->cookies[i].cookie : NULL;
+}
+
+/* Read replies until at most @limit requests remain outstanding */
+static int rtnl_pipe_drain(struct rtnl_pipe *p, unsigned int limit)
+{
+	struct sockaddr_nl nladdr = { .nl_family = AF_NETLINK };
+	struct iovec iov;
+	struct msghdr msg = {
+		.msg_name = &nladdr,
+		.msg_namelen = sizeof(nladdr),
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+	};
+	struct nlmsghdr *h;
+	int status;
+	char *buf;
+
+	if (rtnl_pipe_xmit(p) < 0)
+		return -1;
+
+	while (p->inflight > limit) {
+		status = rtnl_recvmsg(p->rth->fd, &msg, &buf);
+		if (status < 0)
+			return status;
+
+		for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, status);
+		     h = NLMSG_NEXT(h, status)) {
+			struct nlmsgerr *err;
+			int error = 0;
+
+			if (nladdr.nl_pid != 0 ||
+			    h->nlmsg_pid != p->rth->local.nl_pid)
+				continue;
+
+			if (h->nlmsg_type != NLMSG_ERROR) {
+				if (p->filter)
+					p->filter(h, 0,
+						  rtnl_pipe_cookie(p, h->nlmsg_seq),
+						  p->arg);
+				continue;
+			}
+
+			err = (struct nlmsgerr *)NLMSG_DATA(h);
+			if (h->nlmsg_len < NLMSG_LENGTH(sizeof(*err))) {
+				fprintf(stderr, "ERROR truncated\n");
+				error = -EINVAL;
+			} else {
+				error = err->error;
+			}
+
+			if (error) {
+				p->errors++;
+				if (!p->filter &&
+				    !(p->rth->flags & RTNL_HANDLE_F_SUPPRESS_NLERR))
+					rtnl_talk_error(h, err, NULL);
+			} else {
+				nl_dump_ext_ack(h, NULL);
+			}
+
+			if (p->filter)
+				p->filter(h, error,
+					  rtnl_pipe_cookie(p, h->nlmsg_seq),
+					  p->arg);
+			if (p->inflight)
+				p->inflight--;
+		}
+		free(buf);
+
+		if (msg.msg_flags & MSG_TRUNC) {
+			fprintf(stderr, "Message truncated\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int rtnl_pipe_send(struct rtnl_pipe *p, struct nlmsghdr *n, void *cookie)
+{
+	unsigned int len = NLMSG_ALIGN(n->nlmsg_len);
+	unsigned int slot;
+
+	if (len > sizeof(p->buf)) {
+		fprintf(stderr, "Request of %u bytes too large to pipeline\n",
+			n->nlmsg_len);
+		return -1;
+	}
+
+	if (p->len + len > sizeof(p->buf) && rtnl_pipe_xmit(p) < 0)
+		return -1;
+
+	n->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+	n->nlmsg_pid = 0;
+	n->nlmsg_seq = ++p->rth->seq;
+	slot = n->nlmsg_seq % RTNL_PIPE_MAX_WINDOW;
+	p->cookies[slot].seq = n->nlmsg_seq;
+	p->cookies[slot].cookie = cookie;
+	memcpy(p->buf + p->len, n, n->nlmsg_len);
+	memset(p->buf + p->len + n->nlmsg_len, 0, len - n->nlmsg_len);
+	p->len += len;
+	p->inflight++;
+	p->sent++;
+
+	if (p->inflight >= p->window)
+		return rtnl_pipe_drain(p, p->window / 2);
+
+	return 0;
+}
+
+int rtnl_pipe_flush(struct rtnl_pipe *p)
+{
+	return rtnl_pipe_drain(p, 0);
+}
+
 int addattr(struct nlmsghdr *n, int maxlen, int type)
 {
 	return addattr_l(n, maxlen, type, NULL, 0);
@@ -26,6 +26,7 @@
 #include <time.h>
 #include <sys/time.h>
 #include <errno.h>
+#include <pthread.h>
 #ifdef HAVE_LIBCAP
 #include <sys/capability.h>
 #endif
@@ -1073,22 +1074,52 @@ const char *family_name(int family)
 }
 
 #ifdef RESOLVE_HOSTNAMES
+/*
+ * Names of addresses are cached for RESOLVE_TTL seconds, failures included,
+ * so that long running monitors notice renames.  resolve_address_want()
+ * queues addresses and resolve_addresses() looks them all up at once with
+ * a pool of threads, for tools that can format their output afterwards.
+ */
+#define RESOLVE_TTL		300
+#define RESOLVE_WORKERS		16
+
 struct namerec {
 	struct namerec *next;
 	const char *name;
 	inet_prefix addr;
+	time_t expires;		/* 0 until looked up */
+	bool pending;		/* queued for a worker */
 };
 
 #define NHASH 257
 static struct namerec *nht[NHASH];
+static pthread_mutex_t nht_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct resolve_batch {
+	struct namerec **recs;
+	unsigned int count;
+	unsigned int next;
+	unsigned int done;
+	unsigned int users;	/* last one frees the batch */
+	pthread_cond_t cond;
+};
 
-static const char *resolve_address(const void *addr, int len, int af)
+static struct namerec **resolve_queue;
+static unsigned int resolve_queued, resolve_queue_size;
+
+static time_t resolve_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+/* Find or add the record of an address, under nht_lock */
+static struct namerec *namerec_get(const void *addr, int len, int af)
 {
 	struct namerec *n;
-	struct hostent *h_ent;
 	unsigned int hash;
-	static int notfirst;
-
 
 	if (af == AF_INET6 && ((__u32 *)addr)[0] == 0 &&
 	    ((__u32 *)addr)[1] == 0 && ((__u32 *)addr)[2] == htonl(0xffff)) {
@@ -1103,27 +1134,225 @@ static const char *resolve_address(const void *addr, int len, int af)
 		if (n->addr.family == af &&
 		    n->addr.bytelen == len &&
 		    memcmp(n->addr.data, addr, len) == 0)
-			return n->name;
+			return n;
 	}
-	n = malloc(sizeof(*n));
+	n = calloc(1, sizeof(*n));
 	if (n == NULL)
 		return NULL;
 	n->addr.family = af;
 	n->addr.bytelen = len;
-	n->name = NULL;
 	memcpy(n->addr.data, addr, len);
 	n->next = nht[hash];
 	nht[hash] = n;
-	if (++notfirst == 1)
-		sethostent(1);
+	return n;
+}
+
+static char *lookup_name(const inet_prefix *a)
+{
+	struct sockaddr_storage ss = {};
+	char host[NI_MAXHOST];
+	socklen_t salen;
+
+	if (a->family == AF_INET) {
+		struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+
+		sin->sin_family = AF_INET;
+		memcpy(&sin->sin_addr, a->data, 4);
+		salen = sizeof(*sin);
+	} else if (a->family == AF_INET6) {
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+
+		sin6->sin6_family = AF_INET6;
+		memcpy(&sin6->sin6_addr, a->data, 16);
+		salen = sizeof(*sin6);
+	} else {
+		return NULL;
+	}
+
+	if (getnameinfo((struct sockaddr *)&ss, salen, host, sizeof(host),
+			NULL, 0, NI_NAMEREQD))
+		return NULL;
+	return strdup(host);
+}
+
+/* Record a lookup result, under nht_lock.  A name being replaced may
+ * still be in use by the caller of format_host(), so it is not freed.
+ */
+static void namerec_set(struct namerec *n, char *name)
+{
+	if (n->name && name && strcmp(n->name, name) == 0)
+		free(name);
+	else if (name || !n->expires)
+		n->name = name;
+	n->expires = resolve_now() + RESOLVE_TTL;
+	n->pending = false;
+}
+
+static const char *resolve_address(const void *addr, int len, int af)
+{
+	struct namerec *n;
+	const char *name;
+	char *res;
+
+	pthread_mutex_lock(&nht_lock);
+	n = namerec_get(addr, len, af);
+	if (!n || n->pending ||
+	    (n->expires && n->expires > resolve_now())) {
+		/* a name still being looked up is shown numeric */
+		name = n && !n->pending ? n->name : NULL;
+		pthread_mutex_unlock(&nht_lock);
+		return name;
+	}
+	n->pending = true;
+	pthread_mutex_unlock(&nht_lock);
+
 	fflush(stdout);
+	res = lookup_name(&n->addr);
 
-	h_ent = gethostbyaddr(addr, len, af);
-	if (h_ent != NULL)
-		n->name = strdup(h_ent->h_name);
+	pthread_mutex_lock(&nht_lock);
+	namerec_set(n, res);
+	name = n->name;
+	pthread_mutex_unlock(&nht_lock);
 
 	/* Even if we fail, "negative" entry is remembered. */
-	return n->name;
+	return name;
+}
+
+void resolve_address_want(int af, int len, const void *addr)
+{
+	struct namerec *n;
+
+	if (!resolve_hosts)
+		return;
+
+	len = len <= 0 ? af_byte_len(af) : len;
+	if (len <= 0)
+		return;
+
+	pthread_mutex_lock(&nht_lock);
+	n = namerec_get(addr, len, af);
+	if (!n || n->pending || (n->expires && n->expires > resolve_now()))
+		goto out;
+
+	if (resolve_queued == resolve_queue_size) {
+		unsigned int size = resolve_queue_size ? : 256;
+		struct namerec **q;
+
+		q = realloc(resolve_queue, 2 * size * sizeof(*q));
+		if (!q)
+			goto out;
+		resolve_queue = q;
+		resolve_queue_size = 2 * size;
+	}
+	n->pending = true;
+	resolve_queue[resolve_queued++] = n;
+out:
+	pthread_mutex_unlock(&nht_lock);
+}
+
+static void resolve_batch_put(struct resolve_batch *b)
+{
+	if (--b->users)
+		return;
+	pthread_cond_destroy(&b->cond);
+	free(b->recs);
+	free(b);
+}
+
+static void *resolve_worker(void *arg)
+{
+	struct resolve_batch *b = arg;
+
+	pthread_mutex_lock(&nht_lock);
+	while (b->next < b->count) {
+		struct namerec *n = b->recs[b->next++];
+		char *name;
+
+		pthread_mutex_unlock(&nht_lock);
+		name = lookup_name(&n->addr);
+		pthread_mutex_lock(&nht_lock);
+
+		namerec_set(n, name);
+		if (++b->done == b->count)
+			pthread_cond_signal(&b->cond);
+	}
+	resolve_batch_put(b);
+	pthread_mutex_unlock(&nht_lock);
+
+	return NULL;
+}
+
+/*
+ * Look up the queued addresses concurrently, waiting at most @timeout_ms.
+ * Addresses still unresolved then are printed numeric; their lookups go
+ * on in the background and are cached when they complete.
+ */
+void resolve_addresses(unsigned int timeout_ms)
+{
+	struct resolve_batch *b;
+	struct timespec deadline;
+	unsigned int i, workers;
+
+	pthread_mutex_lock(&nht_lock);
+	if (!resolve_queued) {
+		pthread_mutex_unlock(&nht_lock);
+		return;
+	}
+
+	b = calloc(1, sizeof(*b));
+	if (!b) {
+		pthread_mutex_unlock(&nht_lock);
+		return;
+	}
+	b->recs = resolve_queue;
+	b->count = resolve_queued;
+	b->users = 1;
+	pthread_cond_init(&b->cond, NULL);
+	resolve_queue = NULL;
+	resolve_queued = resolve_queue_size = 0;
+
+	workers = b->count < RESOLVE_WORKERS ? b->count : RESOLVE_WORKERS;
+	for (i = 0; i < workers; i++) {
+		pthread_attr_t attr;
+		pthread_t thread;
+
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		if (pthread_create(&thread, &attr, resolve_worker, b) == 0)
+			b->users++;
+		pthread_attr_destroy(&attr);
+	}
+
+	if (b->users == 1) {
+		/* no thread could be started, do it here */
+		b->users++;
+		pthread_mutex_unlock(&nht_lock);
+		resolve_worker(b);
+		pthread_mutex_lock(&nht_lock);
+	}
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	while (b->done < b->count)
+		if (pthread_cond_timedwait(&b->cond, &nht_lock, &deadline))
+			break;
+
+	resolve_batch_put(b);
+	pthread_mutex_unlock(&nht_lock);
+}
+#else
+void resolve_address_want(int af, int len, const void *addr)
+{
+}
+
+void resolve_addresses(unsigned int timeout_ms)
+{
 }
 #endif
 
@@ -12,6 +12,7 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/uio.h>
+#include <sys/poll.h>
 #include <sys/sysmacros.h>
 #include <netinet/in.h>
 #include <string.h>
@@ -24,6 +25,8 @@
 #include <stdbool.h>
 #include <limits.h>
 #include <stdarg.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "ss_util.h"
 #include "utils.h"
@@ -121,6 +124,13 @@ static int show_tipcinfo;
 static int show_tos;
 static int show_cgroup;
 static int show_inet_sockopt;
+static int stream_rows;		/* rows measured before widths freeze */
+static int top_count;		/* --top: number of sockets to keep */
+static unsigned int sample_interval;	/* --interval, in seconds */
+static int count_nkeys;		/* --count-by: number of keys */
+static unsigned int kill_window = 1;	/* -K requests sent per batch */
+static unsigned int kill_rate;	/* -K sockets per second, 0: no limit */
+static bool kill_report;	/* -K progress and counts on stderr */
 int oneline;
 
 enum col_id {
@@ -519,6 +529,8 @@ static FILE *generic_proc_open(const char *env, const char *name)
 #define ephemeral_ports_open()	generic_proc_open("PROC_IP_LOCAL_PORT_RANGE", \
 					"sys/net/ipv4/ip_local_port_range")
 
+#define MAX_PATH_LEN	1024
+
 struct user_ent {
 	struct user_ent	*next;
 	unsigned int	ino;
@@ -528,24 +540,158 @@ struct user_ent {
 	char		*task;
 	char		*task_ctx;
 	char		*socket_ctx;
+	unsigned long long seq;	/* discovery order of the /proc walk */
 };
 
-#define USER_ENT_HASH_SIZE	256
-static struct user_ent *user_ent_hash[USER_ENT_HASH_SIZE];
+static struct user_ent **user_ent_hash;
+static unsigned int user_ent_hash_size;
+static unsigned int user_ent_count;
+
+/*
+ * Process information is resolved lazily: while dumping, proc_ctx_print()
+ * only records the inodes that survived filtering and leaves a marker in
+ * the output buffer.  The /proc walk runs right before the buffer is
+ * rendered and keeps the owners of wanted inodes only.  Output too large
+ * for one buffer (or follow mode) needs every owner, so the first such
+ * walk records all sockets and later lookups are served from it.
+ */
+static unsigned int *user_ent_wanted;
+static unsigned int user_ent_wanted_size;
+static unsigned int user_ent_wanted_count;
+static bool user_ent_complete;
+
+#define USER_ENT_MARK		'\0'
+#define USER_ENT_MARK_LEN	9	/* mark + 8 hex digits of inode */
+
+/* With -r, addresses are also written as markers during the dump, and
+ * all their names are looked up at once before rendering.
+ */
+#define HOST_MARK		'\1'
+#define HOST_MARK_LEN		34	/* mark, '4' or '6', 32 hex digits */
+#define HOST_RESOLVE_TIMEOUT	3000	/* ms, then numeric output */
+
+static bool render_host_marks;
+
+static unsigned int user_ent_hashfn(unsigned int ino, unsigned int size)
+{
+	return (ino * 2654435761U) & (size - 1);
+}
+
+static void user_ent_insert(struct user_ent *p)
+{
+	struct user_ent **pp;
+
+	if (user_ent_count >= user_ent_hash_size) {
+		unsigned int size = user_ent_hash_size ? user_ent_hash_size * 2 : 256;
+		struct user_ent **hash = calloc(size, sizeof(*hash));
+		unsigned int i;
+
+		if (!hash) {
+			fprintf(stderr, "ss: failed to malloc buffer\n");
+			abort();
+		}
+
+		/* keep chain order, find_entry() prints owners in it */
+		for (i = 0; i < user_ent_hash_size; i++) {
+			struct user_ent *q = user_ent_hash[i], *next;
+			struct user_ent **tail;
+
+			for (; q; q = next) {
+				next = q->next;
+				tail = &hash[user_ent_hashfn(q->ino, size)];
+				while (*tail)
+					tail = &(*tail)->next;
+				q->next = NULL;
+				*tail = q;
+			}
+		}
+		free(user_ent_hash);
+		user_ent_hash = hash;
+		user_ent_hash_size = size;
+	}
+
+	pp = &user_ent_hash[user_ent_hashfn(p->ino, user_ent_hash_size)];
+	p->next = *pp;
+	*pp = p;
+	user_ent_count++;
+}
+
+static bool user_ent_is_wanted(unsigned int ino)
+{
+	unsigned int i;
+
+	if (!user_ent_wanted_size)
+		return true;
+
+	i = user_ent_hashfn(ino, user_ent_wanted_size);
+	while (user_ent_wanted[i]) {
+		if (user_ent_wanted[i] == ino)
+			return true;
+		i = (i + 1) & (user_ent_wanted_size - 1);
+	}
+	return false;
+}
 
-static int user_ent_hashfn(unsigned int ino)
+static void user_ent_want(unsigned int ino)
 {
-	int val = (ino >> 24) ^ (ino >> 16) ^ (ino >> 8) ^ ino;
+	unsigned int i;
+
+	if (user_ent_wanted_count * 2 >= user_ent_wanted_size) {
+		unsigned int size = user_ent_wanted_size ? user_ent_wanted_size * 2 : 1024;
+		unsigned int *old = user_ent_wanted;
+		unsigned int old_size = user_ent_wanted_size;
+
+		user_ent_wanted = calloc(size, sizeof(*user_ent_wanted));
+		if (!user_ent_wanted) {
+			fprintf(stderr, "ss: failed to malloc buffer\n");
+			abort();
+		}
+		user_ent_wanted_size = size;
+		user_ent_wanted_count = 0;
+		for (i = 0; i < old_size; i++) {
+			if (old[i])
+				user_ent_want(old[i]);
+		}
+		free(old);
+	}
 
-	return val & (USER_ENT_HASH_SIZE - 1);
+	i = user_ent_hashfn(ino, user_ent_wanted_size);
+	while (user_ent_wanted[i]) {
+		if (user_ent_wanted[i] == ino)
+			return;
+		i = (i + 1) & (user_ent_wanted_size - 1);
+	}
+	user_ent_wanted[i] = ino;
+	user_ent_wanted_count++;
+}
+
+static void user_ent_want_reset(void)
+{
+	free(user_ent_wanted);
+	user_ent_wanted = NULL;
+	user_ent_wanted_size = 0;
+	user_ent_wanted_count = 0;
 }
 
-static void user_ent_add(unsigned int ino, char *task,
-					int pid, int tid, int fd,
-					char *task_ctx,
-					char *sock_ctx)
+/* One walker per thread, results are merged once all of them are done */
+struct user_ent_walker {
+	pthread_t		thread;
+	struct user_ent_scan	*scan;
+	struct user_ent		*found;
+};
+
+struct user_ent_scan {
+	char			root[MAX_PATH_LEN];
+	int			*pids;
+	unsigned int		npids;
+	unsigned int		next;	/* next pid to walk, shared */
+};
+
+static struct user_ent *user_ent_new(unsigned int ino, char *task,
+				     int pid, int tid, int fd,
+				     char *task_ctx, char *sock_ctx)
 {
-	struct user_ent *p, **pp;
+	struct user_ent *p;
 
 	p = malloc(sizeof(struct user_ent));
 	if (!p) {
@@ -561,39 +707,32 @@ static void user_ent_add(unsigned int ino, char *task,
 	p->task_ctx = strdup(task_ctx);
 	p->socket_ctx = strdup(sock_ctx);
 
-	pp = &user_ent_hash[user_ent_hashfn(ino)];
-	p->next = *pp;
-	*pp = p;
+	return p;
 }
 
-#define MAX_PATH_LEN	1024
-
-static void user_ent_hash_build_task(char *path, int pid, int tid)
+static void user_ent_hash_build_task(struct user_ent_walker *w, char *path,
+				     int pid, int tid, unsigned long long *seq)
 {
 	const char *no_ctx = "unavailable";
 	char task[16] = {'\0', };
 	char stat[MAX_PATH_LEN];
+	char *task_context = NULL;
 	int pos_id, pos_fd;
-	char *task_context;
 	struct dirent *d;
 	DIR *dir;
 
-	if (getpidcon(tid, &task_context) != 0)
-		task_context = strdup(no_ctx);
-
 	pos_id = strlen(path);	/* $PROC_ROOT/$ID/ */
 
 	snprintf(path + pos_id, MAX_PATH_LEN - pos_id, "fd/");
 	dir = opendir(path);
-	if (!dir) {
-		freecon(task_context);
+	if (!dir)
 		return;
-	}
 
 	pos_fd = strlen(path);	/* $PROC_ROOT/$ID/fd/ */
 
 	while ((d = readdir(dir)) != NULL) {
 		const char *pattern = "socket:[";
+		struct user_ent *p;
 		char *sock_context;
 		unsigned int ino;
 		ssize_t link_len;
@@ -616,6 +755,12 @@ static void user_ent_hash_build_task(char *path, int pid, int tid)
 		if (sscanf(lnk, "socket:[%u]", &ino) != 1)
 			continue;
 
+		if (!user_ent_is_wanted(ino))
+			continue;
+
+		if (!task_context && getpidcon(tid, &task_context) != 0)
+			task_context = strdup(no_ctx);
+
 		if (getfilecon(path, &sock_context) <= 0)
 			sock_context = strdup(no_ctx);
 
@@ -634,60 +779,37 @@ static void user_ent_hash_build_task(char *path, int pid, int tid)
 			}
 		}
 
-		user_ent_add(ino, task, pid, tid, fd, task_context, sock_context);
+		p = user_ent_new(ino, task, pid, tid, fd, task_context,
+				 sock_context);
+		p->seq = (*seq)++;
+		p->next = w->found;
+		w->found = p;
 		freecon(sock_context);
 	}
 
-	freecon(task_context);
+	if (task_context)
+		freecon(task_context);
 	closedir(dir);
 }
 
-static void user_ent_destroy(void)
-{
-	struct user_ent *p, *p_next;
-	int cnt = 0;
-
-	while (cnt != USER_ENT_HASH_SIZE) {
-		p = user_ent_hash[cnt];
-		while (p) {
-			free(p->task);
-			free(p->task_ctx);
-			free(p->socket_ctx);
-			p_next = p->next;
-			free(p);
-			p = p_next;
-		}
-		cnt++;
-	}
-}
-
-static void user_ent_hash_build(void)
+static void *user_ent_walk(void *arg)
 {
-	const char *root = getenv("PROC_ROOT") ? : "/proc/";
+	struct user_ent_walker *w = arg;
+	struct user_ent_scan *scan = w->scan;
 	char name[MAX_PATH_LEN];
-	struct dirent *d;
+	unsigned int i;
 	int nameoff;
-	DIR *dir;
-
-	strlcpy(name, root, sizeof(name));
-
-	if (strlen(name) == 0 || name[strlen(name) - 1] != '/')
-		strcat(name, "/");
 
+	strlcpy(name, scan->root, sizeof(name));
 	nameoff = strlen(name);
 
-	dir = opendir(name);
-	if (!dir)
-		return;
-
-	while ((d = readdir(dir)) != NULL) {
-		int pid;
-
-		if (sscanf(d->d_name, "%d%*c", &pid) != 1)
-			continue;
+	while ((i = __atomic_fetch_add(&scan->next, 1, __ATOMIC_RELAXED)) <
+	       scan->npids) {
+		unsigned long long seq = (unsigned long long)i << 32;
+		int pid = scan->pids[i];
 
 		snprintf(name + nameoff, sizeof(name) - nameoff, "%d/", pid);
-		user_ent_hash_build_task(name, pid, pid);
+		user_ent_hash_build_task(w, name, pid, pid, &seq);
 
 		if (show_threads) {
 			struct dirent *task_d;
@@ -708,11 +830,155 @@ static void user_ent_hash_build(void)
 					continue;
 
 				snprintf(name + nameoff, sizeof(name) - nameoff, "%d/", tid);
-				user_ent_hash_build_task(name, pid, tid);
+				user_ent_hash_build_task(w, name, pid, tid, &seq);
+			}
+			closedir(task_dir);
+		}
+	}
+
+	return NULL;
+}
+
+static int user_ent_cmp(const void *a, const void *b)
+{
+	const struct user_ent *pa = *(const struct user_ent **)a;
+	const struct user_ent *pb = *(const struct user_ent **)b;
+
+	return pa->seq < pb->seq ? -1 : pa->seq > pb->seq;
+}
+
+#define USER_ENT_PIDS_PER_THREAD	64
+#define USER_ENT_MAX_THREADS		16
+
+/*
+ * Walk /proc, spreading the processes over a few threads.  Each thread
+ * keeps its own list of owners, so the walk itself takes no locks.  The
+ * lists are merged in the order a sequential walk would have found them.
+ */
+static void user_ent_hash_build(void)
+{
+	const char *root = getenv("PROC_ROOT") ? : "/proc/";
+	struct user_ent_walker *walkers;
+	struct user_ent_scan scan = {};
+	struct user_ent **all, *p;
+	unsigned int i, n, max = 0;
+	long nthreads;
+	struct dirent *d;
+	DIR *dir;
+
+	strlcpy(scan.root, root, sizeof(scan.root));
+
+	if (strlen(scan.root) == 0 || scan.root[strlen(scan.root) - 1] != '/')
+		strcat(scan.root, "/");
+
+	dir = opendir(scan.root);
+	if (!dir)
+		return;
+
+	while ((d = readdir(dir)) != NULL) {
+		int pid;
+
+		if (sscanf(d->d_name, "%d%*c", &pid) != 1)
+			continue;
+
+		if (scan.npids == max) {
+			int *pids;
+
+			max = max ? max * 2 : 1024;
+			pids = realloc(scan.pids, max * sizeof(*pids));
+			if (!pids) {
+				fprintf(stderr, "ss: failed to malloc buffer\n");
+				abort();
 			}
+			scan.pids = pids;
 		}
+		scan.pids[scan.npids++] = pid;
 	}
 	closedir(dir);
+
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	nthreads = min(nthreads, (long)(scan.npids / USER_ENT_PIDS_PER_THREAD));
+	nthreads = max(min(nthreads, (long)USER_ENT_MAX_THREADS), 1L);
+
+	walkers = calloc(nthreads, sizeof(*walkers));
+	if (!walkers) {
+		fprintf(stderr, "ss: failed to malloc buffer\n");
+		abort();
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		walkers[i].scan = &scan;
+		if (i && pthread_create(&walkers[i].thread, NULL,
+					user_ent_walk, &walkers[i])) {
+			walkers[i].scan = NULL;
+			continue;
+		}
+	}
+	/* the main thread takes its share too */
+	user_ent_walk(&walkers[0]);
+
+	for (n = 0, i = 0; i < nthreads; i++) {
+		if (i && walkers[i].scan)
+			pthread_join(walkers[i].thread, NULL);
+		for (p = walkers[i].found; p; p = p->next)
+			n++;
+	}
+
+	all = malloc((n + 1) * sizeof(*all));
+	if (!all) {
+		fprintf(stderr, "ss: failed to malloc buffer\n");
+		abort();
+	}
+	for (n = 0, i = 0; i < nthreads; i++) {
+		for (p = walkers[i].found; p; p = p->next)
+			all[n++] = p;
+	}
+	qsort(all, n, sizeof(*all), user_ent_cmp);
+	for (i = 0; i < n; i++)
+		user_ent_insert(all[i]);
+
+	free(all);
+	free(walkers);
+	free(scan.pids);
+}
+
+/* Resolve the inodes recorded since the last call, see user_ent_wanted */
+static void user_ent_resolve(bool all)
+{
+	if (user_ent_complete || (!all && !user_ent_wanted_count))
+		return;
+
+	if (all) {
+		user_ent_want_reset();
+		user_ent_complete = true;
+	}
+	user_ent_hash_build();
+	user_ent_want_reset();
+}
+
+static void user_ent_destroy(void)
+{
+	struct user_ent *p, *p_next;
+	unsigned int cnt = 0;
+
+	while (cnt != user_ent_hash_size) {
+		p = user_ent_hash[cnt];
+		while (p) {
+			free(p->task);
+			free(p->task_ctx);
+			free(p->socket_ctx);
+			p_next = p->next;
+			free(p);
+			p = p_next;
+		}
+		cnt++;
+	}
+	free(user_ent_hash);
+	user_ent_hash = NULL;
+	user_ent_hash_size = 0;
+	user_ent_count = 0;
+	user_ent_complete = false;
+	user_ent_want_reset();
 }
 
 enum entry_types {
@@ -736,8 +1002,11 @@ static int find_entry(unsigned int ino, char **buf, int type)
 	if (!ino)
 		return 0;
 
-	p = user_ent_hash[user_ent_hashfn(ino)];
 	ptr = *buf = NULL;
+	if (!user_ent_hash_size)
+		return 0;
+
+	p = user_ent_hash[user_ent_hashfn(ino, user_ent_hash_size)];
 	while (p) {
 		if (p->ino != ino)
 			goto next;
@@ -1132,7 +1401,10 @@ static void field_flush(struct column *f)
 	chunk = buffer.tail;
 	pad = buffer.cur->len % 2;
 
-	if (buffer.cur->len > f->max_len)
+	/* host markers are measured once names are known */
+	if (buffer.cur->len > f->max_len &&
+	    !(render_host_marks &&
+	      memchr(buffer.cur->data, HOST_MARK, buffer.cur->len)))
 		f->max_len = buffer.cur->len;
 
 	/* We need a new chunk if we can't store the next length descriptor.
@@ -1184,6 +1456,22 @@ static void buf_free_all(void)
 	buffer.chunks = 0;
 }
 
+/* Drop buffered content but keep the first chunk, for streaming output */
+static void buf_reset(void)
+{
+	struct buf_chunk *head = buffer.head;
+
+	buffer.head = head->next;
+	buf_free_all();
+
+	head->next = NULL;
+	buffer.head = buffer.tail = head;
+	buffer.cur = (struct buf_token *)head->data;
+	buffer.cur->len = 0;
+	head->end = buffer.cur->data;
+	buffer.chunks = 1;
+}
+
 /* Get current screen width, returns -1 if TIOCGWINSZ fails */
 static int render_screen_width(void)
 {
@@ -1301,11 +1589,127 @@ newline:
 	}
 }
 
+static int users_find(unsigned int ino, char **buf);
+
+/* Print (or just measure) token data, expanding process markers left by
+ * proc_ctx_print().
+ */
+static const char *render_mark_find(const char *data, int len)
+{
+	const char *mark = memchr(data, USER_ENT_MARK, len);
+
+	if (render_host_marks) {
+		const char *host = memchr(data, HOST_MARK,
+					  mark ? mark - data : len);
+
+		if (host)
+			mark = host;
+	}
+	return mark;
+}
+
+static int render_host_mark(const char *mark, bool print)
+{
+	int af = mark[1] == '4' ? AF_INET : AF_INET6;
+	char addr[16], bracket[1024];
+	const char *name;
+	int i;
+
+	for (i = 0; i < sizeof(addr); i++) {
+		char hex[3] = { mark[2 + 2 * i], mark[3 + 2 * i], '\0' };
+
+		addr[i] = strtoul(hex, NULL, 16);
+	}
+
+	name = format_host(af, af == AF_INET ? 4 : 16, addr);
+
+	/* Numeric IPv6 addresses should be bracketed */
+	if (af == AF_INET6 && strchr(name, ':')) {
+		snprintf(bracket, sizeof(bracket), "[%s]", name);
+		name = bracket;
+	}
+
+	return print ? printf("%s", name) : strlen(name);
+}
+
+static int render_token(const struct buf_token *token, bool print)
+{
+	const char *data = token->data, *mark;
+	int len = token->len, printed = 0;
+
+	while ((mark = render_mark_find(data, len))) {
+		int mark_len = *mark == HOST_MARK ? HOST_MARK_LEN :
+						    USER_ENT_MARK_LEN;
+		char *buf;
+
+		if (mark + mark_len > data + len)
+			break;
+
+		if (print)
+			fwrite(data, 1, mark - data, stdout);
+		printed += mark - data;
+
+		if (*mark == HOST_MARK) {
+			printed += render_host_mark(mark, print);
+		} else {
+			char ino[USER_ENT_MARK_LEN];
+
+			memcpy(ino, mark + 1, USER_ENT_MARK_LEN - 1);
+			ino[USER_ENT_MARK_LEN - 1] = '\0';
+			if (users_find(strtoul(ino, NULL, 16), &buf) > 0) {
+				printed += print ?
+					   printf(" users:(%s)", buf) :
+					   strlen(buf) + 9;
+				free(buf);
+			}
+		}
+
+		len -= mark + mark_len - data;
+		data = mark + mark_len;
+	}
+
+	if (print)
+		fwrite(data, 1, len, stdout);
+	return printed + len;
+}
+
+/* Measure fields holding markers with the owners and names filled in */
+static void render_measure(void)
+{
+	struct buf_token *token = (struct buf_token *)buffer.head->data;
+	struct column *f = columns;
+	int len;
+
+	buffer.tail = buffer.head;
+	while (f->disabled)
+		f++;
+
+	while (token) {
+		/* like field_flush(), leave the unflushed last token out */
+		if (token != buffer.cur &&
+		    render_mark_find(token->data, token->len)) {
+			len = render_token(token, false);
+			if (len > f->max_len)
+				f->max_len = len;
+		}
+
+		do {
+			f = field_is_last(f) ? columns : f + 1;
+		} while (f->disabled);
+
+		token = buf_token_next(token);
+	}
+}
+
+/* Streaming output: rows measured so far, and whether widths are frozen */
+static int stream_rows_seen;
+static bool stream_widths_frozen;
+
 /* Render buffered output with spacing and delimiters, then free up buffers */
 static void render(void)
 {
 	struct buf_token *token;
-	int printed, line_started = 0;
+	int printed, len, line_started = 0;
 	struct column *f;
 
 	if (!buffer.head)
@@ -1316,7 +1720,19 @@ static void render(void)
 	/* Ensure end alignment of last token, it wasn't necessarily flushed */
 	buffer.tail->end += buffer.cur->len % 2;
 
-	render_calc_width();
+	/* Output that fills the buffer before the dump ends needs all owners */
+	if (user_ent_wanted_count)
+		user_ent_resolve(buffer.chunks >= BUF_CHUNKS_MAX);
+	if (render_host_marks)
+		resolve_addresses(HOST_RESOLVE_TIMEOUT);
+	if (user_ent_wanted_count || render_host_marks)
+		render_measure();
+
+	/* Streaming keeps the widths found over the first rows */
+	if (!stream_widths_frozen) {
+		render_calc_width();
+		stream_widths_frozen = stream_rows;
+	}
 
 	/* Rewind and replay */
 	buffer.tail = buffer.head;
@@ -1333,8 +1749,12 @@ static void render(void)
 			printed = 0;
 
 		/* Print field content from token data with spacing */
-		printed += print_left_spacing(f, token->len, printed);
-		printed += fwrite(token->data, 1, token->len, stdout);
+		len = token->len;
+		if ((user_ent_wanted_count || render_host_marks) &&
+		    render_mark_find(token->data, token->len))
+			len = render_token(token, false);
+		printed += print_left_spacing(f, len, printed);
+		printed += render_token(token, true);
 		print_right_spacing(f, printed);
 
 		/* Go to next non-empty field, deal with end-of-line */
@@ -1356,16 +1776,22 @@ static void render(void)
 	if (line_started)
 		printf("\n");
 
-	buf_free_all();
+	if (stream_widths_frozen)
+		buf_reset();
+	else
+		buf_free_all();
 	current_field = columns;
 }
 
 /* Move to next field, and render buffer if we reached the maximum number of
- * chunks, at the last field in a line.
+ * chunks, at the last field in a line. When streaming, render every line once
+ * the first stream_rows lines have set the column widths.
  */
 static void field_next(void)
 {
-	if (field_is_last(current_field) && buffer.chunks >= BUF_CHUNKS_MAX) {
+	if (field_is_last(current_field) &&
+	    (buffer.chunks >= BUF_CHUNKS_MAX ||
+	     (stream_rows && ++stream_rows_seen >= stream_rows))) {
 		render();
 		return;
 	}
@@ -1394,23 +1820,24 @@ static void print_header(void)
 	}
 }
 
+static const char * const sstate_name[] = {
+	"UNKNOWN",
+	[SS_ESTABLISHED] = "ESTAB",
+	[SS_SYN_SENT] = "SYN-SENT",
+	[SS_SYN_RECV] = "SYN-RECV",
+	[SS_FIN_WAIT1] = "FIN-WAIT-1",
+	[SS_FIN_WAIT2] = "FIN-WAIT-2",
+	[SS_TIME_WAIT] = "TIME-WAIT",
+	[SS_CLOSE] = "UNCONN",
+	[SS_CLOSE_WAIT] = "CLOSE-WAIT",
+	[SS_LAST_ACK] = "LAST-ACK",
+	[SS_LISTEN] =	"LISTEN",
+	[SS_CLOSING] = "CLOSING",
+};
+
 static void sock_state_print(struct sockstat *s)
 {
 	const char *sock_name;
-	static const char * const sstate_name[] = {
-		"UNKNOWN",
-		[SS_ESTABLISHED] = "ESTAB",
-		[SS_SYN_SENT] = "SYN-SENT",
-		[SS_SYN_RECV] = "SYN-RECV",
-		[SS_FIN_WAIT1] = "FIN-WAIT-1",
-		[SS_FIN_WAIT2] = "FIN-WAIT-2",
-		[SS_TIME_WAIT] = "TIME-WAIT",
-		[SS_CLOSE] = "UNCONN",
-		[SS_CLOSE_WAIT] = "CLOSE-WAIT",
-		[SS_LAST_ACK] = "LAST-ACK",
-		[SS_LISTEN] =	"LISTEN",
-		[SS_CLOSING] = "CLOSING",
-	};
 
 	switch (s->local.family) {
 	case AF_UNIX:
@@ -1706,7 +2133,21 @@ static void inet_addr_print(const inet_prefix *a, int port,
 	const char *ap = buf;
 	const char *ifname = NULL;
 
-	if (a->family == AF_INET) {
+	if (resolve_hosts &&
+	    (a->family == AF_INET || v6only ||
+	     memcmp(a->data, &in6addr_any, sizeof(in6addr_any)))) {
+		const unsigned char *p = (const unsigned char *)a->data;
+		int i;
+
+		resolve_address_want(a->family, a->family == AF_INET ? 4 : 16,
+				     a->data);
+		buf[0] = HOST_MARK;
+		buf[1] = a->family == AF_INET ? '4' : '6';
+		for (i = 0; i < 16; i++)
+			sprintf(buf + 2 + 2 * i, "%02x",
+				a->family == AF_INET && i >= 4 ? 0 : p[i]);
+		render_host_marks = true;
+	} else if (a->family == AF_INET) {
 		ap = format_host(AF_INET, 4, a->data);
 	} else {
 		if (!v6only &&
@@ -2086,21 +2527,24 @@ static int ssfilter_bytecompile(struct ssfilter *f, char **bytecode)
 	}
 }
 
-static int remember_he(struct aafilter *a, struct hostent *he)
+static int remember_ai(struct aafilter *a, const struct addrinfo *ai)
 {
-	char **ptr = he->h_addr_list;
 	int cnt = 0;
-	int len;
 
-	if (he->h_addrtype == AF_INET)
-		len = 4;
-	else if (he->h_addrtype == AF_INET6)
-		len = 16;
-	else
-		return 0;
-
-	while (*ptr) {
+	for (; ai; ai = ai->ai_next) {
 		struct aafilter *b = a;
+		const void *addr;
+		int len;
+
+		if (ai->ai_family == AF_INET) {
+			addr = &((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+			len = 4;
+		} else if (ai->ai_family == AF_INET6) {
+			addr = &((struct sockaddr_in6 *)ai->ai_addr)->sin6_addr;
+			len = 16;
+		} else {
+			continue;
+		}
 
 		if (a->addr.bitlen) {
 			if ((b = malloc(sizeof(*b))) == NULL)
@@ -2108,35 +2552,30 @@ static int remember_he(struct aafilter *a, struct hostent *he)
 			*b = *a;
 			a->next = b;
 		}
-		memcpy(b->addr.data, *ptr, len);
+		memcpy(b->addr.data, addr, len);
 		b->addr.bytelen = len;
 		b->addr.bitlen = len*8;
-		b->addr.family = he->h_addrtype;
-		ptr++;
+		b->addr.family = ai->ai_family;
 		cnt++;
 	}
 	return cnt;
 }
 
+/* A single getaddrinfo() call has the A and AAAA queries sent together */
 static int get_dns_host(struct aafilter *a, const char *addr, int fam)
 {
-	static int notfirst;
-	int cnt = 0;
-	struct hostent *he;
+	struct addrinfo hints = {
+		.ai_family = fam,
+		.ai_socktype = SOCK_STREAM,
+	};
+	struct addrinfo *res;
+	int cnt;
 
 	a->addr.bitlen = 0;
-	if (!notfirst) {
-		sethostent(1);
-		notfirst = 1;
-	}
-	he = gethostbyname2(addr, fam == AF_UNSPEC ? AF_INET : fam);
-	if (he)
-		cnt = remember_he(a, he);
-	if (fam == AF_UNSPEC) {
-		he = gethostbyname2(addr, AF_INET6);
-		if (he)
-			cnt += remember_he(a, he);
-	}
+	if (getaddrinfo(addr, NULL, &hints, &res))
+		return 1;
+	cnt = remember_ai(a, res);
+	freeaddrinfo(res);
 	return !cnt;
 }
 
@@ -2434,22 +2873,34 @@ void *parse_cgroupcond(const char *path)
 	return res;
 }
 
+static int users_find(unsigned int ino, char **buf)
+{
+	if (show_proc_ctx || show_sock_ctx)
+		return find_entry(ino, buf,
+				  (show_proc_ctx & show_sock_ctx) ?
+				  PROC_SOCK_CTX : PROC_CTX);
+	return find_entry(ino, buf, USERS);
+}
+
 static void proc_ctx_print(struct sockstat *s)
 {
 	char *buf;
 
-	if (show_proc_ctx || show_sock_ctx) {
-		if (find_entry(s->ino, &buf,
-				(show_proc_ctx & show_sock_ctx) ?
-				PROC_SOCK_CTX : PROC_CTX) > 0) {
-			out(" users:(%s)", buf);
-			free(buf);
-		}
-	} else if (show_processes || show_threads) {
-		if (find_entry(s->ino, &buf, USERS) > 0) {
-			out(" users:(%s)", buf);
-			free(buf);
+	if (!(show_processes || show_threads || show_proc_ctx || show_sock_ctx))
+		return;
+
+	if (!user_ent_complete) {
+		/* filled in by render() once the owners are known */
+		if (s->ino) {
+			user_ent_want(s->ino);
+			out("%c%08x", USER_ENT_MARK, s->ino);
 		}
+		return;
+	}
+
+	if (users_find(s->ino, &buf) > 0) {
+		out(" users:(%s)", buf);
+		free(buf);
 	}
 }
 
@@ -3499,6 +3950,843 @@ static int inet_show_sock(struct nlmsghdr *nlh,
 	return 0;
 }
 
+/* --top N --by METRIC: only the N sockets with the largest METRIC are
+ * printed.  Candidates are kept as raw diag messages in a bounded min-heap
+ * while the dump runs, so nothing is formatted until the winners are known.
+ */
+struct top_metric {
+	const char	*name;
+	int		offset;		/* in struct tcp_info, or TOP_*Q */
+	int		size;
+};
+
+#define TOP_RECVQ	-1
+#define TOP_SENDQ	-2
+
+#define TOP_TCPI(_name, _field) {					\
+	.name	= _name,						\
+	.offset	= offsetof(struct tcp_info, _field),			\
+	.size	= sizeof(((struct tcp_info *)0)->_field),		\
+}
+
+static const struct top_metric top_metrics[] = {
+	{ .name = "recvq", .offset = TOP_RECVQ },
+	{ .name = "sendq", .offset = TOP_SENDQ },
+	TOP_TCPI("rtt",			tcpi_rtt),
+	TOP_TCPI("rttvar",		tcpi_rttvar),
+	TOP_TCPI("minrtt",		tcpi_min_rtt),
+	TOP_TCPI("rto",			tcpi_rto),
+	TOP_TCPI("snd_cwnd",		tcpi_snd_cwnd),
+	TOP_TCPI("ssthresh",		tcpi_snd_ssthresh),
+	TOP_TCPI("unacked",		tcpi_unacked),
+	TOP_TCPI("lost",		tcpi_lost),
+	TOP_TCPI("retrans",		tcpi_total_retrans),
+	TOP_TCPI("reordering",		tcpi_reordering),
+	TOP_TCPI("reord_seen",		tcpi_reord_seen),
+	TOP_TCPI("dsack_dups",		tcpi_dsack_dups),
+	TOP_TCPI("notsent",		tcpi_notsent_bytes),
+	TOP_TCPI("bytes_sent",		tcpi_bytes_sent),
+	TOP_TCPI("bytes_retrans",	tcpi_bytes_retrans),
+	TOP_TCPI("bytes_acked",		tcpi_bytes_acked),
+	TOP_TCPI("bytes_received",	tcpi_bytes_received),
+	TOP_TCPI("segs_out",		tcpi_segs_out),
+	TOP_TCPI("segs_in",		tcpi_segs_in),
+	TOP_TCPI("delivered",		tcpi_delivered),
+	TOP_TCPI("delivery_rate",	tcpi_delivery_rate),
+	TOP_TCPI("pacing_rate",		tcpi_pacing_rate),
+	TOP_TCPI("busy",		tcpi_busy_time),
+	TOP_TCPI("rwnd_limited",	tcpi_rwnd_limited),
+	TOP_TCPI("sndbuf_limited",	tcpi_sndbuf_limited),
+	TOP_TCPI("snd_wnd",		tcpi_snd_wnd),
+	TOP_TCPI("rcv_wnd",		tcpi_rcv_wnd),
+};
+
+struct top_ent {
+	__u64		value;
+	int		protocol;
+	struct nlmsghdr	*h;
+};
+
+static const struct top_metric *top_by;
+static struct top_ent *top_heap;
+static int top_len;
+
+static const struct top_metric *top_metric_lookup(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(top_metrics); i++)
+		if (strcmp(top_metrics[i].name, name) == 0)
+			return &top_metrics[i];
+	return NULL;
+}
+
+static void top_metric_list(FILE *fp)
+{
+	int i;
+
+	fprintf(fp, "METRIC := {");
+	for (i = 0; i < ARRAY_SIZE(top_metrics); i++)
+		fprintf(fp, "%s%s", i ? "|" : "", top_metrics[i].name);
+	fprintf(fp, "}\n");
+}
+
+/* Metrics other than the queue sizes come from tcp_info, which only
+ * TCP sockets carry in that layout.
+ */
+static bool top_needs_tcpinfo(void)
+{
+	return top_by && top_by->offset >= 0;
+}
+
+static int top_metric_get(const struct nlmsghdr *h, int protocol, __u64 *value)
+{
+	struct inet_diag_msg *r = NLMSG_DATA(h);
+	struct rtattr *tb[INET_DIAG_MAX+1];
+	const char *info;
+
+	if (top_by->offset == TOP_RECVQ) {
+		*value = r->idiag_rqueue;
+		return 0;
+	}
+	if (top_by->offset == TOP_SENDQ) {
+		*value = r->idiag_wqueue;
+		return 0;
+	}
+
+	if (protocol != IPPROTO_TCP)
+		return -1;
+
+	parse_rtattr(tb, INET_DIAG_MAX, (struct rtattr *)(r+1),
+		     h->nlmsg_len - NLMSG_LENGTH(sizeof(*r)));
+	if (!tb[INET_DIAG_INFO] ||
+	    RTA_PAYLOAD(tb[INET_DIAG_INFO]) < top_by->offset + top_by->size)
+		return -1;
+
+	info = RTA_DATA(tb[INET_DIAG_INFO]) + top_by->offset;
+	if (top_by->size == sizeof(__u64)) {
+		__u64 v;
+
+		memcpy(&v, info, sizeof(v));
+		*value = v;
+	} else {
+		__u32 v;
+
+		memcpy(&v, info, sizeof(v));
+		*value = v;
+	}
+	return 0;
+}
+
+static void top_sift_down(int i)
+{
+	while (1) {
+		int l = 2 * i + 1, m = i;
+		struct top_ent tmp;
+
+		if (l < top_len && top_heap[l].value < top_heap[m].value)
+			m = l;
+		if (l + 1 < top_len && top_heap[l + 1].value < top_heap[m].value)
+			m = l + 1;
+		if (m == i)
+			return;
+		tmp = top_heap[i];
+		top_heap[i] = top_heap[m];
+		top_heap[m] = tmp;
+		i = m;
+	}
+}
+
+static void top_sift_up(int i)
+{
+	while (i > 0) {
+		int p = (i - 1) / 2;
+		struct top_ent tmp;
+
+		if (top_heap[p].value <= top_heap[i].value)
+			return;
+		tmp = top_heap[i];
+		top_heap[i] = top_heap[p];
+		top_heap[p] = tmp;
+		i = p;
+	}
+}
+
+/* Offer a socket that passed the filter; on ties the first one seen wins */
+static int top_offer(const struct nlmsghdr *h, int protocol)
+{
+	struct top_ent *e;
+	__u64 value;
+
+	if (top_metric_get(h, protocol, &value))
+		return 0;
+
+	if (!top_heap) {
+		top_heap = calloc(top_count, sizeof(*top_heap));
+		if (!top_heap)
+			return -1;
+	}
+
+	if (top_len < top_count)
+		e = &top_heap[top_len];
+	else if (value > top_heap[0].value)
+		e = &top_heap[0];
+	else
+		return 0;
+
+	e->h = realloc(e->h, h->nlmsg_len);
+	if (!e->h)
+		return -1;
+	memcpy(e->h, h, h->nlmsg_len);
+	e->value = value;
+	e->protocol = protocol;
+
+	if (top_len < top_count)
+		top_sift_up(top_len++);
+	else
+		top_sift_down(0);
+	return 0;
+}
+
+/* Print the winners, largest first, and free them */
+static void top_show(void)
+{
+	int i, n = top_len;
+
+	/* heap sort: each popped minimum is parked right past the heap */
+	while (top_len > 1) {
+		struct top_ent e = top_heap[0];
+
+		top_heap[0] = top_heap[--top_len];
+		top_heap[top_len] = e;
+		top_sift_down(0);
+	}
+
+	for (i = 0; i < n; i++) {
+		struct top_ent *e = &top_heap[i];
+		struct sockstat s = {};
+
+		parse_diag_msg(e->h, &s);
+		s.type = e->protocol;
+		inet_show_sock(e->h, &s);
+		free(e->h);
+	}
+
+	free(top_heap);
+	top_heap = NULL;
+	top_len = 0;
+}
+
+/* --interval N: TCP sockets are dumped every N seconds and remembered by
+ * cookie, so that each sample shows what every connection did since the
+ * previous one.  The first dump is only a baseline.
+ */
+struct sample_ent {
+	struct sample_ent	*next;
+	unsigned long long	cookie;
+	unsigned int		gen;
+	int			protocol;
+	__u64			bytes_acked;
+	__u64			bytes_received;
+	__u32			segs_out;
+	__u32			retrans;
+	struct nlmsghdr		*h;
+};
+
+static struct sample_ent **sample_hash;
+static unsigned int sample_hash_size;
+static unsigned int sample_count;
+static unsigned int sample_gen;
+static double sample_elapsed;	/* seconds since the previous sample */
+
+static unsigned int sample_hashfn(unsigned long long cookie)
+{
+	return (cookie ^ (cookie >> 32)) * 2654435761U;
+}
+
+static struct sample_ent **sample_slot(unsigned long long cookie)
+{
+	struct sample_ent **pp;
+
+	pp = &sample_hash[sample_hashfn(cookie) & (sample_hash_size - 1)];
+	while (*pp && (*pp)->cookie != cookie)
+		pp = &(*pp)->next;
+	return pp;
+}
+
+static int sample_hash_grow(void)
+{
+	struct sample_ent **old = sample_hash;
+	unsigned int i, old_size = sample_hash_size;
+
+	sample_hash_size = old_size ? old_size * 2 : 1024;
+	sample_hash = calloc(sample_hash_size, sizeof(*sample_hash));
+	if (!sample_hash) {
+		sample_hash = old;
+		sample_hash_size = old_size;
+		return -1;
+	}
+
+	for (i = 0; i < old_size; i++) {
+		struct sample_ent *e, *next;
+
+		for (e = old[i]; e; e = next) {
+			struct sample_ent **pp = sample_slot(e->cookie);
+
+			next = e->next;
+			e->next = *pp;
+			*pp = e;
+		}
+	}
+	free(old);
+	return 0;
+}
+
+static void sample_tcp_info(const struct nlmsghdr *h, struct tcp_info *info)
+{
+	struct inet_diag_msg *r = NLMSG_DATA(h);
+	struct rtattr *tb[INET_DIAG_MAX+1];
+
+	memset(info, 0, sizeof(*info));
+	parse_rtattr(tb, INET_DIAG_MAX, (struct rtattr *)(r+1),
+		     h->nlmsg_len - NLMSG_LENGTH(sizeof(*r)));
+	if (tb[INET_DIAG_INFO]) {
+		int len = RTA_PAYLOAD(tb[INET_DIAG_INFO]);
+
+		/* older kernels have less fields */
+		if (len > sizeof(*info))
+			len = sizeof(*info);
+		memcpy(info, RTA_DATA(tb[INET_DIAG_INFO]), len);
+	}
+}
+
+static const char *sample_sep(void)
+{
+	return oneline || !show_tcpinfo ? " " : "\n\t";
+}
+
+static void sample_delta_print(const struct sample_ent *e,
+			       const struct tcp_info *info)
+{
+	__u64 acked = info->tcpi_bytes_acked - e->bytes_acked;
+	__u64 received = info->tcpi_bytes_received - e->bytes_received;
+	__u32 segs_out = info->tcpi_segs_out - e->segs_out;
+	char b1[64], b2[64];
+
+	out("%sbytes_acked:+%llu bytes_received:+%llu segs_out:+%u retrans:+%u",
+	    sample_sep(), acked, received, segs_out,
+	    info->tcpi_total_retrans - e->retrans);
+	if (sample_elapsed > 0)
+		out(" acked_rate %sbps rcv_rate %sbps",
+		    sprint_bw(b1, acked * 8 / sample_elapsed),
+		    sprint_bw(b2, received * 8 / sample_elapsed));
+}
+
+static int sample_sock(struct nlmsghdr *h, struct sockstat *s, int protocol)
+{
+	struct sample_ent **pp, *e;
+	struct tcp_info info;
+
+	if (sample_count >= sample_hash_size && sample_hash_grow())
+		return -1;
+
+	pp = sample_slot(s->sk);
+	e = *pp;
+	if (!e) {
+		e = calloc(1, sizeof(*e));
+		if (!e)
+			return -1;
+		e->cookie = s->sk;
+		e->next = *pp;
+		*pp = e;
+		sample_count++;
+	}
+
+	sample_tcp_info(h, &info);
+
+	if (sample_gen > 1) {
+		inet_show_sock(h, s);
+		if (e->gen)
+			sample_delta_print(e, &info);
+		else
+			out("%s[new]", sample_sep());
+	}
+
+	e->h = realloc(e->h, h->nlmsg_len);
+	if (!e->h)
+		return -1;
+	memcpy(e->h, h, h->nlmsg_len);
+	e->gen = sample_gen;
+	e->protocol = protocol;
+	e->bytes_acked = info.tcpi_bytes_acked;
+	e->bytes_received = info.tcpi_bytes_received;
+	e->segs_out = info.tcpi_segs_out;
+	e->retrans = info.tcpi_total_retrans;
+	return 0;
+}
+
+/* Show and forget the sockets that were not in the latest dump */
+static void sample_sweep(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < sample_hash_size; i++) {
+		struct sample_ent **pp = &sample_hash[i];
+
+		while (*pp) {
+			struct sample_ent *e = *pp;
+			struct sockstat s = {};
+
+			if (e->gen == sample_gen) {
+				pp = &e->next;
+				continue;
+			}
+
+			parse_diag_msg(e->h, &s);
+			s.type = e->protocol;
+			inet_show_sock(e->h, &s);
+			out("%s[closed]", sample_sep());
+
+			*pp = e->next;
+			free(e->h);
+			free(e);
+			sample_count--;
+		}
+	}
+}
+
+static int inet_show_netlink(struct filter *f, FILE *dump_fp, int protocol);
+
+static int sample_loop(struct filter *f)
+{
+	struct timespec next, now, prev;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	prev = next;
+
+	while (1) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		sample_elapsed = now.tv_sec - prev.tv_sec +
+				 (now.tv_nsec - prev.tv_nsec) / 1e9;
+		prev = now;
+
+		if (++sample_gen > 1 && show_header)
+			print_header();
+
+		if (inet_show_netlink(f, NULL, IPPROTO_TCP)) {
+			fprintf(stderr, "ss: --interval needs the sock_diag interface\n");
+			return -1;
+		}
+		sample_sweep();
+
+		render();
+		fflush(stdout);
+
+		/* owners are looked up again for the next sample */
+		if (show_processes || show_threads || show_proc_ctx ||
+		    show_sock_ctx)
+			user_ent_destroy();
+
+		next.tv_sec += sample_interval;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+}
+
+/* --count-by KEYS: inet sockets are only counted, per distinct value of
+ * the chosen keys.  The kernel already applied the filter bytecode, so only
+ * the inet_diag_msg header is looked at, plus the attribute carrying the
+ * mark or cgroup when those are keys.  src and dst may be cut down to a
+ * prefix, as in dst/24.
+ *
+ * With -E the destroy events are counted instead, over windows of
+ * --interval seconds, and the groups also sum up the bytes and
+ * retransmits of the tcp_info attached to each event.
+ */
+enum {
+	COUNT_NETID,
+	COUNT_STATE,
+	COUNT_FAMILY,
+	COUNT_SRC,
+	COUNT_SPORT,
+	COUNT_DST,
+	COUNT_DPORT,
+	COUNT_UID,
+	COUNT_DEV,
+	COUNT_MARK,
+	COUNT_CGROUP,
+	COUNT_MAX
+};
+
+static const struct {
+	const char	*name;
+	const char	*header;
+} count_key_names[COUNT_MAX] = {
+	[COUNT_NETID]	= { "netid",	"Netid" },
+	[COUNT_STATE]	= { "state",	"State" },
+	[COUNT_FAMILY]	= { "family",	"Family" },
+	[COUNT_SRC]	= { "src",	"Local Address" },
+	[COUNT_SPORT]	= { "sport",	"Local Port" },
+	[COUNT_DST]	= { "dst",	"Peer Address" },
+	[COUNT_DPORT]	= { "dport",	"Peer Port" },
+	[COUNT_UID]	= { "uid",	"UID" },
+	[COUNT_DEV]	= { "dev",	"Interface" },
+	[COUNT_MARK]	= { "mark",	"Mark" },
+	[COUNT_CGROUP]	= { "cgroup",	"Cgroup" },
+};
+
+struct count_key {
+	int		protocol;
+	__u8		family;
+	__u8		state;
+	__u16		sport;
+	__u16		dport;
+	__u32		uid;
+	__u32		iface;
+	__u32		mark;
+	__u64		cgroup_id;
+	__u32		src[4];
+	__u32		dst[4];
+};
+
+struct count_ent {
+	struct count_ent	*next;
+	struct count_key	key;
+	unsigned long long	count;
+	unsigned long long	bytes_acked;
+	unsigned long long	bytes_received;
+	unsigned long long	retrans;
+};
+
+static int count_keys[COUNT_MAX];	/* in output order */
+static unsigned int count_mask;
+static int count_src_plen = -1, count_dst_plen = -1;
+static bool count_totals;		/* sum up tcp_info, for -E */
+static bool count_kernel_filtered;	/* the filter compiled to bytecode */
+static struct count_ent **count_hash;
+static unsigned int count_hash_size;
+static unsigned int count_groups;
+
+static int count_keys_parse(const char *arg)
+{
+	char *list = strdupa(arg), *tok;
+	int i;
+
+	for (tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+		char *plen = strchr(tok, '/');
+		unsigned int len;
+
+		if (plen)
+			*plen++ = 0;
+		for (i = 0; i < COUNT_MAX; i++)
+			if (strcmp(tok, count_key_names[i].name) == 0)
+				break;
+		if (i == COUNT_MAX || (count_mask & (1 << i)))
+			return -1;
+		if (plen) {
+			if ((i != COUNT_SRC && i != COUNT_DST) ||
+			    get_unsigned(&len, plen, 0) || len > 128)
+				return -1;
+			if (i == COUNT_SRC)
+				count_src_plen = len;
+			else
+				count_dst_plen = len;
+		}
+		count_mask |= 1 << i;
+		count_keys[count_nkeys++] = i;
+	}
+	return count_nkeys ? 0 : -1;
+}
+
+static unsigned int count_hashfn(const struct count_key *k)
+{
+	const unsigned char *p = (const unsigned char *)k;
+	unsigned int i, h = 2166136261U;
+
+	for (i = 0; i < sizeof(*k); i++)
+		h = (h ^ p[i]) * 16777619U;
+	return h;
+}
+
+static struct count_ent **count_slot(const struct count_key *k)
+{
+	struct count_ent **pp;
+
+	pp = &count_hash[count_hashfn(k) & (count_hash_size - 1)];
+	while (*pp && memcmp(&(*pp)->key, k, sizeof(*k)))
+		pp = &(*pp)->next;
+	return pp;
+}
+
+static int count_hash_grow(void)
+{
+	struct count_ent **old = count_hash;
+	unsigned int i, old_size = count_hash_size;
+
+	count_hash_size = old_size ? old_size * 2 : 256;
+	count_hash = calloc(count_hash_size, sizeof(*count_hash));
+	if (!count_hash) {
+		count_hash = old;
+		count_hash_size = old_size;
+		return -1;
+	}
+
+	for (i = 0; i < old_size; i++) {
+		struct count_ent *e, *next;
+
+		for (e = old[i]; e; e = next) {
+			struct count_ent **pp = count_slot(&e->key);
+
+			next = e->next;
+			e->next = *pp;
+			*pp = e;
+		}
+	}
+	free(old);
+	return 0;
+}
+
+static void count_prefix(__u32 *addr, int plen)
+{
+	int i;
+
+	if (plen < 0)
+		return;
+	for (i = 0; i < 4; i++, plen -= 32) {
+		if (plen >= 32)
+			continue;
+		addr[i] = plen > 0 ? addr[i] & htonl(~0U << (32 - plen)) : 0;
+	}
+}
+
+static int count_sock(const struct nlmsghdr *h, int protocol)
+{
+	struct inet_diag_msg *r = NLMSG_DATA(h);
+	struct rtattr *tb[INET_DIAG_MAX+1];
+	struct tcp_info info = {};
+	struct count_key k = {};
+	struct count_ent **pp;
+
+	if (count_totals || protocol == IPPROTO_MAX ||
+	    (count_mask & ((1 << COUNT_MARK) | (1 << COUNT_CGROUP))))
+		parse_rtattr(tb, INET_DIAG_MAX, (struct rtattr *)(r+1),
+			     h->nlmsg_len - NLMSG_LENGTH(sizeof(*r)));
+
+	/* events do not say which table they come from */
+	if (protocol == IPPROTO_MAX && tb[INET_DIAG_PROTOCOL])
+		protocol = rta_getattr_u8(tb[INET_DIAG_PROTOCOL]);
+
+	if (count_mask & (1 << COUNT_NETID))
+		k.protocol = protocol;
+	if (count_mask & (1 << COUNT_STATE))
+		k.state = r->idiag_state;
+	if (count_mask & ((1 << COUNT_FAMILY) | (1 << COUNT_SRC) |
+			  (1 << COUNT_DST)))
+		k.family = r->idiag_family;
+	if (count_mask & (1 << COUNT_SRC)) {
+		memcpy(k.src, r->id.idiag_src, sizeof(k.src));
+		count_prefix(k.src, count_src_plen);
+	}
+	if (count_mask & (1 << COUNT_SPORT))
+		k.sport = ntohs(r->id.idiag_sport);
+	if (count_mask & (1 << COUNT_DST)) {
+		memcpy(k.dst, r->id.idiag_dst, sizeof(k.dst));
+		count_prefix(k.dst, count_dst_plen);
+	}
+	if (count_mask & (1 << COUNT_DPORT))
+		k.dport = ntohs(r->id.idiag_dport);
+	if (count_mask & (1 << COUNT_UID))
+		k.uid = r->idiag_uid;
+	if (count_mask & (1 << COUNT_DEV))
+		k.iface = r->id.idiag_if;
+	if ((count_mask & (1 << COUNT_MARK)) && tb[INET_DIAG_MARK])
+		k.mark = rta_getattr_u32(tb[INET_DIAG_MARK]);
+	if ((count_mask & (1 << COUNT_CGROUP)) && tb[INET_DIAG_CGROUP_ID])
+		k.cgroup_id = rta_getattr_u64(tb[INET_DIAG_CGROUP_ID]);
+	if (count_totals && tb[INET_DIAG_INFO]) {
+		int len = RTA_PAYLOAD(tb[INET_DIAG_INFO]);
+
+		if (len > sizeof(info))
+			len = sizeof(info);
+		memcpy(&info, RTA_DATA(tb[INET_DIAG_INFO]), len);
+	}
+
+	if (count_groups >= count_hash_size && count_hash_grow())
+		return -1;
+
+	pp = count_slot(&k);
+	if (!*pp) {
+		*pp = calloc(1, sizeof(**pp));
+		if (!*pp)
+			return -1;
+		(*pp)->key = k;
+		count_groups++;
+	}
+	(*pp)->count++;
+	(*pp)->bytes_acked += info.tcpi_bytes_acked;
+	(*pp)->bytes_received += info.tcpi_bytes_received;
+	(*pp)->retrans += info.tcpi_total_retrans;
+	return 0;
+}
+
+static int count_ent_cmp(const void *a, const void *b)
+{
+	const struct count_ent *x = *(const struct count_ent **)a;
+	const struct count_ent *y = *(const struct count_ent **)b;
+
+	if (x->count != y->count)
+		return x->count > y->count ? -1 : 1;
+	return memcmp(&x->key, &y->key, sizeof(x->key));
+}
+
+static char *count_key_format(const struct count_key *k, int key)
+{
+	int len = k->family == AF_INET ? 4 : 16;
+	char buf[64];
+
+	switch (key) {
+	case COUNT_NETID:
+		return strdup(proto_name(k->protocol == IPPROTO_RAW ?
+					 0 : k->protocol));
+	case COUNT_STATE:
+		return strdup(k->state < ARRAY_SIZE(sstate_name) &&
+			      sstate_name[k->state] ?
+			      sstate_name[k->state] : "UNKNOWN");
+	case COUNT_FAMILY:
+		return strdup(k->family == AF_INET ? "inet" : "inet6");
+	case COUNT_SRC:
+	case COUNT_DST: {
+		int plen = key == COUNT_SRC ? count_src_plen : count_dst_plen;
+
+		snprintf(buf, sizeof(buf), "%s",
+			 format_host(k->family, len,
+				     key == COUNT_SRC ? k->src : k->dst));
+		if (plen >= 0 && plen < len * 8)
+			snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf),
+				 "/%d", plen);
+		break;
+	}
+	case COUNT_SPORT:
+	case COUNT_DPORT:
+		if (count_mask & (1 << COUNT_NETID))
+			dg_proto = k->protocol == IPPROTO_UDP ? UDP_PROTO :
+				   k->protocol == IPPROTO_RAW ? RAW_PROTO :
+				   TCP_PROTO;
+		return strdup(resolve_service(key == COUNT_SPORT ?
+					      k->sport : k->dport));
+	case COUNT_UID:
+		snprintf(buf, sizeof(buf), "%u", k->uid);
+		break;
+	case COUNT_DEV:
+		return strdup(k->iface ? ll_index_to_name(k->iface) : "*");
+	case COUNT_MARK:
+		snprintf(buf, sizeof(buf), "0x%x", k->mark);
+		break;
+	case COUNT_CGROUP:
+		return strdup(cg_id_to_path(k->cgroup_id));
+	}
+	return strdup(buf);
+}
+
+static const char *count_total_names[] = {
+	"Count", "Bytes-Acked", "Bytes-Rcvd", "Retrans",
+};
+
+static unsigned long long count_total(const struct count_ent *e, int col)
+{
+	switch (col) {
+	case 1:
+		return e->bytes_acked;
+	case 2:
+		return e->bytes_received;
+	case 3:
+		return e->retrans;
+	}
+	return e->count;
+}
+
+/* Print the groups, largest first, and free them */
+static void count_show(void)
+{
+	int ntotals = count_totals ? ARRAY_SIZE(count_total_names) : 1;
+	int width[COUNT_MAX + ARRAY_SIZE(count_total_names)];
+	struct count_ent **ents;
+	char **cells;
+	unsigned int i, n = 0;
+	int j;
+
+	ents = calloc(count_groups ? : 1, sizeof(*ents));
+	cells = calloc((count_groups ? : 1) * count_nkeys, sizeof(*cells));
+	if (!ents || !cells) {
+		perror("ss: count");
+		exit(-1);
+	}
+
+	for (i = 0; i < count_hash_size; i++) {
+		struct count_ent *e;
+
+		for (e = count_hash[i]; e; e = e->next)
+			ents[n++] = e;
+	}
+	qsort(ents, n, sizeof(*ents), count_ent_cmp);
+
+	for (j = 0; j < count_nkeys; j++)
+		width[j] = show_header ?
+			   strlen(count_key_names[count_keys[j]].header) : 0;
+	for (j = 0; j < ntotals; j++)
+		width[count_nkeys + j] = show_header ?
+					 strlen(count_total_names[j]) : 0;
+
+	for (i = 0; i < n; i++) {
+		char buf[32];
+
+		for (j = 0; j < count_nkeys; j++) {
+			char *cell = count_key_format(&ents[i]->key,
+						      count_keys[j]);
+
+			if (!cell) {
+				perror("ss: count");
+				exit(-1);
+			}
+			cells[i * count_nkeys + j] = cell;
+			if (strlen(cell) > width[j])
+				width[j] = strlen(cell);
+		}
+		for (j = 0; j < ntotals; j++)
+			if (snprintf(buf, sizeof(buf), "%llu",
+				     count_total(ents[i], j)) >
+			    width[count_nkeys + j])
+				width[count_nkeys + j] = strlen(buf);
+	}
+
+	if (show_header) {
+		for (j = 0; j < count_nkeys; j++)
+			printf("%-*s ", width[j],
+			       count_key_names[count_keys[j]].header);
+		for (j = 0; j < ntotals; j++)
+			printf("%*s%s", width[count_nkeys + j],
+			       count_total_names[j],
+			       j == ntotals - 1 ? "\n" : " ");
+	}
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < count_nkeys; j++) {
+			printf("%-*s ", width[j], cells[i * count_nkeys + j]);
+			free(cells[i * count_nkeys + j]);
+		}
+		for (j = 0; j < ntotals; j++)
+			printf("%*llu%s", width[count_nkeys + j],
+			       count_total(ents[i], j),
+			       j == ntotals - 1 ? "\n" : " ");
+		free(ents[i]);
+	}
+
+	free(cells);
+	free(ents);
+	free(count_hash);
+	count_hash = NULL;
+	count_hash_size = count_groups = 0;
+}
+
 static int tcpdiag_send(int fd, int protocol, struct filter *f)
 {
 	struct sockaddr_nl nladdr = { .nl_family = AF_NETLINK };
@@ -3531,7 +4819,7 @@ static int tcpdiag_send(int fd, int protocol, struct filter *f)
 		req.r.idiag_ext |= (1<<(INET_DIAG_SKMEMINFO-1));
 	}
 
-	if (show_tcpinfo) {
+	if (show_tcpinfo || top_needs_tcpinfo() || sample_interval) {
 		req.r.idiag_ext |= (1<<(INET_DIAG_INFO-1));
 		req.r.idiag_ext |= (1<<(INET_DIAG_VEGASINFO-1));
 		req.r.idiag_ext |= (1<<(INET_DIAG_CONG-1));
@@ -3598,7 +4886,7 @@ static int sockdiag_send(int family, int fd, int protocol, struct filter *f)
 		req.r.idiag_ext |= (1<<(INET_DIAG_SKMEMINFO-1));
 	}
 
-	if (show_tcpinfo) {
+	if (show_tcpinfo || top_needs_tcpinfo() || sample_interval) {
 		req.r.idiag_ext |= (1<<(INET_DIAG_INFO-1));
 		req.r.idiag_ext |= (1<<(INET_DIAG_VEGASINFO-1));
 		req.r.idiag_ext |= (1<<(INET_DIAG_CONG-1));
@@ -3657,29 +4945,212 @@ struct inet_diag_arg {
 	struct rtnl_handle *rth;
 };
 
+/* -K: SOCK_DESTROY requests are queued from the dump callback and sent
+ * kill_window at a time with a single send(), then their acks are read
+ * back together.  The kernel handles a batch under one sock_diag lock,
+ * so the window also bounds how long each batch holds it.  --kill-rate
+ * spaces the requests out to that many sockets per second.  A socket is
+ * displayed once its ack says it was closed.
+ */
+#define KILL_WINDOW_MAX	256	/* acks of a batch must fit the rcvbuf */
+
+struct kill_req {
+	struct nlmsghdr		nlh;
+	struct inet_diag_req_v2	r;
+};
+
+static struct {
+	struct kill_req		*reqs;
+	struct nlmsghdr		**msgs;
+	int			*protocols;
+	unsigned int		n;
+	struct timespec		start;
+	time_t			progress;
+	unsigned long long	queued;
+	unsigned long long	closed;
+	unsigned long long	gone;
+	unsigned long long	failed;
+} kill_q;
+
+static void kill_progress(bool done)
+{
+	struct timespec now;
+	double secs;
+
+	if (!kill_report || !kill_q.queued || follow_events)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!done && now.tv_sec <= kill_q.progress)
+		return;
+	kill_q.progress = now.tv_sec;
+
+	secs = now.tv_sec - kill_q.start.tv_sec +
+	       (now.tv_nsec - kill_q.start.tv_nsec) / 1e9;
+	fprintf(stderr, "%s %llu closed, %llu gone, %llu failed, %.0f/s%s",
+		done ? "Killed:" : "Killing:",
+		kill_q.closed, kill_q.gone, kill_q.failed,
+		secs > 0 ? kill_q.queued / secs : 0,
+		done || !isatty(STDERR_FILENO) ? "\n" : "\r");
+}
+
+static int kill_show(struct nlmsghdr *h, int protocol)
+{
+	struct sockstat s = {};
+
+	parse_diag_msg(h, &s);
+	s.type = protocol;
+
+	return inet_show_sock(h, &s);
+}
+
+static int kill_flush(struct rtnl_handle *rth)
+{
+	char buf[16384];
+	unsigned int i, acked = 0;
+	__u32 seq0;
+	int err = 0;
+
+	if (!kill_q.n)
+		return 0;
+
+	seq0 = kill_q.reqs[0].nlh.nlmsg_seq;
+	if (rtnl_send(rth, kill_q.reqs, kill_q.n * sizeof(*kill_q.reqs)) < 0) {
+		perror("SOCK_DESTROY send");
+		err = -1;
+		goto out;
+	}
+
+	while (acked < kill_q.n) {
+		struct nlmsghdr *h;
+		int len;
+
+		len = recv(rth->fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("SOCK_DESTROY answers");
+			err = -1;
+			goto out;
+		}
+
+		for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, len);
+		     h = NLMSG_NEXT(h, len)) {
+			struct nlmsgerr *e = NLMSG_DATA(h);
+
+			i = h->nlmsg_seq - seq0;
+			if (h->nlmsg_type != NLMSG_ERROR || i >= kill_q.n)
+				continue;
+			acked++;
+
+			if (!e->error) {
+				kill_q.closed++;
+				if (kill_show(kill_q.msgs[i], kill_q.protocols[i]) < 0)
+					err = -1;
+			} else if (e->error == -EOPNOTSUPP || e->error == -ENOENT) {
+				/* Socket can't be closed, or is already closed. */
+				kill_q.gone++;
+			} else {
+				kill_q.failed++;
+				if (!err) {
+					errno = -e->error;
+					perror("SOCK_DESTROY answers");
+					err = -1;
+				}
+			}
+		}
+	}
+
+out:
+	for (i = 0; i < kill_q.n; i++)
+		free(kill_q.msgs[i]);
+	kill_q.n = 0;
+	kill_progress(false);
+	return err;
+}
+
+/* Hold the next request back until --kill-rate allows it */
+static int kill_throttle(struct rtnl_handle *rth)
+{
+	struct timespec now, due;
+	unsigned long long ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ns = kill_q.queued * 1000000000ULL / kill_rate;
+	due.tv_sec = kill_q.start.tv_sec + ns / 1000000000ULL;
+	due.tv_nsec = kill_q.start.tv_nsec + ns % 1000000000ULL;
+	if (due.tv_nsec >= 1000000000L) {
+		due.tv_sec++;
+		due.tv_nsec -= 1000000000L;
+	}
+
+	if (now.tv_sec > due.tv_sec ||
+	    (now.tv_sec == due.tv_sec && now.tv_nsec >= due.tv_nsec))
+		return 0;
+
+	/* do not sit on queued requests while waiting */
+	if (kill_flush(rth))
+		return -1;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR)
+		;
+	return 0;
+}
+
 static int kill_inet_sock(struct nlmsghdr *h, void *arg, struct sockstat *s)
 {
 	struct inet_diag_msg *d = NLMSG_DATA(h);
 	struct inet_diag_arg *diag_arg = arg;
 	struct rtnl_handle *rth = diag_arg->rth;
+	struct kill_req *req;
+
+	if (!kill_q.reqs) {
+		kill_q.reqs = calloc(kill_window, sizeof(*kill_q.reqs));
+		kill_q.msgs = calloc(kill_window, sizeof(*kill_q.msgs));
+		kill_q.protocols = calloc(kill_window, sizeof(*kill_q.protocols));
+		if (!kill_q.reqs || !kill_q.msgs || !kill_q.protocols) {
+			perror("kill queue");
+			return -1;
+		}
+	}
 
-	DIAG_REQUEST(req, struct inet_diag_req_v2 r);
+	if (!kill_q.queued) {
+		clock_gettime(CLOCK_MONOTONIC, &kill_q.start);
+		kill_q.progress = kill_q.start.tv_sec;
+	} else if (kill_rate && kill_throttle(rth)) {
+		return -1;
+	}
+
+	kill_q.msgs[kill_q.n] = malloc(h->nlmsg_len);
+	if (!kill_q.msgs[kill_q.n]) {
+		perror("kill queue");
+		return -1;
+	}
+	memcpy(kill_q.msgs[kill_q.n], h, h->nlmsg_len);
+	kill_q.protocols[kill_q.n] = diag_arg->protocol;
 
-	req.nlh.nlmsg_type = SOCK_DESTROY;
-	req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
-	req.nlh.nlmsg_seq = ++rth->seq;
-	req.r.sdiag_family = d->idiag_family;
-	req.r.sdiag_protocol = diag_arg->protocol;
-	req.r.id = d->id;
+	req = &kill_q.reqs[kill_q.n];
+	memset(req, 0, sizeof(*req));
+	req->nlh.nlmsg_len = sizeof(*req);
+	req->nlh.nlmsg_type = SOCK_DESTROY;
+	req->nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	req->nlh.nlmsg_seq = ++rth->seq;
+	req->r.sdiag_family = d->idiag_family;
+	req->r.sdiag_protocol = diag_arg->protocol;
+	req->r.id = d->id;
 
 	if (diag_arg->protocol == IPPROTO_RAW) {
-		struct inet_diag_req_raw *raw = (void *)&req.r;
+		struct inet_diag_req_raw *raw = (void *)&req->r;
 
-		BUILD_BUG_ON(sizeof(req.r) != sizeof(*raw));
+		BUILD_BUG_ON(sizeof(req->r) != sizeof(*raw));
 		raw->sdiag_raw_protocol = s->raw_prot;
 	}
 
-	return rtnl_talk(rth, &req.nlh, NULL);
+	kill_q.n++;
+	kill_q.queued++;
+
+	if (kill_q.n >= kill_window)
+		return kill_flush(rth);
+	return 0;
 }
 
 static int show_one_inet_sock(struct nlmsghdr *h, void *arg)
@@ -3692,21 +5163,29 @@ static int show_one_inet_sock(struct nlmsghdr *h, void *arg)
 	if (!(diag_arg->f->families & FAMILY_MASK(r->idiag_family)))
 		return 0;
 
+	if (count_nkeys && count_kernel_filtered)
+		return count_sock(h, diag_arg->protocol);
+
 	parse_diag_msg(h, &s);
 	s.type = diag_arg->protocol;
 
 	if (diag_arg->f->f && run_ssfilter(diag_arg->f->f, &s) == 0)
 		return 0;
 
-	if (diag_arg->f->kill && kill_inet_sock(h, arg, &s) != 0) {
-		if (errno == EOPNOTSUPP || errno == ENOENT) {
-			/* Socket can't be closed, or is already closed. */
-			return 0;
-		} else {
-			perror("SOCK_DESTROY answers");
-			return -1;
-		}
-	}
+	/* destroy events are not filtered by the kernel, nor are conditions
+	 * without bytecode such as dev
+	 */
+	if (count_nkeys)
+		return count_sock(h, diag_arg->protocol);
+
+	if (top_count)
+		return top_offer(h, diag_arg->protocol);
+
+	if (sample_interval)
+		return sample_sock(h, &s, diag_arg->protocol);
+
+	if (diag_arg->f->kill)
+		return kill_inet_sock(h, arg, &s);
 
 	err = inet_show_sock(h, &s);
 	if (err < 0)
@@ -3715,12 +5194,253 @@ static int show_one_inet_sock(struct nlmsghdr *h, void *arg)
 	return 0;
 }
 
+/* Concurrent dumps: when several socket tables are listed, each netlink
+ * dump runs ahead in its own thread on its own socket and only queues the
+ * raw messages.  The tables are still shown one after the other from the
+ * main thread, which replays each queue through the usual callbacks, so the
+ * output is the same as with sequential dumps.
+ */
+#define DUMP_CHUNK_SIZE		(256 * 1024)
+#define DUMP_QUEUE_MAX		(64 * 1024 * 1024)	/* per table */
+
+struct dump_chunk {
+	struct dump_chunk	*next;
+	size_t			len;
+	size_t			size;
+	char			data[];
+};
+
+struct dump_job {
+	struct dump_job		*next;
+	rtnl_filter_t		show;		/* callback the dump is for */
+	int			protocol;	/* inet dumps only */
+	int			(*dump)(struct filter *f);
+	struct filter		*f;
+	pthread_t		thread;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	struct dump_chunk	*head, *tail;	/* ready for replay */
+	struct dump_chunk	*fill;		/* owned by the thread */
+	size_t			queued;
+	bool			done;
+	bool			abort;
+	int			err;
+};
+
+static struct dump_job *dump_jobs;
+static __thread struct dump_job *dump_job_self;
+
+static int dump_job_publish(struct dump_job *job)
+{
+	struct dump_chunk *c = job->fill;
+	bool abort;
+
+	job->fill = NULL;
+	pthread_mutex_lock(&job->lock);
+	if (c) {
+		if (job->tail)
+			job->tail->next = c;
+		else
+			job->head = c;
+		job->tail = c;
+		job->queued += c->size;
+		pthread_cond_broadcast(&job->cond);
+	}
+	while (job->queued > DUMP_QUEUE_MAX && !job->abort)
+		pthread_cond_wait(&job->cond, &job->lock);
+	abort = job->abort;
+	pthread_mutex_unlock(&job->lock);
+
+	return abort ? -1 : 0;
+}
+
+static int dump_job_capture(struct nlmsghdr *h, void *arg)
+{
+	struct dump_job *job = arg;
+	struct dump_chunk *c = job->fill;
+	size_t len = NLMSG_ALIGN(h->nlmsg_len);
+
+	if (c && c->len + len > c->size) {
+		if (dump_job_publish(job))
+			return -1;
+		c = NULL;
+	}
+
+	if (!c) {
+		size_t size = len > DUMP_CHUNK_SIZE ? len : DUMP_CHUNK_SIZE;
+
+		c = malloc(sizeof(*c) + size);
+		if (!c)
+			return -1;
+		c->next = NULL;
+		c->len = 0;
+		c->size = size;
+		job->fill = c;
+	}
+
+	memcpy(c->data + c->len, h, h->nlmsg_len);
+	c->len += len;
+	return 0;
+}
+
+static void *dump_job_run(void *arg)
+{
+	struct dump_job *job = arg;
+	int err;
+
+	dump_job_self = job;
+	if (job->dump)
+		err = job->dump(job->f);
+	else
+		err = inet_show_netlink(job->f, NULL, job->protocol);
+	dump_job_publish(job);
+
+	pthread_mutex_lock(&job->lock);
+	job->err = err;
+	job->done = true;
+	pthread_cond_broadcast(&job->cond);
+	pthread_mutex_unlock(&job->lock);
+
+	return NULL;
+}
+
+static void dump_job_add(struct filter *f, rtnl_filter_t show, int protocol,
+			 int (*dump)(struct filter *f))
+{
+	struct dump_job *job, **pp;
+
+	job = calloc(1, sizeof(*job));
+	if (!job)
+		return;
+
+	job->show = show;
+	job->protocol = protocol;
+	job->dump = dump;
+	job->f = f;
+	pthread_mutex_init(&job->lock, NULL);
+	pthread_cond_init(&job->cond, NULL);
+
+	if (pthread_create(&job->thread, NULL, dump_job_run, job)) {
+		free(job);
+		return;
+	}
+
+	for (pp = &dump_jobs; *pp; pp = &(*pp)->next)
+		;
+	*pp = job;
+}
+
+/* Stop a job if it is still running and release it */
+static void dump_job_free(struct dump_job *job)
+{
+	struct dump_chunk *c, *next;
+
+	pthread_mutex_lock(&job->lock);
+	job->abort = true;
+	pthread_cond_broadcast(&job->cond);
+	pthread_mutex_unlock(&job->lock);
+	pthread_join(job->thread, NULL);
+
+	for (c = job->head; c; c = next) {
+		next = c->next;
+		free(c);
+	}
+	free(job->fill);
+	pthread_mutex_destroy(&job->lock);
+	pthread_cond_destroy(&job->cond);
+	free(job);
+}
+
+/* Find the queued dump for a table, if any; dump threads never take one */
+static struct dump_job *dump_job_take(rtnl_filter_t show, int protocol)
+{
+	struct dump_job **pp, *job;
+
+	if (dump_job_self)
+		return NULL;
+
+	for (pp = &dump_jobs; (job = *pp); pp = &job->next) {
+		if (job->show == show && job->protocol == protocol) {
+			*pp = job->next;
+			return job;
+		}
+	}
+	return NULL;
+}
+
+/* Feed a queued dump to @show as rtnl_dump_filter() would, then release it */
+static int dump_job_replay(struct dump_job *job, rtnl_filter_t show, void *arg)
+{
+	struct dump_chunk *c;
+	int err = 0;
+
+	while (1) {
+		char *p;
+
+		pthread_mutex_lock(&job->lock);
+		while (!job->head && !job->done)
+			pthread_cond_wait(&job->cond, &job->lock);
+		c = job->head;
+		if (c) {
+			job->head = c->next;
+			if (!job->head)
+				job->tail = NULL;
+			job->queued -= c->size;
+			pthread_cond_broadcast(&job->cond);
+		} else {
+			err = job->err;
+		}
+		pthread_mutex_unlock(&job->lock);
+
+		if (!c)
+			break;
+
+		for (p = c->data; p < c->data + c->len;) {
+			struct nlmsghdr *h = (struct nlmsghdr *)p;
+
+			p += NLMSG_ALIGN(h->nlmsg_len);
+			err = show(h, arg);
+			if (err < 0)
+				break;
+		}
+		free(c);
+		if (err < 0)
+			break;
+	}
+
+	dump_job_free(job);
+	return err;
+}
+
+static void dump_jobs_destroy(void)
+{
+	while (dump_jobs) {
+		struct dump_job *job = dump_jobs;
+
+		dump_jobs = job->next;
+		dump_job_free(job);
+	}
+}
+
+/* In a dump thread, queue the messages instead of showing them */
+static int ss_dump_filter(struct rtnl_handle *rth, rtnl_filter_t show,
+			  void *arg)
+{
+	if (dump_job_self)
+		return rtnl_dump_filter(rth, dump_job_capture, dump_job_self);
+	return rtnl_dump_filter(rth, show, arg);
+}
+
 static int inet_show_netlink(struct filter *f, FILE *dump_fp, int protocol)
 {
 	int err = 0;
 	struct rtnl_handle rth, rth2;
 	int family = PF_INET;
 	struct inet_diag_arg arg = { .f = f, .protocol = protocol };
+	struct dump_job *job = dump_job_take(show_one_inet_sock, protocol);
+
+	if (job)
+		return dump_job_replay(job, show_one_inet_sock, &arg);
 
 	if (rtnl_open_byproto(&rth, 0, NETLINK_SOCK_DIAG))
 		return -1;
@@ -3750,7 +5470,7 @@ again:
 	if ((err = sockdiag_send(family, rth.fd, protocol, f)))
 		goto Exit;
 
-	if ((err = rtnl_dump_filter(&rth, show_one_inet_sock, &arg))) {
+	if ((err = ss_dump_filter(&rth, show_one_inet_sock, &arg))) {
 		if (family != PF_UNSPEC) {
 			family = PF_UNSPEC;
 			goto again;
@@ -3763,6 +5483,8 @@ again:
 	}
 
 Exit:
+	if (arg.rth && kill_flush(arg.rth))
+		err = -1;
 	rtnl_close(&rth);
 	if (arg.rth)
 		rtnl_close(arg.rth);
@@ -3830,7 +5552,12 @@ static int tcp_show_netlink_file(struct filter *f)
 		if (f && f->f && run_ssfilter(f->f, &s) == 0)
 			continue;
 
-		err2 = inet_show_sock(h, &s);
+		if (top_count)
+			err2 = top_offer(h, IPPROTO_TCP);
+		else if (count_nkeys)
+			err2 = count_sock(h, IPPROTO_TCP);
+		else
+			err2 = inet_show_sock(h, &s);
 		if (err2 < 0) {
 			err = err2;
 			break;
@@ -4109,7 +5836,7 @@ static int unix_show_sock(struct nlmsghdr *nlh, void *arg)
 	stat.ino   = stat.lport = r->udiag_ino;
 	stat.local.family = stat.remote.family = AF_UNIX;
 
-	if (unix_type_skip(&stat, f))
+	if (unix_type_skip(&stat, f) || !(f->states & (1 << stat.state)))
 		return 0;
 
 	if (tb[UNIX_DIAG_RQLEN]) {
@@ -4170,21 +5897,97 @@ static int unix_show_sock(struct nlmsghdr *nlh, void *arg)
 	return 0;
 }
 
+/*
+ * Find the value every socket matching @f must have, as reported by
+ * @leaf for the single conditions, or -1 when @f does not pin one down.
+ * Used to narrow the unix, packet and netlink diag requests so the kernel
+ * only reports sockets that can pass the filter.
+ */
+static int ssfilter_pinned(struct ssfilter *f, int (*leaf)(struct ssfilter *))
+{
+	int l, r;
+
+	if (!f)
+		return -1;
+
+	switch (f->type) {
+	case SSF_AND:
+		l = ssfilter_pinned(f->pred, leaf);
+		r = ssfilter_pinned(f->post, leaf);
+		return l != -1 ? l : r;
+	case SSF_OR:
+		l = ssfilter_pinned(f->pred, leaf);
+		r = ssfilter_pinned(f->post, leaf);
+		return l == r ? l : -1;
+	case SSF_SCOND:
+		return leaf(f);
+	}
+	return -1;
+}
+
+/* "sport = :N", the inode for unix sockets */
+static int ssfilter_leaf_sport(struct ssfilter *f)
+{
+	struct aafilter *a = (void *)f->pred;
+
+	if (a->addr.family == AF_UNIX || a->port < 0)
+		return -1;
+	return a->port;
+}
+
+/* "src netlink:PROTO" */
+static int ssfilter_leaf_nlproto(struct ssfilter *f)
+{
+	struct aafilter *a = (void *)f->pred;
+
+	if (a->addr.family != AF_NETLINK || a->addr.bitlen != 32 ||
+	    a->addr.data[0] >= MAX_LINKS)
+		return -1;
+	return a->addr.data[0];
+}
+
+/* Non-dump request for a single socket, answered with one message. */
+static int netlink_lookup_one(struct rtnl_handle *rth, struct nlmsghdr *req,
+			      rtnl_filter_t show_one_sock, struct filter *f)
+{
+	struct nlmsghdr *answer;
+	int err;
+
+	if (rtnl_talk_suppress_rtnl_errmsg(rth, req, &answer) < 0)
+		return errno == ENOENT ? 0 : -1;
+
+	if (dump_job_self)
+		err = dump_job_capture(answer, dump_job_self);
+	else
+		err = show_one_sock(answer, f);
+	free(answer);
+	return err < 0 ? -1 : 0;
+}
+
 static int handle_netlink_request(struct filter *f, struct nlmsghdr *req,
 		size_t size, rtnl_filter_t show_one_sock)
 {
 	int ret = -1;
 	struct rtnl_handle rth;
+	struct dump_job *job = dump_job_take(show_one_sock, 0);
+
+	if (job)
+		return dump_job_replay(job, show_one_sock, f) ? -1 : 0;
 
 	if (rtnl_open_byproto(&rth, 0, NETLINK_SOCK_DIAG))
 		return -1;
 
 	rth.dump = MAGIC_SEQ;
 
+	if (!(req->nlmsg_flags & NLM_F_DUMP)) {
+		ret = netlink_lookup_one(&rth, req, show_one_sock, f);
+		goto Exit;
+	}
+
 	if (rtnl_send(&rth, req, size) < 0)
 		goto Exit;
 
-	if (rtnl_dump_filter(&rth, show_one_sock, f))
+	if (ss_dump_filter(&rth, show_one_sock, f))
 		goto Exit;
 
 	ret = 0;
@@ -4196,6 +5999,7 @@ Exit:
 static int unix_show_netlink(struct filter *f)
 {
 	DIAG_REQUEST(req, struct unix_diag_req r);
+	int ino = ssfilter_pinned(f->f, ssfilter_leaf_sport);
 
 	req.r.sdiag_family = AF_UNIX;
 	req.r.udiag_states = f->states;
@@ -4205,6 +6009,14 @@ static int unix_show_netlink(struct filter *f)
 	if (show_details)
 		req.r.udiag_show |= UDIAG_SHOW_VFS | UDIAG_SHOW_ICONS;
 
+	/* A filter on one inode is answered by lookup instead of a dump */
+	if (ino > 0) {
+		req.nlh.nlmsg_flags = NLM_F_REQUEST;
+		req.r.udiag_ino = ino;
+		req.r.udiag_cookie[0] = INET_DIAG_NOCOOKIE;
+		req.r.udiag_cookie[1] = INET_DIAG_NOCOOKIE;
+	}
+
 	return handle_netlink_request(f, &req.nlh, sizeof(req), unix_show_sock);
 }
 
@@ -4534,8 +6346,11 @@ static int packet_show_netlink(struct filter *f)
 	DIAG_REQUEST(req, struct packet_diag_req r);
 
 	req.r.sdiag_family = AF_PACKET;
-	req.r.pdiag_show = PACKET_SHOW_INFO | PACKET_SHOW_MEMINFO |
-		PACKET_SHOW_FILTER | PACKET_SHOW_RING_CFG | PACKET_SHOW_FANOUT;
+	req.r.pdiag_show = PACKET_SHOW_INFO | PACKET_SHOW_MEMINFO;
+	if (show_bpf)
+		req.r.pdiag_show |= PACKET_SHOW_FILTER;
+	if (show_details)
+		req.r.pdiag_show |= PACKET_SHOW_RING_CFG | PACKET_SHOW_FANOUT;
 
 	return handle_netlink_request(f, &req.nlh, sizeof(req), packet_show_sock);
 }
@@ -4890,10 +6705,13 @@ static int netlink_show_sock(struct nlmsghdr *nlh, void *arg)
 static int netlink_show_netlink(struct filter *f)
 {
 	DIAG_REQUEST(req, struct netlink_diag_req r);
+	int proto = ssfilter_pinned(f->f, ssfilter_leaf_nlproto);
 
 	req.r.sdiag_family = AF_NETLINK;
-	req.r.sdiag_protocol = NDIAG_PROTO_ALL;
-	req.r.ndiag_show = NDIAG_SHOW_GROUPS | NDIAG_SHOW_MEMINFO;
+	req.r.sdiag_protocol = proto >= 0 ? proto : NDIAG_PROTO_ALL;
+	req.r.ndiag_show = NDIAG_SHOW_MEMINFO;
+	if (show_details)
+		req.r.ndiag_show |= NDIAG_SHOW_GROUPS;
 
 	return handle_netlink_request(f, &req.nlh, sizeof(req), netlink_show_sock);
 }
@@ -5128,6 +6946,8 @@ static int generic_show_sock(struct nlmsghdr *nlh, void *arg)
 	case AF_INET6:
 		inet_arg.rth = inet_arg.f->rth_for_killing;
 		ret = show_one_inet_sock(nlh, &inet_arg);
+		if (inet_arg.rth && kill_flush(inet_arg.rth))
+			ret = -1;
 		break;
 	case AF_UNIX:
 		ret = unix_show_sock(nlh, arg);
@@ -5153,6 +6973,160 @@ static int generic_show_sock(struct nlmsghdr *nlh, void *arg)
 	return ret;
 }
 
+/* The netlink dumps of main(), in the order it shows the tables.  The
+ * netlink table comes first and is not in the list: dumping it while the
+ * other dumps are running would show their sockets too.
+ */
+static const struct dump_job_desc {
+	int		dbs;
+	int		family;		/* AF_INET for both inet families */
+	bool		close_only;	/* table only has SS_CLOSE sockets */
+	const char	*env;		/* set to read the table from /proc */
+	rtnl_filter_t	show;
+	int		protocol;
+	int		(*dump)(struct filter *f);
+} dump_job_descs[] = {
+	{ PACKET_DBM, AF_PACKET, true, "PROC_NET_PACKET",
+	  packet_show_sock, 0, packet_show_netlink },
+	{ UNIX_DBM, AF_UNIX, false, "PROC_NET_UNIX",
+	  unix_show_sock, 0, unix_show_netlink },
+	{ 1<<RAW_DB, AF_INET, false, "PROC_NET_RAW",
+	  show_one_inet_sock, IPPROTO_RAW },
+	{ 1<<UDP_DB, AF_INET, false, "PROC_NET_UDP",
+	  show_one_inet_sock, IPPROTO_UDP },
+	{ 1<<TCP_DB, AF_INET, false, "PROC_NET_TCP",
+	  show_one_inet_sock, IPPROTO_TCP },
+	{ 1<<DCCP_DB, AF_INET, false, "PROC_NET_DCCP",
+	  show_one_inet_sock, IPPROTO_DCCP },
+	{ 1<<SCTP_DB, AF_INET, false, "PROC_NET_SCTP",
+	  show_one_inet_sock, IPPROTO_SCTP },
+	{ VSOCK_DBM, AF_VSOCK, false, NULL,
+	  vsock_show_sock, 0, vsock_show },
+	{ 1<<TIPC_DB, AF_UNSPEC, false, NULL,
+	  tipc_show_sock, 0, tipc_show },
+	{ 1<<XDP_DB, AF_XDP, true, NULL,
+	  xdp_show_sock, 0, xdp_show },
+	{ 1<<MPTCP_DB, AF_INET, false, "PROC_NET_MPTCP",
+	  show_one_inet_sock, IPPROTO_MPTCP },
+};
+
+static bool dump_job_wanted(const struct dump_job_desc *d, struct filter *f)
+{
+	if (!(f->dbs & d->dbs))
+		return false;
+	if (d->family == AF_INET) {
+		if (!filter_af_get(f, AF_INET) && !filter_af_get(f, AF_INET6))
+			return false;
+	} else if (d->family != AF_UNSPEC && !filter_af_get(f, d->family)) {
+		return false;
+	}
+	if (d->close_only && !(f->states & (1 << SS_CLOSE)))
+		return false;
+	if (d->env && getenv(d->env))
+		return false;
+	if (d->protocol == IPPROTO_TCP && getenv("TCPDIAG_FILE"))
+		return false;
+	return true;
+}
+
+/* Start the dumps of all listed tables at once, if there are several.
+ * Not with --stream: the queued tables would defeat its bounded memory.
+ */
+static void dump_jobs_start(struct filter *f)
+{
+	int i, n = 0;
+
+	if (stream_rows || getenv("PROC_ROOT"))
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(dump_job_descs); i++)
+		n += dump_job_wanted(&dump_job_descs[i], f);
+	if (n < 2)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(dump_job_descs); i++) {
+		const struct dump_job_desc *d = &dump_job_descs[i];
+
+		if (dump_job_wanted(d, f))
+			dump_job_add(f, d->show, d->protocol, d->dump);
+	}
+}
+
+/* -E --count-by: the events of each window are only counted, and the
+ * groups printed when the window ends.  An overrun of the event socket
+ * loses an unknown number of events, so overruns are reported with the
+ * window they happened in.
+ */
+static void follow_count_show(unsigned long long events,
+			      unsigned int overruns)
+{
+	char stamp[32];
+	time_t now = time(NULL);
+
+	strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S",
+		 localtime(&now));
+	printf("%s: %llu events", stamp, events);
+	if (overruns)
+		printf(", %u overruns", overruns);
+	printf("\n");
+
+	count_show();
+	printf("\n");
+	fflush(stdout);
+}
+
+static int follow_count(struct rtnl_handle *rth, struct filter *f)
+{
+	unsigned int window = sample_interval ? : 1;
+	unsigned long long events = 0;
+	unsigned int overruns = 0;
+	struct timespec now, next;
+	char buf[65536];
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	next.tv_sec += window;
+
+	while (1) {
+		struct pollfd pfd = { .fd = rth->fd, .events = POLLIN };
+		struct nlmsghdr *h;
+		int timeout, len;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timeout = (next.tv_sec - now.tv_sec) * 1000 +
+			  (next.tv_nsec - now.tv_nsec) / 1000000;
+		if (timeout <= 0) {
+			follow_count_show(events, overruns);
+			events = overruns = 0;
+			next.tv_sec += window;
+			continue;
+		}
+
+		if (poll(&pfd, 1, timeout) <= 0)
+			continue;
+
+		len = recv(rth->fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno == ENOBUFS)
+				overruns++;
+			else if (errno != EINTR && errno != EAGAIN) {
+				perror("ss: events");
+				return -1;
+			}
+			continue;
+		}
+
+		for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, len);
+		     h = NLMSG_NEXT(h, len)) {
+			if (h->nlmsg_type == NLMSG_DONE ||
+			    h->nlmsg_type == NLMSG_ERROR)
+				continue;
+			events++;
+			if (generic_show_sock(h, f) < 0)
+				return -1;
+		}
+	}
+}
+
 static int handle_follow_request(struct filter *f)
 {
 	int ret = 0;
@@ -5185,7 +7159,9 @@ static int handle_follow_request(struct filter *f)
 		f->rth_for_killing = &rth2;
 	}
 
-	if (rtnl_dump_filter(&rth, generic_show_sock, f))
+	if (count_nkeys)
+		ret = follow_count(&rth, f);
+	else if (rtnl_dump_filter(&rth, generic_show_sock, f))
 		ret = -1;
 
 	rtnl_close(&rth);
@@ -5389,9 +7365,20 @@ static void _usage(FILE *dest)
 "       FAMILY := {inet|inet6|link|unix|netlink|vsock|tipc|xdp|help}\n"
 "\n"
 "   -K, --kill          forcibly close sockets, display what was closed\n"
+"       --kill-window=N send up to N close requests at once (default 1)\n"
+"       --kill-rate=N   close at most N sockets per second\n"
 "   -H, --no-header     Suppress header line\n"
 "   -O, --oneline       socket's data printed on a single line\n"
 "       --inet-sockopt  show various inet socket options\n"
+"       --stream[=ROWS] print rows as they come, with column widths taken\n"
+"                       from the first ROWS rows (default 100)\n"
+"       --top=N --by=METRIC\n"
+"                       show only the N inet sockets with the largest METRIC\n"
+"       METRIC := {recvq|sendq|rtt|snd_cwnd|retrans|notsent|bytes_acked|...}\n"
+"       --interval=SECS show per-interval TCP deltas and rates every SECS\n"
+"       --count-by=KEYS only count inet sockets, per distinct KEYS value\n"
+"       KEYS := {netid|state|family|src[/LEN]|sport|dst[/LEN]|dport|uid|dev|mark|cgroup}[,KEYS]\n"
+"                       with -E, count destroy events per --interval window\n"
 "\n"
 "   -A, --query=QUERY, --socket=QUERY\n"
 "       QUERY := {all|inet|tcp|mptcp|udp|raw|unix|unix_dgram|unix_stream|unix_seqpacket|packet|packet_raw|packet_dgram|netlink|dccp|sctp|vsock_stream|vsock_dgram|tipc|xdp}[,QUERY]\n"
@@ -5483,6 +7470,18 @@ static int scan_state(const char *state)
 
 #define OPT_INET_SOCKOPT 262
 
+#define OPT_STREAM 263
+
+#define OPT_TOP 264
+#define OPT_TOP_BY 265
+
+#define OPT_INTERVAL 266
+
+#define OPT_COUNT_BY 267
+
+#define OPT_KILL_WINDOW 268
+#define OPT_KILL_RATE 269
+
 static const struct option long_opts[] = {
 	{ "numeric", 0, 0, 'n' },
 	{ "resolve", 0, 0, 'r' },
@@ -5527,6 +7526,13 @@ static const struct option long_opts[] = {
 	{ "mptcp", 0, 0, 'M' },
 	{ "oneline", 0, 0, 'O' },
 	{ "inet-sockopt", 0, 0, OPT_INET_SOCKOPT },
+	{ "stream", 2, 0, OPT_STREAM },
+	{ "top", 1, 0, OPT_TOP },
+	{ "by", 1, 0, OPT_TOP_BY },
+	{ "interval", 1, 0, OPT_INTERVAL },
+	{ "count-by", 1, 0, OPT_COUNT_BY },
+	{ "kill-window", 1, 0, OPT_KILL_WINDOW },
+	{ "kill-rate", 1, 0, OPT_KILL_RATE },
 	{ 0 }
 
 };
@@ -5729,6 +7735,65 @@ int main(int argc, char *argv[])
 		case OPT_INET_SOCKOPT:
 			show_inet_sockopt = 1;
 			break;
+		case OPT_STREAM:
+			stream_rows = 100;
+			if (optarg && (get_integer(&stream_rows, optarg, 0) ||
+				       stream_rows <= 0)) {
+				fprintf(stderr, "ss: invalid stream row count \"%s\"\n",
+					optarg);
+				exit(1);
+			}
+			break;
+		case OPT_TOP:
+			if (get_integer(&top_count, optarg, 0) ||
+			    top_count <= 0) {
+				fprintf(stderr, "ss: invalid top count \"%s\"\n",
+					optarg);
+				exit(1);
+			}
+			break;
+		case OPT_TOP_BY:
+			top_by = top_metric_lookup(optarg);
+			if (!top_by) {
+				fprintf(stderr, "ss: unknown metric \"%s\"\n",
+					optarg);
+				top_metric_list(stderr);
+				exit(1);
+			}
+			break;
+		case OPT_COUNT_BY:
+			if (count_keys_parse(optarg)) {
+				fprintf(stderr, "ss: invalid count keys \"%s\"\n",
+					optarg);
+				fprintf(stderr, "KEYS := {netid|state|family|src[/LEN]|sport|dst[/LEN]|dport|uid|dev|mark|cgroup}[,KEYS]\n");
+				exit(1);
+			}
+			break;
+		case OPT_KILL_WINDOW:
+			if (get_unsigned(&kill_window, optarg, 0) ||
+			    !kill_window || kill_window > KILL_WINDOW_MAX) {
+				fprintf(stderr, "ss: invalid kill window \"%s\", 1..%d\n",
+					optarg, KILL_WINDOW_MAX);
+				exit(1);
+			}
+			kill_report = true;
+			break;
+		case OPT_KILL_RATE:
+			if (get_unsigned(&kill_rate, optarg, 0) || !kill_rate) {
+				fprintf(stderr, "ss: invalid kill rate \"%s\"\n",
+					optarg);
+				exit(1);
+			}
+			kill_report = true;
+			break;
+		case OPT_INTERVAL:
+			if (get_unsigned(&sample_interval, optarg, 0) ||
+			    !sample_interval) {
+				fprintf(stderr, "ss: invalid interval \"%s\"\n",
+					optarg);
+				exit(1);
+			}
+			break;
 		case 'h':
 			help();
 		case '?':
@@ -5737,13 +7802,45 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (show_processes || show_threads || show_proc_ctx || show_sock_ctx)
-		user_ent_hash_build();
+	if (!top_count != !top_by) {
+		fprintf(stderr, "ss: --top and --by must be used together\n");
+		exit(1);
+	}
+	if (kill_report && !current_filter.kill) {
+		fprintf(stderr, "ss: --kill-window and --kill-rate need -K\n");
+		exit(1);
+	}
+	if (top_count && (follow_events || current_filter.kill ||
+			  stream_rows)) {
+		fprintf(stderr, "ss: --top cannot be combined with -E, -K or --stream\n");
+		exit(1);
+	}
+	if (sample_interval && !(follow_events && count_nkeys) &&
+	    (follow_events || current_filter.kill ||
+	     stream_rows || top_count || dump_tcpdiag)) {
+		fprintf(stderr, "ss: --interval cannot be combined with -K, -D, --stream, --top, or -E without --count-by\n");
+		exit(1);
+	}
+	if (count_nkeys && (current_filter.kill || stream_rows || top_count ||
+			    (sample_interval && !follow_events) ||
+			    dump_tcpdiag)) {
+		fprintf(stderr, "ss: --count-by cannot be combined with -K, -D, --stream, --top, or --interval without -E\n");
+		exit(1);
+	}
+	count_totals = follow_events && count_nkeys;
+
+	/* sockets of follow events are gone by the time they are rendered,
+	 * and streamed rows are rendered one by one
+	 */
+	if ((show_processes || show_threads || show_proc_ctx || show_sock_ctx) &&
+	    (follow_events || stream_rows))
+		user_ent_resolve(true);
 
 	argc -= optind;
 	argv += optind;
 
 	if (do_summary) {
+		kill_report = true;
 		print_summary();
 		if (do_default && argc == 0)
 			exit(0);
@@ -5777,6 +7874,15 @@ int main(int argc, char *argv[])
 	filter_states_set(&current_filter, state_filter);
 	filter_merge_defaults(&current_filter);
 
+	/* only inet sockets can be ranked, and tcp_info metrics need TCP */
+	if (top_count)
+		current_filter.dbs &= top_needs_tcpinfo() ? (1<<TCP_DB) :
+							    INET_DBM;
+	if (sample_interval && !follow_events)
+		current_filter.dbs &= 1<<TCP_DB;
+	if (count_nkeys)
+		current_filter.dbs &= INET_DBM;
+
 #ifdef HAVE_RPC
 	if (!numeric && resolve_hosts &&
 	    (current_filter.dbs & (UNIX_DBM|INET_L4_DBM)))
@@ -5818,13 +7924,24 @@ int main(int argc, char *argv[])
 	if (ssfilter_parse(&current_filter.f, argc, argv, filter_fp))
 		usage();
 
+	if (count_nkeys && !follow_events) {
+		char *bc = NULL;
+
+		count_kernel_filtered = !current_filter.f ||
+			ssfilter_bytecompile(current_filter.f, &bc);
+		free(bc);
+	}
+
 	if (!(current_filter.dbs & (current_filter.dbs - 1)))
 		columns[COL_NETID].disabled = 1;
 
 	if (!(current_filter.states & (current_filter.states - 1)))
 		columns[COL_STATE].disabled = 1;
 
-	if (show_header)
+	if (sample_interval && !follow_events)
+		exit(sample_loop(&current_filter));
+
+	if (show_header && !count_nkeys)
 		print_header();
 
 	fflush(stdout);
@@ -5834,6 +7951,9 @@ int main(int argc, char *argv[])
 
 	if (current_filter.dbs & (1<<NETLINK_DB))
 		netlink_show(&current_filter);
+
+	if (!current_filter.kill)
+		dump_jobs_start(&current_filter);
 	if (current_filter.dbs & PACKET_DBM)
 		packet_show(&current_filter);
 	if (current_filter.dbs & UNIX_DBM)
@@ -5857,10 +7977,20 @@ int main(int argc, char *argv[])
 	if (current_filter.dbs & (1<<MPTCP_DB))
 		mptcp_show(&current_filter);
 
-	if (show_processes || show_threads || show_proc_ctx || show_sock_ctx)
-		user_ent_destroy();
+	dump_jobs_destroy();
+
+	if (top_count)
+		top_show();
+	if (count_nkeys)
+		count_show();
 
 	render();
 
+	if (current_filter.kill)
+		kill_progress(true);
+
+	if (show_processes || show_threads || show_proc_ctx || show_sock_ctx)
+		user_ent_destroy();
+
 	return 0;
 }
@@ -0,0 +1,326 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Trace driven distribution table generator.
+ *
+ * Reads delay or RTT samples (numbers separated by white space, lines
+ * starting with '#' are skipped) and writes the netem inverse
+ * distribution table for them, as text or in the binary .distb format.
+ *
+ * Unlike maketable, the samples are never stored: they go into a
+ * log-linear histogram whose buckets are 1/SUB_BUCKETS of an octave wide,
+ * while mean and deviation are kept with Welford's method.  Memory stays
+ * bounded no matter how long the trace is, and quantiles come out with
+ * about 0.1% relative error, well below the resolution of the table.
+ *
+ * With -c the input is a text distribution table, which is converted to
+ * the binary format as is.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <unistd.h>
+#include <endian.h>
+
+#include <linux/types.h>
+#include <linux/pkt_sched.h>
+
+#include "netem_dist.h"
+
+#define TABLESIZE	4096
+#define MAX_TABLESIZE	16384
+#define TABLEFACTOR	NETEM_DIST_SCALE
+
+#define SUB_BITS	10
+#define SUB_BUCKETS	(1 << SUB_BITS)
+#define EXP_MIN		-32	/* magnitudes below 2^-33 count as zero */
+#define EXP_MAX		64
+#define NBUCKETS	((EXP_MAX - EXP_MIN + 1) * SUB_BUCKETS)
+
+struct trace_hist {
+	__u64	neg[NBUCKETS];
+	__u64	pos[NBUCKETS];
+	__u64	zero;
+	__u64	count;
+	double	mean;
+	double	m2;
+};
+
+static void hist_add(struct trace_hist *h, double x)
+{
+	double delta, m;
+	int e, idx;
+
+	h->count++;
+	delta = x - h->mean;
+	h->mean += delta / h->count;
+	h->m2 += delta * (x - h->mean);
+
+	m = frexp(fabs(x), &e);
+	if (x == 0 || e < EXP_MIN) {
+		h->zero++;
+		return;
+	}
+	if (e > EXP_MAX) {
+		e = EXP_MAX;
+		m = 1.0 - 1e-9;
+	}
+
+	/* m is in [0.5, 1) */
+	idx = (e - EXP_MIN) * SUB_BUCKETS +
+		(int)((m - 0.5) * 2 * SUB_BUCKETS);
+	if (x < 0)
+		h->neg[idx]++;
+	else
+		h->pos[idx]++;
+}
+
+static void bucket_bounds(int idx, double *lo, double *hi)
+{
+	int e = idx / SUB_BUCKETS + EXP_MIN;
+	int sub = idx % SUB_BUCKETS;
+
+	*lo = ldexp(0.5 + (double)sub / (2 * SUB_BUCKETS), e);
+	*hi = ldexp(0.5 + (double)(sub + 1) / (2 * SUB_BUCKETS), e);
+}
+
+/*
+ * Walk the buckets in value order, from the most negative one up, and
+ * return the lower bound and count of bucket @i of that order.
+ */
+static __u64 hist_bucket(const struct trace_hist *h, int i,
+			 double *lo, double *hi)
+{
+	if (i < NBUCKETS) {
+		int idx = NBUCKETS - 1 - i;
+
+		bucket_bounds(idx, hi, lo);
+		*lo = -*lo;
+		*hi = -*hi;
+		return h->neg[idx];
+	}
+	if (i == NBUCKETS) {
+		*lo = *hi = 0;
+		return h->zero;
+	}
+	bucket_bounds(i - NBUCKETS - 1, lo, hi);
+	return h->pos[i - NBUCKETS - 1];
+}
+
+static int make_table(const struct trace_hist *h, short *table, int size)
+{
+	double sigma, lo = 0, hi = 0;
+	__u64 seen = 0, cnt = 0;
+	int i, b = -1;
+
+	if (h->count < 2)
+		return -1;
+	sigma = sqrt(h->m2 / (h->count - 1));
+	if (sigma == 0)
+		return -1;
+
+	for (i = 0; i < size; i++) {
+		double rank = (i + 0.5) * h->count / size;
+		double q;
+		long v;
+
+		while (b < 2 * NBUCKETS && seen + cnt <= rank) {
+			seen += cnt;
+			cnt = hist_bucket(h, ++b, &lo, &hi);
+		}
+
+		q = lo + (hi - lo) * (rank - seen) / (cnt ? cnt : 1);
+		v = lrint((q - h->mean) / sigma * TABLEFACTOR);
+		if (v < SHRT_MIN)
+			v = SHRT_MIN;
+		if (v > SHRT_MAX)
+			v = SHRT_MAX;
+		table[i] = v;
+	}
+
+	return 0;
+}
+
+static int read_table(FILE *fp, short *table, int size)
+{
+	char *line = NULL;
+	size_t len = 0;
+	int n = 0;
+
+	while (getline(&line, &len, fp) != -1) {
+		char *p, *endp;
+
+		if (*line == '\n' || *line == '#')
+			continue;
+
+		for (p = line; ; p = endp) {
+			long x = strtol(p, &endp, 0);
+
+			if (endp == p)
+				break;
+			if (n >= size || x < SHRT_MIN || x > SHRT_MAX) {
+				free(line);
+				return -1;
+			}
+			table[n++] = x;
+		}
+	}
+
+	free(line);
+	return n;
+}
+
+static void read_trace(FILE *fp, struct trace_hist *h)
+{
+	char *line = NULL;
+	size_t len = 0;
+
+	while (getline(&line, &len, fp) != -1) {
+		char *p, *endp;
+
+		if (*line == '#')
+			continue;
+
+		for (p = line; ; p = endp) {
+			double x = strtod(p, &endp);
+
+			if (endp == p)
+				break;
+			if (isfinite(x))
+				hist_add(h, x);
+		}
+	}
+
+	free(line);
+}
+
+static void print_table(const short *table, int size)
+{
+	int i;
+
+	printf("# This is the distribution table for a trace driven distribution.\n");
+
+	for (i = 0; i < size; ++i) {
+		printf("%d%c", table[i],
+		       (i % 8) == 7 ? '\n' : ' ');
+	}
+	if (size % 8)
+		putchar('\n');
+}
+
+static int write_table(const short *table, int size)
+{
+	struct netem_dist_hdr hdr = {
+		.magic	 = htole32(NETEM_DIST_MAGIC),
+		.version = htole16(NETEM_DIST_VERSION),
+		.hdr_len = htole16(sizeof(hdr)),
+		.count	 = htole32(size),
+	};
+	int i;
+
+	if (fwrite(&hdr, sizeof(hdr), 1, stdout) != 1)
+		return -1;
+
+	for (i = 0; i < size; i++) {
+		__u16 v = htole16((__u16)table[i]);
+
+		if (fwrite(&v, sizeof(v), 1, stdout) != 1)
+			return -1;
+	}
+
+	return fflush(stdout);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: tracetable [ -b ] [ -v ] [ -n SIZE ] [ TRACE ]\n"
+		"       tracetable -c [ TABLE ]\n"
+		"  -b       write the binary (.distb) format\n"
+		"  -c       convert a text table to the binary format\n"
+		"  -n SIZE  number of table entries (default %d, max %d)\n"
+		"  -v       report sample statistics on stderr\n",
+		TABLESIZE, MAX_TABLESIZE);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int size = TABLESIZE, binary = 0, convert = 0, verbose = 0;
+	struct trace_hist *h;
+	short *table;
+	FILE *fp = stdin;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "bcn:v")) != -1) {
+		switch (opt) {
+		case 'b':
+			binary = 1;
+			break;
+		case 'c':
+			convert = binary = 1;
+			break;
+		case 'n':
+			size = atoi(optarg);
+			if (size <= 0 || size > MAX_TABLESIZE)
+				usage();
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind < argc) {
+		fp = fopen(argv[optind], "r");
+		if (!fp) {
+			perror(argv[optind]);
+			exit(1);
+		}
+	}
+
+	table = calloc(MAX_TABLESIZE, sizeof(*table));
+	if (!table) {
+		perror("table alloc");
+		exit(3);
+	}
+
+	if (convert) {
+		size = read_table(fp, table, MAX_TABLESIZE);
+		if (size <= 0) {
+			fprintf(stderr, "Not a distribution table\n");
+			exit(2);
+		}
+	} else {
+		h = calloc(1, sizeof(*h));
+		if (!h) {
+			perror("histogram alloc");
+			exit(3);
+		}
+
+		read_trace(fp, h);
+		if (verbose)
+			fprintf(stderr, "%llu values, mu %10.4f, sigma %10.4f\n",
+				(unsigned long long)h->count, h->mean,
+				h->count > 1 ? sqrt(h->m2 / (h->count - 1)) : 0);
+		if (make_table(h, table, size)) {
+			fprintf(stderr, "Nothing much read!\n");
+			exit(2);
+		}
+		free(h);
+	}
+
+	if (binary) {
+		if (write_table(table, size)) {
+			perror("write");
+			exit(1);
+		}
+	} else {
+		print_table(table, size);
+	}
+
+	return 0;
+}
@@ -45,6 +45,7 @@ static void act_usage(void)
 		"	ACR := add | change | replace <ACTSPEC>*\n"
 		"	GD := get | delete | <ACTISPEC>*\n"
 		"	FL := ls | list | flush | <ACTNAMESPEC>\n"
+		"	     (with -s, ls takes [ interval SECS [ count N ] ])\n"
 		"	ACTNAMESPEC :=  action <ACTNAME>\n"
 		"	ACTISPEC := <ACTNAMESPEC> <INDEXSPEC>\n"
 		"	ACTSPEC := action <ACTDETAIL> [INDEXSPEC] [HWSTATSSPEC] [SKIPSPEC]\n"
@@ -774,6 +775,7 @@ static int tc_act_list_or_flush(int *argc_p, char ***argv_p, int event)
 	struct nla_bitfield32 flag_select = { 0 };
 	char **argv = *argv_p;
 	__u32 msec_since = 0;
+	unsigned int interval = 0, count = 0;
 	int argc = *argc_p;
 	char k[FILTER_NAMESZ];
 	struct {
@@ -812,6 +814,25 @@ static int tc_act_list_or_flush(int *argc_p, char ***argv_p, int event)
 		NEXT_ARG();
 		if (get_u32(&msec_since, *argv, 0))
 			invarg("dump time \"since\" is invalid", *argv);
+		argc--;
+		argv++;
+	}
+	if (argc && event == RTM_GETACTION &&
+	    strcmp(*argv, "interval") == 0) {
+		NEXT_ARG();
+		if (get_unsigned(&interval, *argv, 0) || !interval)
+			invarg("invalid interval", *argv);
+		argc--;
+		argv++;
+		if (argc && strcmp(*argv, "count") == 0) {
+			NEXT_ARG();
+			if (get_unsigned(&count, *argv, 0))
+				invarg("invalid count", *argv);
+		}
+		if (!show_stats) {
+			fprintf(stderr, "\"interval\" needs -s\n");
+			return -1;
+		}
 	}
 
 	addattr_l(&req.n, MAX_MSG, ++prio, NULL, 0);
@@ -837,6 +858,10 @@ static int tc_act_list_or_flush(int *argc_p, char ***argv_p, int event)
 	msg_size = NLMSG_ALIGN(req.n.nlmsg_len)
 		- NLMSG_ALIGN(sizeof(struct nlmsghdr));
 
+	if (event == RTM_GETACTION && interval)
+		return tc_sample_stats(event, (void *)&req.t, msg_size, NULL,
+				       interval, count);
+
 	if (event == RTM_GETACTION) {
 		if (rtnl_dump_request(&rth, event,
 				      (void *)&req.t, msg_size) < 0) {
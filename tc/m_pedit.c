@@ -19,6 +19,7 @@
 #include <arpa/inet.h>
 #include <string.h>
 #include <dlfcn.h>
+#include <linux/if_ether.h>
 #include "utils.h"
 #include "tc_util.h"
 #include "m_pedit.h"
@@ -117,38 +118,155 @@ noexist:
 	return p;
 }
 
+/*
+ * Header a key is relative to: the MAC header, the network header (IPv4,
+ * IPv6 and the legacy raw offsets) or the transport header, and the
+ * fewest bytes the lower two span before the next one starts.
+ */
+static int pedit_key_base(enum pedit_header_type htype)
+{
+	switch (htype) {
+	case TCA_PEDIT_KEY_EX_HDR_TYPE_ETH:
+		return 0;
+	case TCA_PEDIT_KEY_EX_HDR_TYPE_TCP:
+	case TCA_PEDIT_KEY_EX_HDR_TYPE_UDP:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+static const int pedit_base_minlen[] = { ETH_HLEN, 20 };
+
+/* Bits of its word a key may change */
+static __u32 pedit_key_changes(const struct tc_pedit_key *k,
+			       enum pedit_cmd cmd)
+{
+	return cmd == TCA_PEDIT_KEY_EX_CMD_SET ? ~k->mask | k->val : ~k->mask;
+}
+
+/* Can the two keys run in either order with the same result? */
+static bool pedit_keys_commute(const struct tc_pedit_key *k1,
+			       enum pedit_header_type h1, enum pedit_cmd c1,
+			       const struct tc_pedit_key *k2,
+			       enum pedit_header_type h2, enum pedit_cmd c2)
+{
+	int b1 = pedit_key_base(h1), b2 = pedit_key_base(h2);
+	__u32 changed;
+	int last;
+
+	if (k1->offmask || k2->offmask)
+		return false;
+
+	if (b1 == b2) {
+		if (k1->off != k2->off)
+			return true;
+		/* same word: fine as long as they change different bits */
+		return c1 == TCA_PEDIT_KEY_EX_CMD_SET &&
+		       c2 == TCA_PEDIT_KEY_EX_CMD_SET &&
+		       !(pedit_key_changes(k1, c1) & pedit_key_changes(k2, c2));
+	}
+
+	if (b1 > b2) {
+		const struct tc_pedit_key *k = k1;
+
+		k1 = k2;
+		k2 = k;
+		c1 = c2;
+		b1 = b2;
+	}
+	/* the upper key may point back into the lower header */
+	if ((int)k2->off < 0)
+		return false;
+
+	changed = ntohl(pedit_key_changes(k1, c1));
+	for (last = 3; last >= 0; last--)
+		if (changed & (0xFF << (24 - 8 * last)))
+			break;
+	return last < 0 || (int)k1->off + last < pedit_base_minlen[b1];
+}
+
+/*
+ * Fold a "set" key into an earlier one on the same word when every key
+ * in between commutes with it.  (x & m1 ^ v1) & m2 ^ v2 is
+ * x & (m1 & m2) ^ (v1 & m2 ^ v2), so the result is exact.  Returns the
+ * key it went into or -1.
+ */
+static int pedit_key_fold(struct tc_pedit_key *keys,
+			  struct m_pedit_key_ex *keys_ex, int nkeys,
+			  const struct tc_pedit_key *k,
+			  enum pedit_header_type htype, enum pedit_cmd cmd)
+{
+	int i;
+
+	if (cmd != TCA_PEDIT_KEY_EX_CMD_SET || k->offmask)
+		return -1;
+
+	for (i = nkeys - 1; i >= 0; i--) {
+		enum pedit_header_type hi = TCA_PEDIT_KEY_EX_HDR_TYPE_NETWORK;
+		enum pedit_cmd ci = TCA_PEDIT_KEY_EX_CMD_SET;
+
+		if (keys_ex) {
+			hi = keys_ex[i].htype;
+			ci = keys_ex[i].cmd;
+		}
+
+		if (hi == htype && ci == TCA_PEDIT_KEY_EX_CMD_SET &&
+		    keys[i].off == k->off && !keys[i].offmask) {
+			keys[i].val = (keys[i].val & k->mask) ^ k->val;
+			keys[i].mask &= k->mask;
+			return i;
+		}
+		if (!pedit_keys_commute(&keys[i], hi, ci, k, htype, cmd))
+			return -1;
+	}
+	return -1;
+}
+
 static int pack_key(struct m_pedit_sel *_sel, struct m_pedit_key *tkey)
 {
 	struct tc_pedit_sel *sel = &_sel->sel;
 	struct m_pedit_key_ex *keys_ex = _sel->keys_ex;
+	struct tc_pedit_key k = {
+		.mask = tkey->mask,
+		.val = tkey->val,
+		.off = tkey->off,
+		.at = tkey->at,
+		.offmask = tkey->offmask,
+		.shift = tkey->shift,
+	};
 	int hwm = sel->nkeys;
 
-	if (hwm >= MAX_OFFS)
-		return -1;
-
 	if (tkey->off % 4) {
 		fprintf(stderr, "offsets MUST be in 32 bit boundaries\n");
 		return -1;
 	}
 
+	if (!_sel->extended &&
+	    (tkey->htype != TCA_PEDIT_KEY_EX_HDR_TYPE_NETWORK ||
+	     tkey->cmd != TCA_PEDIT_KEY_EX_CMD_SET)) {
+		fprintf(stderr,
+			"Munge parameters not supported. Use 'pedit ex munge ...'.\n");
+		return -1;
+	}
+
+	/* edits of the same word end up in one key */
+	if (pedit_key_fold(sel->keys, _sel->extended ? keys_ex : NULL, hwm,
+			   &k, tkey->htype, tkey->cmd) >= 0) {
+		if (pedit_debug)
+			printf("pack_key: folded word off %d\n", tkey->off);
+		return 0;
+	}
+
+	if (hwm >= MAX_OFFS)
+		return -1;
+
 	//将tkey存入到sel中
-	sel->keys[hwm].val = tkey->val;
-	sel->keys[hwm].mask = tkey->mask;
-	sel->keys[hwm].off = tkey->off;
-	sel->keys[hwm].at = tkey->at;
-	sel->keys[hwm].offmask = tkey->offmask;
-	sel->keys[hwm].shift = tkey->shift;
+	sel->keys[hwm] = k;
 
 	if (_sel->extended) {
 		keys_ex[hwm].htype = tkey->htype;
 		keys_ex[hwm].cmd = tkey->cmd;
-	} else {
-		if (tkey->htype != TCA_PEDIT_KEY_EX_HDR_TYPE_NETWORK ||
-		    tkey->cmd != TCA_PEDIT_KEY_EX_CMD_SET) {
-			fprintf(stderr,
-				"Munge parameters not supported. Use 'pedit ex munge ...'.\n");
-			return -1;
-		}
 	}
 
 	//增加key指针
@@ -770,6 +888,33 @@ static int print_pedit_location(FILE *f,
 	return 0;
 }
 
+/* Keys left once same word edits are folded, for actions from elsewhere */
+static unsigned int pedit_folded_nkeys(const struct tc_pedit_sel *sel,
+				       const struct m_pedit_key_ex *keys_ex)
+{
+	struct tc_pedit_key keys[MAX_OFFS];
+	struct m_pedit_key_ex ex[MAX_OFFS];
+	int i, n = 0;
+
+	for (i = 0; i < sel->nkeys; i++) {
+		enum pedit_header_type htype =
+			keys_ex ? keys_ex[i].htype :
+			TCA_PEDIT_KEY_EX_HDR_TYPE_NETWORK;
+		enum pedit_cmd cmd =
+			keys_ex ? keys_ex[i].cmd : TCA_PEDIT_KEY_EX_CMD_SET;
+
+		if (pedit_key_fold(keys, ex, n, &sel->keys[i], htype, cmd) >= 0)
+			continue;
+		if (n == MAX_OFFS)
+			return sel->nkeys;
+		keys[n] = sel->keys[i];
+		ex[n].htype = htype;
+		ex[n].cmd = cmd;
+		n++;
+	}
+	return n;
+}
+
 static int print_pedit(struct action_util *au, FILE *f, struct rtattr *arg)
 {
 	struct tc_pedit_sel *sel;
@@ -817,7 +962,15 @@ static int print_pedit(struct action_util *au, FILE *f, struct rtattr *arg)
 	}
 
 	print_action_control(f, "action ", sel->action, " ");
-	print_uint(PRINT_ANY, "nkeys", "keys %d\n", sel->nkeys);
+	print_uint(PRINT_ANY, "nkeys", "keys %d", sel->nkeys);
+	if (show_stats) {
+		unsigned int folded = pedit_folded_nkeys(sel, keys_ex);
+
+		if (folded != sel->nkeys)
+			print_uint(PRINT_ANY, "folded_nkeys", " (%u folded)",
+				   folded);
+	}
+	print_string(PRINT_FP, NULL, "%s", "\n");
 	print_uint(PRINT_ANY, "index", " \t index %u", sel->index);
 	print_int(PRINT_ANY, "ref", " ref %d", sel->refcnt);
 	print_int(PRINT_ANY, "bind", " bind %d", sel->bindcnt);
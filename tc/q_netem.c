@@ -15,10 +15,14 @@
 #include <arpa/inet.h>
 #include <string.h>
 #include <errno.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "utils.h"
 #include "tc_util.h"
 #include "tc_common.h"
+#include "netem_dist.h"
 
 static void explain(void)
 {
@@ -121,22 +125,17 @@ static void print_corr(bool present, __u32 value)
  *	# comment line(s)
  *	data0 data1 ...
  */
-static int get_distribution(const char *type, __s16 *data, int maxdata)
+static int get_distribution_text(const char *name, __s16 *data, int maxdata)
 {
 	FILE *f;
 	int n;
 	long x;
 	size_t len;
 	char *line = NULL;
-	char name[128];
 
-	snprintf(name, sizeof(name), "%s/%s.dist", get_tc_lib(), type);
 	f = fopen(name, "r");
-	if (f == NULL) {
-		fprintf(stderr, "No distribution data for %s (%s: %s)\n",
-			type, name, strerror(errno));
+	if (f == NULL)
 		return -1;
-	}
 
 	n = 0;
 	while (getline(&line, &len, f) != -1) {
@@ -153,7 +152,7 @@ static int get_distribution(const char *type, __s16 *data, int maxdata)
 			if (n >= maxdata) {
 				fprintf(stderr, "%s: too much data\n",
 					name);
-				n = -1;
+				n = -2;
 				goto error;
 			}
 			data[n++] = x;
@@ -165,6 +164,150 @@ static int get_distribution(const char *type, __s16 *data, int maxdata)
 	return n;
 }
 
+/*
+ * Binary tables (see netem_dist.h) are mapped and used in place on
+ * little endian hosts.
+ */
+static int get_distribution_bin(const char *name, const __s16 **data)
+{
+	const struct netem_dist_hdr *hdr;
+	struct stat st;
+	void *map;
+	__u32 count;
+	int fd;
+
+	fd = open(name, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof(*hdr)) {
+		close(fd);
+		goto bad;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "%s: mmap failed: %s\n", name, strerror(errno));
+		return -2;
+	}
+
+	hdr = map;
+	count = le32toh(hdr->count);
+	if (le32toh(hdr->magic) != NETEM_DIST_MAGIC ||
+	    le16toh(hdr->version) != NETEM_DIST_VERSION ||
+	    le16toh(hdr->hdr_len) < sizeof(*hdr) ||
+	    (le16toh(hdr->hdr_len) & 1) ||
+	    count == 0 || count > MAX_DIST ||
+	    le16toh(hdr->hdr_len) + count * sizeof(__s16) > st.st_size) {
+		munmap(map, st.st_size);
+		goto bad;
+	}
+
+	*data = map + le16toh(hdr->hdr_len);
+#if __BYTE_ORDER == __BIG_ENDIAN
+	{
+		const __s16 *raw = *data;
+		__s16 *swapped = malloc(count * sizeof(__s16));
+		__u32 i;
+
+		if (!swapped) {
+			munmap(map, st.st_size);
+			return -2;
+		}
+		for (i = 0; i < count; i++)
+			swapped[i] = le16toh(raw[i]);
+		munmap(map, st.st_size);
+		*data = swapped;
+	}
+#endif
+	return count;
+bad:
+	fprintf(stderr, "%s: not a netem distribution table\n", name);
+	return -2;
+}
+
+/*
+ * Tables are loaded once per run, so a batch setting the same
+ * distribution on many devices reads and parses it only once.
+ */
+struct netem_dist {
+	struct netem_dist	*next;
+	char			*type;
+	const __s16		*data;
+	int			size;
+};
+
+static struct netem_dist *netem_dists;
+
+/*
+ * A binary table regenerated from its text source is newer than it;
+ * one older than the text table next to it is out of date and ignored.
+ */
+static bool distb_is_stale(const char *bin, const char *text)
+{
+	struct stat bst, tst;
+
+	if (stat(bin, &bst) < 0 || stat(text, &tst) < 0)
+		return false;
+
+	return bst.st_mtime < tst.st_mtime;
+}
+
+static int get_distribution(const char *type, const __s16 **data)
+{
+	struct netem_dist *dist;
+	char name[128], text_name[128];
+	__s16 *text;
+	int n = -1;
+
+	for (dist = netem_dists; dist; dist = dist->next) {
+		if (strcmp(dist->type, type) == 0) {
+			*data = dist->data;
+			return dist->size;
+		}
+	}
+
+	snprintf(name, sizeof(name), "%s/%s.distb", get_tc_lib(), type);
+	snprintf(text_name, sizeof(text_name), "%s/%s.dist", get_tc_lib(), type);
+	if (distb_is_stale(name, text_name))
+		errno = ENOENT;
+	else
+		n = get_distribution_bin(name, data);
+	if (n == -1 && errno == ENOENT) {
+		strcpy(name, text_name);
+		text = calloc(sizeof(text[0]), MAX_DIST);
+		if (text == NULL)
+			return -1;
+
+		n = get_distribution_text(name, text, MAX_DIST);
+		if (n > 0)
+			*data = text;
+		else
+			free(text);
+	}
+	if (n == -1)
+		fprintf(stderr, "No distribution data for %s (%s: %s)\n",
+			type, name, strerror(errno));
+	if (n <= 0)
+		return -1;
+
+	dist = malloc(sizeof(*dist));
+	if (dist) {
+		dist->type = strdup(type);
+		if (dist->type) {
+			dist->data = *data;
+			dist->size = n;
+			dist->next = netem_dists;
+			netem_dists = dist;
+		} else {
+			free(dist);
+		}
+	}
+
+	return n;
+}
+
 #define NEXT_IS_NUMBER() (NEXT_ARG_OK() && isdigit(argv[1][0]))
 #define NEXT_IS_SIGNED_NUMBER() \
 	(NEXT_ARG_OK() && (isdigit(argv[1][0]) || argv[1][0] == '-'))
@@ -203,8 +346,8 @@ static int netem_parse_opt(struct qdisc_util *qu, int argc, char **argv,
 	struct tc_netem_gemodel gemodel;
 	struct tc_netem_rate rate = {};
 	struct tc_netem_slot slot = {};
-	__s16 *dist_data = NULL;
-	__s16 *slot_dist_data = NULL;
+	const __s16 *dist_data = NULL;
+	const __s16 *slot_dist_data = NULL;
 	__u16 loss_type = NETEM_LOSS_UNSPEC;
 	int present[__TCA_NETEM_MAX] = {};
 	__u64 rate64 = 0;
@@ -416,15 +559,9 @@ random_loss_model:
 			}
 		} else if (matches(*argv, "distribution") == 0) {
 			NEXT_ARG();
-			dist_data = calloc(sizeof(dist_data[0]), MAX_DIST);
-			if (dist_data == NULL)
-				return -1;
-
-			dist_size = get_distribution(*argv, dist_data, MAX_DIST);
-			if (dist_size <= 0) {
-				free(dist_data);
+			dist_size = get_distribution(*argv, &dist_data);
+			if (dist_size <= 0)
 				return -1;
-			}
 		} else if (matches(*argv, "rate") == 0) {
 			++present[TCA_NETEM_RATE];
 			NEXT_ARG();
@@ -481,14 +618,9 @@ random_loss_model:
 				if (strcmp(*argv, "distribution") == 0) {
 					present[TCA_NETEM_SLOT] = 1;
 					NEXT_ARG();
-					slot_dist_data = calloc(sizeof(slot_dist_data[0]), MAX_DIST);
-					if (!slot_dist_data)
-						return -1;
-					slot_dist_size = get_distribution(*argv, slot_dist_data, MAX_DIST);
-					if (slot_dist_size <= 0) {
-						free(slot_dist_data);
+					slot_dist_size = get_distribution(*argv, &slot_dist_data);
+					if (slot_dist_size <= 0)
 						return -1;
-					}
 					NEXT_ARG();
 					if (get_time64(&slot.dist_delay, *argv)) {
 						explain1("slot delay");
@@ -632,7 +764,6 @@ random_loss_model:
 			      TCA_NETEM_DELAY_DIST,
 			      dist_data, dist_size * sizeof(dist_data[0])) < 0)
 			return -1;
-		free(dist_data);
 	}
 
 	if (slot_dist_data) {
@@ -640,7 +771,6 @@ random_loss_model:
 			      TCA_NETEM_SLOT_DIST,
 			      slot_dist_data, slot_dist_size * sizeof(slot_dist_data[0])) < 0)
 			return -1;
-		free(slot_dist_data);
 	}
 	tail->rta_len = (void *) NLMSG_TAIL(n) - (void *) tail;
 	return 0;
@@ -199,7 +199,7 @@ static void usage(void)
 		"Usage:	tc [ OPTIONS ] OBJECT { COMMAND | help }\n"
 		"	tc [-force] -batch filename\n"
 		"where  OBJECT := { qdisc | class | filter | chain |\n"
-		"		    action | monitor | exec }\n"
+		"		    action | monitor | exec | flower | tree | u32 }\n"
 		"       OPTIONS := { -V[ersion] | -s[tatistics] | -d[etails] | -r[aw] |\n"
 		"		    -o[neline] | -j[son] | -p[retty] | -c[olor]\n"
 		"		    -b[atch] [filename] | -n[etns] name | -N[umeric] |\n"
@@ -230,6 +230,12 @@ static int do_cmd(int argc, char **argv)
 	//tc exec 命令
 	if (matches(*argv, "exec") == 0)
 		return do_exec(argc-1, argv+1);
+	if (matches(*argv, "flower") == 0)
+		return do_flower(argc-1, argv+1);
+	if (matches(*argv, "tree") == 0)
+		return do_tree(argc-1, argv+1);
+	if (matches(*argv, "u32") == 0)
+		return do_u32(argc-1, argv+1);
 	if (matches(*argv, "help") == 0) {
 		usage();
 		return 0;
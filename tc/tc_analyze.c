@@ -0,0 +1,802 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * tc_analyze.c		"tc filter analyze": estimate the classification cost
+ *			of an installed filter set.
+ *
+ * Every priority of a chain is a separate classifier instance that a
+ * packet tries in turn.  A flower instance does one hash lookup per
+ * distinct mask it holds, a u32 instance walks the nodes of its root
+ * tables and one bucket of every table they link to.  The analyzer
+ * rebuilds the masks of every instance from a filter dump, reports the
+ * resulting per packet lookup count for a miss, the hardware/software
+ * placement of the filters, and flower filters that can never match in
+ * software because a filter of an earlier priority covers them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <linux/if_ether.h>
+#include <linux/pkt_cls.h>
+#include <linux/tc_act/tc_gact.h>
+#include <linux/tc_act/tc_connmark.h>
+#include <linux/tc_act/tc_csum.h>
+#include <linux/tc_act/tc_ct.h>
+#include <linux/tc_act/tc_ctinfo.h>
+#include <linux/tc_act/tc_ife.h>
+#include <linux/tc_act/tc_nat.h>
+#include <linux/tc_act/tc_pedit.h>
+
+#include "rt_names.h"
+#include "utils.h"
+#include "tc_util.h"
+#include "tc_common.h"
+#include "tc_flower.h"
+
+enum {
+	FA_FLOWER,
+	FA_U32,
+	FA_OTHER,
+};
+
+/* u32 hash tables are shared by all instances under a parent */
+#define FA_U32_TABLES	0x1000
+
+struct fa_u32_table {
+	int		tp;
+	__u32		divisor;
+	unsigned int	nodes;
+	int		state;
+	double		cost;
+};
+
+struct fa_u32_link {
+	__u32		from;
+	__u32		to;
+};
+
+struct fa_tp {
+	__u32		chain;
+	__u32		prio;
+	__u16		protocol;
+	int		type;
+	char		kind[16];
+	unsigned int	filters;
+	unsigned int	masks;
+	unsigned int	sw_masks;
+	unsigned int	skip_sw;
+	unsigned int	skip_hw;
+	unsigned int	in_hw;
+	unsigned int	not_in_hw;
+	unsigned int	ntables;
+	double		lookups;
+};
+
+/* a flower mask within one chain, with the terminal filters using it */
+struct fa_sig {
+	__u8		*mask;
+	unsigned int	hash;
+	bool		exact;
+	int		next;
+	int		tp;		/* last instance that counted it */
+	int		sw_tp;
+	int		*slot;		/* open addressing over fa_entry */
+	unsigned int	size;
+	unsigned int	count;
+};
+
+struct fa_entry {
+	__u8		*key;
+	__u32		prio;
+	__u32		handle;
+};
+
+struct fa_shadow {
+	__u32		chain;
+	__u32		prio;
+	__u32		handle;
+	__u32		by_prio;
+	__u32		by_handle;
+};
+
+struct fa_pending {
+	int		sig;
+	int		entry;
+};
+
+#define FA_SIG_HASH	256
+
+struct fa_ctx {
+	struct fa_tp	*tps;
+	int		ntps;
+	int		tps_alloc;
+
+	/* state of the chain being dumped */
+	__u32		chain;
+	struct fa_sig	*sigs;
+	int		nsigs;
+	int		sigs_alloc;
+	int		sig_head[FA_SIG_HASH];
+	struct fa_entry	*entries;
+	int		nentries;
+	int		entries_alloc;
+	struct fa_pending *pending;
+	int		npending;
+	int		pending_alloc;
+
+	struct fa_shadow *shadows;
+	int		nshadows;
+	int		shadows_alloc;
+
+	struct fa_u32_table *tables;
+	struct fa_u32_link *links;
+	int		nlinks;
+	int		links_alloc;
+};
+
+static void fa_chain_reset(struct fa_ctx *ctx, __u32 chain)
+{
+	int i;
+
+	for (i = 0; i < ctx->nsigs; i++) {
+		free(ctx->sigs[i].mask);
+		free(ctx->sigs[i].slot);
+	}
+	for (i = 0; i < ctx->nentries; i++)
+		free(ctx->entries[i].key);
+	ctx->nsigs = 0;
+	ctx->nentries = 0;
+	ctx->npending = 0;
+	memset(ctx->sig_head, -1, sizeof(ctx->sig_head));
+	ctx->chain = chain;
+}
+
+static int fa_sig_get(struct fa_ctx *ctx, const struct flower_keyvec *kv,
+		      int len)
+{
+	unsigned int h = tc_masked_hash(kv->mask, kv->mask, len);
+	struct fa_sig *s;
+	int i;
+
+	/* port ranges and friends: one mask per layout, no shadow lookups */
+	for (i = 0; i < kv->extra_len; i++)
+		h = (h ^ kv->extra[i]) * 16777619U;
+
+	for (i = ctx->sig_head[h % FA_SIG_HASH]; i >= 0; i = s->next) {
+		s = &ctx->sigs[i];
+		if (s->hash == h && s->exact == !kv->inexact &&
+		    !memcmp(s->mask, kv->mask, len))
+			return i;
+	}
+
+	ctx->sigs = tc_grow(ctx->sigs, &ctx->sigs_alloc, ctx->nsigs + 1,
+			    sizeof(*ctx->sigs));
+	s = &ctx->sigs[ctx->nsigs];
+	memset(s, 0, sizeof(*s));
+	s->mask = malloc(len);
+	if (!s->mask) {
+		perror("malloc");
+		exit(1);
+	}
+	memcpy(s->mask, kv->mask, len);
+	s->hash = h;
+	s->exact = !kv->inexact;
+	s->tp = s->sw_tp = -1;
+	s->next = ctx->sig_head[h % FA_SIG_HASH];
+	ctx->sig_head[h % FA_SIG_HASH] = ctx->nsigs;
+
+	return ctx->nsigs++;
+}
+
+static void fa_sig_insert(struct fa_ctx *ctx, struct fa_sig *s, int e, int len)
+{
+	unsigned int h;
+
+	if ((s->count + 1) * 2 > s->size) {
+		int *old = s->slot;
+		unsigned int i, osize = s->size;
+
+		s->size = s->size ? s->size * 2 : 16;
+		s->count = 0;
+		s->slot = malloc(s->size * sizeof(*s->slot));
+		if (!s->slot) {
+			perror("malloc");
+			exit(1);
+		}
+		memset(s->slot, -1, s->size * sizeof(*s->slot));
+		for (i = 0; i < osize; i++)
+			if (old[i] >= 0)
+				fa_sig_insert(ctx, s, old[i], len);
+		free(old);
+	}
+
+	h = tc_masked_hash(ctx->entries[e].key, s->mask, len) & (s->size - 1);
+	for (; s->slot[h] >= 0; h = (h + 1) & (s->size - 1)) {
+		/* keep the earliest of identical keys */
+		if (tc_masked_eq(ctx->entries[s->slot[h]].key,
+				 ctx->entries[e].key, s->mask, len))
+			return;
+	}
+	s->slot[h] = e;
+	s->count++;
+}
+
+static int fa_sig_find(struct fa_ctx *ctx, struct fa_sig *s, const __u8 *key,
+		       int len)
+{
+	unsigned int h;
+
+	if (!s->size)
+		return -1;
+
+	h = tc_masked_hash(key, s->mask, len) & (s->size - 1);
+	for (; s->slot[h] >= 0; h = (h + 1) & (s->size - 1))
+		if (tc_masked_eq(ctx->entries[s->slot[h]].key, key, s->mask,
+				 len))
+			return s->slot[h];
+	return -1;
+}
+
+/* filters of an instance only shadow those of later priorities */
+static void fa_commit(struct fa_ctx *ctx, int len)
+{
+	int i;
+
+	for (i = 0; i < ctx->npending; i++)
+		fa_sig_insert(ctx, &ctx->sigs[ctx->pending[i].sig],
+			      ctx->pending[i].entry, len);
+	ctx->npending = 0;
+}
+
+/*
+ * Every action reports its verdict in the tc_gen header of its parameters,
+ * kept in attribute 2 (TCA_GACT_PARMS) by most kinds and elsewhere by these.
+ */
+static const struct {
+	const char	*kind;
+	int		type;
+} fa_act_parms[] = {
+	{ "connmark",	TCA_CONNMARK_PARMS },
+	{ "csum",	TCA_CSUM_PARMS },
+	{ "ct",		TCA_CT_PARMS },
+	{ "ctinfo",	TCA_CTINFO_ACT },
+	{ "ife",	TCA_IFE_PARMS },
+	{ "nat",	TCA_NAT_PARMS },
+	{ "pedit",	TCA_PEDIT_PARMS },
+	{ "pedit",	TCA_PEDIT_PARMS_EX },
+};
+
+/* verdicts that certainly end the filter walk */
+static bool fa_verdict_terminal(int action)
+{
+	return action != TC_ACT_UNSPEC && action != TC_ACT_PIPE &&
+	       action != TC_ACT_RECLASSIFY;
+}
+
+/* a policer passes conforming packets with its result, OK by default */
+static bool fa_police_terminal(struct rtattr *opts)
+{
+	struct rtattr *tb[TCA_POLICE_MAX + 1];
+	struct tc_police *p;
+
+	parse_rtattr_nested(tb, TCA_POLICE_MAX, opts);
+	if (!tb[TCA_POLICE_TBF] || RTA_PAYLOAD(tb[TCA_POLICE_TBF]) < sizeof(*p))
+		return false;
+
+	p = RTA_DATA(tb[TCA_POLICE_TBF]);
+	if (!fa_verdict_terminal(p->action))
+		return false;
+	return !tb[TCA_POLICE_RESULT] ||
+	       fa_verdict_terminal(rta_getattr_u32(tb[TCA_POLICE_RESULT]));
+}
+
+/* Does the last action end the walk rather than hand the packet on? */
+static bool fa_flower_terminal(struct rtattr *act)
+{
+	struct rtattr *tb[TCA_ACT_MAX_PRIO + 1];
+	struct rtattr *atb[TCA_ACT_MAX + 1];
+	struct rtattr *otb[TCA_PEDIT_PARMS_EX + 1];
+	struct rtattr *parms = NULL;
+	bool known = false;
+	const char *kind;
+	struct tc_gact *p;
+	int i;
+
+	/* a filter without actions returns its classid */
+	if (!act)
+		return true;
+
+	parse_rtattr_nested(tb, TCA_ACT_MAX_PRIO, act);
+	for (i = TCA_ACT_MAX_PRIO; i > 0 && !tb[i]; i--)
+		;
+	if (!i)
+		return true;
+
+	parse_rtattr_nested(atb, TCA_ACT_MAX, tb[i]);
+	if (!atb[TCA_ACT_KIND] || !atb[TCA_ACT_OPTIONS])
+		return false;
+
+	kind = rta_getattr_str(atb[TCA_ACT_KIND]);
+	if (!strcmp(kind, "police"))
+		return fa_police_terminal(atb[TCA_ACT_OPTIONS]);
+
+	/* the parameters are among the first few attributes of every kind */
+	parse_rtattr_nested(otb, TCA_PEDIT_PARMS_EX, atb[TCA_ACT_OPTIONS]);
+	for (i = 0; i < ARRAY_SIZE(fa_act_parms) && !parms; i++) {
+		if (strcmp(fa_act_parms[i].kind, kind))
+			continue;
+		known = true;
+		parms = otb[fa_act_parms[i].type];
+	}
+	if (!known)
+		parms = otb[TCA_GACT_PARMS];
+
+	/* struct tc_gact is just the tc_gen header */
+	if (!parms || RTA_PAYLOAD(parms) < sizeof(*p))
+		return false;
+
+	p = RTA_DATA(parms);
+	if (!fa_verdict_terminal(p->action))
+		return false;
+
+	/* gact random gives some packets a second verdict */
+	if (!strcmp(kind, "gact") && otb[TCA_GACT_PROB]) {
+		struct tc_gact_p *pp = RTA_DATA(otb[TCA_GACT_PROB]);
+
+		if (RTA_PAYLOAD(otb[TCA_GACT_PROB]) < sizeof(*pp) ||
+		    !fa_verdict_terminal(pp->paction))
+			return false;
+	}
+	return true;
+}
+
+static void fa_flags(struct fa_tp *tp, __u32 flags)
+{
+	if (flags & TCA_CLS_FLAGS_SKIP_SW)
+		tp->skip_sw++;
+	if (flags & TCA_CLS_FLAGS_SKIP_HW)
+		tp->skip_hw++;
+	if (flags & TCA_CLS_FLAGS_IN_HW)
+		tp->in_hw++;
+	if (flags & TCA_CLS_FLAGS_NOT_IN_HW)
+		tp->not_in_hw++;
+}
+
+static void fa_flower(struct fa_ctx *ctx, struct fa_tp *tp, __u32 handle,
+		      struct rtattr *opts)
+{
+	struct rtattr *tb[TCA_FLOWER_MAX + 1];
+	struct flower_keyvec kv;
+	__u32 flags = 0;
+	int len, sig, i;
+	struct fa_sig *s;
+
+	parse_rtattr_nested(tb, TCA_FLOWER_MAX, opts);
+	if (tb[TCA_FLOWER_FLAGS])
+		flags = rta_getattr_u32(tb[TCA_FLOWER_FLAGS]);
+	fa_flags(tp, flags);
+
+	flower_keyvec_parse(opts, &kv);
+	len = flower_keyvec_len();
+	sig = fa_sig_get(ctx, &kv, len);
+	s = &ctx->sigs[sig];
+	if (s->tp != ctx->ntps - 1) {
+		s->tp = ctx->ntps - 1;
+		tp->masks++;
+	}
+	if (flags & TCA_CLS_FLAGS_SKIP_SW)
+		return;
+	if (s->sw_tp != ctx->ntps - 1) {
+		s->sw_tp = ctx->ntps - 1;
+		tp->sw_masks++;
+	}
+
+	/* covered by a terminal filter of an earlier priority? */
+	for (i = 0; i < ctx->nsigs; i++) {
+		struct fa_sig *o = &ctx->sigs[i];
+		int e;
+
+		if (!o->exact || !o->count ||
+		    !flower_keyvec_subset(o->mask, kv.mask))
+			continue;
+		e = fa_sig_find(ctx, o, kv.key, len);
+		if (e < 0)
+			continue;
+
+		ctx->shadows = tc_grow(ctx->shadows, &ctx->shadows_alloc,
+				       ctx->nshadows + 1,
+				       sizeof(*ctx->shadows));
+		ctx->shadows[ctx->nshadows++] = (struct fa_shadow) {
+			.chain = tp->chain,
+			.prio = tp->prio,
+			.handle = handle,
+			.by_prio = ctx->entries[e].prio,
+			.by_handle = ctx->entries[e].handle,
+		};
+		return;
+	}
+
+	if (!s->exact || !fa_flower_terminal(tb[TCA_FLOWER_ACT]))
+		return;
+
+	ctx->entries = tc_grow(ctx->entries, &ctx->entries_alloc,
+			       ctx->nentries + 1, sizeof(*ctx->entries));
+	ctx->entries[ctx->nentries].key = malloc(len);
+	if (!ctx->entries[ctx->nentries].key) {
+		perror("malloc");
+		exit(1);
+	}
+	memcpy(ctx->entries[ctx->nentries].key, kv.key, len);
+	ctx->entries[ctx->nentries].prio = tp->prio;
+	ctx->entries[ctx->nentries].handle = handle;
+
+	ctx->pending = tc_grow(ctx->pending, &ctx->pending_alloc,
+			       ctx->npending + 1, sizeof(*ctx->pending));
+	ctx->pending[ctx->npending].sig = sig;
+	ctx->pending[ctx->npending].entry = ctx->nentries++;
+	ctx->npending++;
+}
+
+static struct fa_u32_table *fa_u32_table(struct fa_ctx *ctx,
+					 struct fa_tp *tp, __u32 handle)
+{
+	struct fa_u32_table *t = &ctx->tables[TC_U32_USERHTID(handle)];
+
+	if (t->tp < 0) {
+		t->tp = tp - ctx->tps;
+		tp->ntables++;
+	}
+	return t;
+}
+
+static void fa_u32(struct fa_ctx *ctx, struct fa_tp *tp, __u32 handle,
+		   struct rtattr *opts)
+{
+	struct rtattr *tb[TCA_U32_MAX + 1];
+	struct fa_u32_table *t;
+
+	parse_rtattr_nested(tb, TCA_U32_MAX, opts);
+
+	t = fa_u32_table(ctx, tp, handle);
+	if (tb[TCA_U32_DIVISOR]) {
+		t->divisor = rta_getattr_u32(tb[TCA_U32_DIVISOR]) ? : 1;
+		return;
+	}
+	if (!TC_U32_KEY(handle))
+		return;
+
+	tp->filters++;
+	t->nodes++;
+	if (tb[TCA_U32_FLAGS])
+		fa_flags(tp, rta_getattr_u32(tb[TCA_U32_FLAGS]));
+
+	if (tb[TCA_U32_LINK]) {
+		ctx->links = tc_grow(ctx->links, &ctx->links_alloc,
+				     ctx->nlinks + 1, sizeof(*ctx->links));
+		ctx->links[ctx->nlinks].from = TC_U32_USERHTID(handle);
+		ctx->links[ctx->nlinks].to =
+			TC_U32_USERHTID(rta_getattr_u32(tb[TCA_U32_LINK]));
+		ctx->nlinks++;
+	}
+}
+
+static int fa_filter(struct nlmsghdr *n, void *arg)
+{
+	struct fa_ctx *ctx = arg;
+	struct tcmsg *t = NLMSG_DATA(n);
+	int len = n->nlmsg_len - NLMSG_LENGTH(sizeof(*t));
+	struct rtattr *tb[TCA_MAX + 1];
+	struct fa_tp *tp = NULL;
+	__u32 chain = 0, prio;
+	__u16 protocol;
+
+	if (n->nlmsg_type != RTM_NEWTFILTER || len < 0)
+		return 0;
+
+	parse_rtattr(tb, TCA_MAX, TCA_RTA(t), len);
+	if (!tb[TCA_KIND])
+		return 0;
+	if (tb[TCA_CHAIN])
+		chain = rta_getattr_u32(tb[TCA_CHAIN]);
+	prio = TC_H_MAJ(t->tcm_info) >> 16;
+	protocol = TC_H_MIN(t->tcm_info);
+
+	if (ctx->ntps)
+		tp = &ctx->tps[ctx->ntps - 1];
+	if (!tp || tp->chain != chain || tp->prio != prio ||
+	    tp->protocol != protocol) {
+		fa_commit(ctx, flower_keyvec_len());
+		if (!tp || tp->chain != chain)
+			fa_chain_reset(ctx, chain);
+
+		ctx->tps = tc_grow(ctx->tps, &ctx->tps_alloc, ctx->ntps + 1,
+				   sizeof(*ctx->tps));
+		tp = &ctx->tps[ctx->ntps++];
+		memset(tp, 0, sizeof(*tp));
+		tp->chain = chain;
+		tp->prio = prio;
+		tp->protocol = protocol;
+		strncpy(tp->kind, rta_getattr_str(tb[TCA_KIND]),
+			sizeof(tp->kind) - 1);
+		if (!strcmp(tp->kind, "flower"))
+			tp->type = FA_FLOWER;
+		else if (!strcmp(tp->kind, "u32"))
+			tp->type = FA_U32;
+		else
+			tp->type = FA_OTHER;
+	}
+
+	/* the first message of an instance carries no filter */
+	if (!tb[TCA_OPTIONS] || (!t->tcm_handle && tp->type != FA_U32))
+		return 0;
+
+	switch (tp->type) {
+	case FA_FLOWER:
+		tp->filters++;
+		fa_flower(ctx, tp, t->tcm_handle, tb[TCA_OPTIONS]);
+		break;
+	case FA_U32:
+		fa_u32(ctx, tp, t->tcm_handle, tb[TCA_OPTIONS]);
+		break;
+	default:
+		tp->filters++;
+		break;
+	}
+	return 0;
+}
+
+/*
+ * Average nodes visited in a table: its nodes and those of the tables
+ * they link to, spread over its buckets.
+ */
+static double fa_u32_cost(struct fa_ctx *ctx, __u32 id)
+{
+	struct fa_u32_table *t = &ctx->tables[id];
+	double sum = t->nodes;
+	int i;
+
+	if (t->state)
+		return t->state > 1 ? t->cost : 0;
+
+	t->state = 1;
+	for (i = 0; i < ctx->nlinks; i++)
+		if (ctx->links[i].from == id)
+			sum += fa_u32_cost(ctx, ctx->links[i].to);
+	t->cost = sum / (t->divisor ? : 1);
+	t->state = 2;
+	return t->cost;
+}
+
+static void fa_tp_cost(struct fa_ctx *ctx, struct fa_tp *tp)
+{
+	int i;
+
+	switch (tp->type) {
+	case FA_FLOWER:
+		tp->lookups = tp->sw_masks;
+		break;
+	case FA_U32:
+		/* from the root tables of the instance down */
+		tp->lookups = 0;
+		for (i = 0; i < FA_U32_TABLES; i++) {
+			int j;
+
+			if (ctx->tables[i].tp != tp - ctx->tps)
+				continue;
+			for (j = 0; j < ctx->nlinks; j++)
+				if (ctx->links[j].to == i)
+					break;
+			if (j == ctx->nlinks)
+				tp->lookups += fa_u32_cost(ctx, i);
+		}
+		break;
+	default:
+		tp->lookups = tp->filters - tp->skip_sw;
+		break;
+	}
+}
+
+static void fa_print_tp(struct fa_tp *tp)
+{
+	SPRINT_BUF(b1);
+
+	open_json_object(NULL);
+	print_uint(PRINT_ANY, "prio", "  prio %u", tp->prio);
+	print_string(PRINT_ANY, "protocol", " protocol %s",
+		     ll_proto_n2a(tp->protocol, b1, sizeof(b1)));
+	print_string(PRINT_ANY, "kind", " %s:", tp->kind);
+	print_uint(PRINT_ANY, "filters", " filters %u", tp->filters);
+	if (tp->type == FA_FLOWER) {
+		print_uint(PRINT_ANY, "masks", " masks %u", tp->masks);
+		print_uint(PRINT_ANY, "sw_masks", " sw_masks %u",
+			   tp->sw_masks);
+	} else if (tp->type == FA_U32) {
+		print_uint(PRINT_ANY, "tables", " tables %u", tp->ntables);
+	}
+	print_float(PRINT_ANY, "lookups", " lookups %.1f", tp->lookups);
+	if (tp->skip_sw)
+		print_uint(PRINT_ANY, "skip_sw", " skip_sw %u", tp->skip_sw);
+	if (tp->skip_hw)
+		print_uint(PRINT_ANY, "skip_hw", " skip_hw %u", tp->skip_hw);
+	print_uint(PRINT_ANY, "in_hw", " in_hw %u", tp->in_hw);
+	print_uint(PRINT_ANY, "not_in_hw", " not_in_hw %u", tp->not_in_hw);
+	print_nl();
+	close_json_object();
+}
+
+static void fa_print(struct fa_ctx *ctx)
+{
+	double total = 0;
+	int i, j, s = 0;
+
+	open_json_object(NULL);
+	open_json_array(PRINT_JSON, "chains");
+	for (i = 0; i < ctx->ntps; i = j) {
+		__u32 chain = ctx->tps[i].chain;
+		unsigned int filters = 0, masks = 0, shadowed = 0;
+		double lookups = 0;
+
+		for (j = i; j < ctx->ntps && ctx->tps[j].chain == chain; j++) {
+			fa_tp_cost(ctx, &ctx->tps[j]);
+			filters += ctx->tps[j].filters;
+			masks += ctx->tps[j].type == FA_FLOWER ?
+				 ctx->tps[j].sw_masks : 0;
+			lookups += ctx->tps[j].lookups;
+		}
+		for (s = 0; s < ctx->nshadows; s++)
+			shadowed += ctx->shadows[s].chain == chain;
+		total += lookups;
+
+		open_json_object(NULL);
+		print_uint(PRINT_ANY, "chain", "chain %u:", chain);
+		print_uint(PRINT_ANY, "priorities", " priorities %u", j - i);
+		print_uint(PRINT_ANY, "filters", " filters %u", filters);
+		print_uint(PRINT_ANY, "masks", " masks %u", masks);
+		print_float(PRINT_ANY, "lookups", " lookups %.1f", lookups);
+		print_uint(PRINT_ANY, "shadowed", " shadowed %u", shadowed);
+		print_nl();
+
+		open_json_array(PRINT_JSON, "instances");
+		for (s = i; s < j; s++)
+			fa_print_tp(&ctx->tps[s]);
+		close_json_array(PRINT_JSON, NULL);
+
+		open_json_array(PRINT_JSON, "shadowed_filters");
+		for (s = 0; s < ctx->nshadows; s++) {
+			struct fa_shadow *sh = &ctx->shadows[s];
+
+			if (sh->chain != chain)
+				continue;
+			open_json_object(NULL);
+			print_uint(PRINT_ANY, "prio", "  shadowed: prio %u",
+				   sh->prio);
+			print_0xhex(PRINT_ANY, "handle", " handle %#llx",
+				    sh->handle);
+			print_uint(PRINT_ANY, "by_prio", " by prio %u",
+				   sh->by_prio);
+			print_0xhex(PRINT_ANY, "by_handle", " handle %#llx",
+				    sh->by_handle);
+			print_nl();
+			close_json_object();
+		}
+		close_json_array(PRINT_JSON, NULL);
+		close_json_object();
+	}
+	close_json_array(PRINT_JSON, NULL);
+	print_float(PRINT_ANY, "lookups",
+		    "worst case lookups per packet, all chains: %.1f", total);
+	print_nl();
+	close_json_object();
+}
+
+int tc_filter_analyze(int argc, char **argv)
+{
+	struct {
+		struct nlmsghdr n;
+		struct tcmsg t;
+		char buf[256];
+	} req = {
+		.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg)),
+		.n.nlmsg_type = RTM_GETTFILTER,
+		.t.tcm_parent = TC_H_UNSPEC,
+		.t.tcm_family = AF_UNSPEC,
+	};
+	struct fa_ctx ctx = {};
+	char *dev = NULL;
+	__u32 chain;
+	bool chain_set = false;
+	int ret = 0, i;
+
+	while (argc > 0) {
+		if (strcmp(*argv, "dev") == 0) {
+			NEXT_ARG();
+			if (dev)
+				duparg("dev", *argv);
+			dev = *argv;
+		} else if (strcmp(*argv, "root") == 0) {
+			if (req.t.tcm_parent)
+				duparg("parent", *argv);
+			req.t.tcm_parent = TC_H_ROOT;
+		} else if (strcmp(*argv, "ingress") == 0) {
+			if (req.t.tcm_parent)
+				duparg("parent", *argv);
+			req.t.tcm_parent = TC_H_MAKE(TC_H_CLSACT,
+						     TC_H_MIN_INGRESS);
+		} else if (strcmp(*argv, "egress") == 0) {
+			if (req.t.tcm_parent)
+				duparg("parent", *argv);
+			req.t.tcm_parent = TC_H_MAKE(TC_H_CLSACT,
+						     TC_H_MIN_EGRESS);
+		} else if (strcmp(*argv, "parent") == 0) {
+			NEXT_ARG();
+			if (req.t.tcm_parent)
+				duparg("parent", *argv);
+			if (get_tc_classid(&req.t.tcm_parent, *argv))
+				invarg("invalid parent ID", *argv);
+		} else if (matches(*argv, "chain") == 0) {
+			NEXT_ARG();
+			if (chain_set)
+				duparg("chain", *argv);
+			if (get_u32(&chain, *argv, 0))
+				invarg("invalid chain index value", *argv);
+			chain_set = true;
+		} else {
+			fprintf(stderr,
+				"What is \"%s\"? Try \"tc filter help\"\n",
+				*argv);
+			return -1;
+		}
+		argc--; argv++;
+	}
+
+	if (!dev) {
+		fprintf(stderr, "\"dev\" is required\n");
+		return -1;
+	}
+
+	ll_init_map(&rth);
+	req.t.tcm_ifindex = ll_name_to_index(dev);
+	if (!req.t.tcm_ifindex)
+		return -nodev(dev);
+	if (chain_set)
+		addattr32(&req.n, sizeof(req), TCA_CHAIN, chain);
+
+	/*
+	 * No TCA_DUMP_FLAGS_TERSE here: terse flower dumps leave out the
+	 * keys, and the keys are all this needs.
+	 */
+	if (rtnl_dump_request_n(&rth, &req.n) < 0) {
+		perror("Cannot send dump request");
+		return 1;
+	}
+
+	memset(ctx.sig_head, -1, sizeof(ctx.sig_head));
+	ctx.tables = calloc(FA_U32_TABLES, sizeof(*ctx.tables));
+	if (!ctx.tables) {
+		perror("calloc");
+		return 1;
+	}
+	for (i = 0; i < FA_U32_TABLES; i++)
+		ctx.tables[i].tp = -1;
+	if (rtnl_dump_filter(&rth, fa_filter, &ctx) < 0) {
+		fprintf(stderr, "Dump terminated\n");
+		ret = 1;
+		goto out;
+	}
+
+	new_json_obj(json);
+	fa_print(&ctx);
+	delete_json_obj();
+
+out:
+	fa_chain_reset(&ctx, 0);
+	free(ctx.sigs);
+	free(ctx.entries);
+	free(ctx.pending);
+	free(ctx.shadows);
+	free(ctx.tables);
+	free(ctx.links);
+	free(ctx.tps);
+	return ret;
+}
@@ -24,15 +24,20 @@ struct graph_node {
 	struct hlist_node hlist;
 	__u32 id;
 	__u32 parent_id;
-	struct graph_node *parent_node;
-	struct graph_node *right_node;
-	void *data;
-	int data_len;
+	int ifindex;
+	struct nlmsghdr *msg;
+	struct graph_node **children;
 	int nodes_count;
 };
 
-static struct hlist_head cls_list = {};
-static struct hlist_head root_cls_list = {};
+/*
+ * Classes are collected during the dump and linked into a tree once the
+ * dump is complete: a hash on (ifindex, classid) resolves every parent in
+ * one pass and children are kept in arrays sorted by classid.
+ */
+static struct graph_node **cls_nodes;
+static int cls_nodes_count;
+static int cls_nodes_alloc;
 
 static void usage(void);
 
@@ -44,6 +49,8 @@ static void usage(void)
 		"       [ [ QDISC_KIND ] [ help | OPTIONS ] ]\n"
 		"\n"
 		"       tc class show [ dev STRING ] [ root | parent CLASSID ]\n"
+		"       tc -s class show [ dev STRING ] [ root | parent CLASSID ]\n"
+		"                        interval SECS [ count N ]\n"
 		"Where:\n"
 		"QDISC_KIND := { prio | cbq | etc. }\n"
 		"OPTIONS := ... try tc class add <desired QDISC_KIND> help\n");
@@ -51,7 +58,8 @@ static void usage(void)
 
 //class的创建及更新
 //例如：tc class add dev eth0 parent 1: classid 1:1 htb rate 40mbit ceil 40mbit
-static int tc_class_modify(int cmd, unsigned int flags, int argc, char **argv)
+int tc_class_modify(int cmd, unsigned int flags, int argc, char **argv,
+		    struct nlmsghdr *out)
 {
 	struct {
 		struct nlmsghdr	n;
@@ -149,6 +157,11 @@ static int tc_class_modify(int cmd, unsigned int flags, int argc, char **argv)
 			return -nodev(d);
 	}
 
+	if (out) {
+		memcpy(out, &req.n, req.n.nlmsg_len);
+		return 0;
+	}
+
 	if (rtnl_talk(&rth, &req.n, NULL) < 0)
 		return 2;
 
@@ -159,174 +172,326 @@ static int filter_ifindex;
 static __u32 filter_qdisc;
 static __u32 filter_classid;
 
-static void graph_node_add(__u32 parent_id, __u32 id, void *data,
-		int len)
+static void graph_node_add(struct nlmsghdr *n)
 {
-	struct graph_node *node = calloc(1, sizeof(struct graph_node));
+	struct tcmsg *t = NLMSG_DATA(n);
+	struct graph_node *node;
+
+	if (cls_nodes_count == cls_nodes_alloc) {
+		cls_nodes_alloc = cls_nodes_alloc ? cls_nodes_alloc * 2 : 256;
+		cls_nodes = realloc(cls_nodes,
+				    cls_nodes_alloc * sizeof(*cls_nodes));
+		if (!cls_nodes) {
+			perror("realloc");
+			exit(1);
+		}
+	}
 
-	node->id         = id;
-	node->parent_id  = parent_id;
+	node = calloc(1, sizeof(*node));
+	if (node)
+		node->msg = malloc(n->nlmsg_len);
+	if (!node || !node->msg) {
+		perror("malloc");
+		exit(1);
+	}
+	memcpy(node->msg, n, n->nlmsg_len);
+	node->id = t->tcm_handle;
+	node->parent_id = t->tcm_parent;
+	node->ifindex = t->tcm_ifindex;
 
-	if (data && len) {
-		node->data       = malloc(len);
-		node->data_len   = len;
-		memcpy(node->data, data, len);
+	cls_nodes[cls_nodes_count++] = node;
+}
+
+static unsigned int graph_hash(int ifindex, __u32 id, unsigned int mask)
+{
+	return (id * 2654435761U ^ ifindex) & mask;
+}
+
+static struct graph_node *graph_lookup(struct hlist_head *hash,
+				       unsigned int mask, int ifindex, __u32 id)
+{
+	struct hlist_node *n;
+
+	hlist_for_each(n, &hash[graph_hash(ifindex, id, mask)]) {
+		struct graph_node *node = container_of(n, struct graph_node,
+						       hlist);
+
+		if (node->id == id && node->ifindex == ifindex)
+			return node;
 	}
+	return NULL;
+}
 
-	if (parent_id == TC_H_ROOT)
-		hlist_add_head(&node->hlist, &root_cls_list);
-	else
-		hlist_add_head(&node->hlist, &cls_list);
+static int graph_node_cmp(const void *a, const void *b)
+{
+	const struct graph_node *na = *(const struct graph_node **)a;
+	const struct graph_node *nb = *(const struct graph_node **)b;
+
+	if (na->ifindex != nb->ifindex)
+		return na->ifindex < nb->ifindex ? -1 : 1;
+	if (na->id != nb->id)
+		return na->id < nb->id ? -1 : 1;
+	return 0;
 }
 
-static void graph_indent(char *buf, struct graph_node *node, int is_newline,
-		int add_spaces)
+/*
+ * Link every collected class to its parent.  Returns the sorted array of
+ * root classes; classes whose parent was not dumped are not shown.
+ */
+static struct graph_node **graph_build(int *nroots)
 {
-	char spaces[100] = {0};
+	struct graph_node **roots, **parents;
+	struct hlist_head *hash;
+	unsigned int size = 64, mask;
+	int i, n = 0;
+
+	while (size < cls_nodes_count)
+		size <<= 1;
+	mask = size - 1;
+
+	hash = calloc(size, sizeof(*hash));
+	parents = calloc(cls_nodes_count ? : 1, sizeof(*parents));
+	roots = calloc(cls_nodes_count ? : 1, sizeof(*roots));
+	if (!hash || !parents || !roots) {
+		perror("calloc");
+		exit(1);
+	}
+
+	for (i = 0; i < cls_nodes_count; i++) {
+		struct graph_node *node = cls_nodes[i];
 
-	while (node && node->parent_node) {
-		node->parent_node->right_node = node;
-		node = node->parent_node;
+		hlist_add_head(&node->hlist,
+			       &hash[graph_hash(node->ifindex, node->id, mask)]);
 	}
-	while (node && node->right_node) {
-		if (node->hlist.next)
-			strcat(buf, "|    ");
+
+	/* count children first so each array is allocated exactly once */
+	for (i = 0; i < cls_nodes_count; i++) {
+		struct graph_node *node = cls_nodes[i];
+
+		if (node->parent_id == TC_H_ROOT) {
+			roots[n++] = node;
+			continue;
+		}
+		parents[i] = graph_lookup(hash, mask, node->ifindex,
+					  node->parent_id);
+		if (parents[i] && parents[i] != node)
+			parents[i]->nodes_count++;
 		else
-			strcat(buf, "     ");
+			parents[i] = NULL;
+	}
+
+	for (i = 0; i < cls_nodes_count; i++) {
+		struct graph_node *node = cls_nodes[i];
 
-		node = node->right_node;
+		if (node->nodes_count) {
+			node->children = calloc(node->nodes_count,
+						sizeof(*node->children));
+			if (!node->children) {
+				perror("calloc");
+				exit(1);
+			}
+			node->nodes_count = 0;
+		}
 	}
+	for (i = 0; i < cls_nodes_count; i++) {
+		struct graph_node *parent = parents[i];
+
+		if (parent)
+			parent->children[parent->nodes_count++] = cls_nodes[i];
+	}
+	for (i = 0; i < cls_nodes_count; i++)
+		if (cls_nodes[i]->nodes_count > 1)
+			qsort(cls_nodes[i]->children, cls_nodes[i]->nodes_count,
+			      sizeof(struct graph_node *), graph_node_cmp);
+	qsort(roots, n, sizeof(*roots), graph_node_cmp);
+
+	free(parents);
+	free(hash);
+
+	*nroots = n;
+	return roots;
+}
 
-	if (is_newline) {
-		if (node->hlist.next && node->nodes_count)
-			strcat(buf, "|    |");
-		else if (node->hlist.next)
-			strcat(buf, "|     ");
-		else if (node->nodes_count)
-			strcat(buf, "     |");
-		else if (!node->hlist.next)
-			strcat(buf, "      ");
+static void graph_free(struct graph_node **roots)
+{
+	int i;
+
+	for (i = 0; i < cls_nodes_count; i++) {
+		free(cls_nodes[i]->children);
+		free(cls_nodes[i]->msg);
+		free(cls_nodes[i]);
 	}
-	if (add_spaces > 0) {
-		sprintf(spaces, "%-*s", add_spaces, "");
-		strcat(buf, spaces);
+	free(cls_nodes);
+	free(roots);
+	cls_nodes = NULL;
+	cls_nodes_count = cls_nodes_alloc = 0;
+}
+
+/*
+ * Indent stack for the ASCII graph: one 5 column segment per ancestor,
+ * "|    " while that ancestor still has siblings to print below it.
+ */
+struct graph_indent {
+	char *buf;
+	int len;
+	int size;
+};
+
+static void graph_indent_reserve(struct graph_indent *ind, int extra)
+{
+	if (ind->len + extra + 1 <= ind->size)
+		return;
+
+	ind->size = (ind->len + extra + 1) * 2;
+	ind->buf = realloc(ind->buf, ind->size);
+	if (!ind->buf) {
+		perror("realloc");
+		exit(1);
 	}
 }
 
-static void graph_cls_show(FILE *fp, char *buf, struct hlist_head *root_list,
-		int level)
+static void graph_indent_push(struct graph_indent *ind, const char *seg)
+{
+	int len = strlen(seg);
+
+	graph_indent_reserve(ind, len);
+	memcpy(ind->buf + ind->len, seg, len + 1);
+	ind->len += len;
+}
+
+static void graph_indent_pop(struct graph_indent *ind, int len)
+{
+	ind->len -= len;
+	ind->buf[ind->len] = '\0';
+}
+
+/* indent for the lines printed under a class (stats, trailing blank) */
+static void graph_indent_below(struct graph_indent *ind,
+			       struct graph_node *cls, bool last, int spaces)
+{
+	if (!last && cls->nodes_count)
+		graph_indent_push(ind, "|    |");
+	else if (!last)
+		graph_indent_push(ind, "|     ");
+	else if (cls->nodes_count)
+		graph_indent_push(ind, "     |");
+	else
+		graph_indent_push(ind, "      ");
+
+	graph_indent_reserve(ind, spaces);
+	memset(ind->buf + ind->len, ' ', spaces);
+	ind->len += spaces;
+	ind->buf[ind->len] = '\0';
+}
+
+static void graph_cls_show(FILE *fp, struct graph_indent *ind,
+			   struct graph_node **list, int count)
 {
-	struct hlist_node *n, *tmp_cls;
 	char cls_id_str[256] = {};
 	struct rtattr *tb[TCA_MAX + 1];
 	struct qdisc_util *q;
-	char str[300] = {};
-
-	hlist_for_each_safe(n, tmp_cls, root_list) {
-		struct hlist_node *c, *tmp_chld;
-		struct hlist_head children = {};
-		struct graph_node *cls = container_of(n, struct graph_node,
-				hlist);
-
-		hlist_for_each_safe(c, tmp_chld, &cls_list) {
-			struct graph_node *child = container_of(c,
-					struct graph_node, hlist);
-
-			if (cls->id == child->parent_id) {
-				hlist_del(c);
-				hlist_add_head(c, &children);
-				cls->nodes_count++;
-				child->parent_node = cls;
-			}
-		}
+	int i;
 
-		graph_indent(buf, cls, 0, 0);
+	for (i = 0; i < count; i++) {
+		struct graph_node *cls = list[i];
+		struct tcmsg *t = NLMSG_DATA(cls->msg);
+		bool last = i == count - 1;
+		int base = ind->len;
 
 		print_tc_classid(cls_id_str, sizeof(cls_id_str), cls->id);
-		snprintf(str, sizeof(str),
-			 "+---(%s)", cls_id_str);
-		strcat(buf, str);
+		fprintf(fp, "%s+---(%s)", ind->buf, cls_id_str);
 
-		parse_rtattr_flags(tb, TCA_MAX, (struct rtattr *)cls->data,
-				   cls->data_len, NLA_F_NESTED);
+		parse_rtattr_flags(tb, TCA_MAX, TCA_RTA(t),
+				   cls->msg->nlmsg_len - NLMSG_LENGTH(sizeof(*t)),
+				   NLA_F_NESTED);
 
 		if (tb[TCA_KIND] == NULL) {
-			strcat(buf, " [unknown qdisc kind] ");
+			fprintf(fp, " [unknown qdisc kind] ");
 		} else {
 			const char *kind = rta_getattr_str(tb[TCA_KIND]);
 
-			sprintf(str, " %s ", kind);
-			strcat(buf, str);
-			fprintf(fp, "%s", buf);
-			buf[0] = '\0';
+			fprintf(fp, " %s ", kind);
 
 			q = get_qdisc_kind(kind);
-			if (q && q->print_copt) {
+			if (q && q->print_copt)
 				q->print_copt(q, fp, tb[TCA_OPTIONS]);
-			}
 			if (q && show_stats) {
 				int cls_indent = strlen(q->id) - 2 +
 					strlen(cls_id_str);
 				struct rtattr *stats = NULL;
 
-				graph_indent(buf, cls, 1, cls_indent);
+				graph_indent_below(ind, cls, last, cls_indent);
 
 				if (tb[TCA_STATS] || tb[TCA_STATS2]) {
 					fprintf(fp, "\n");
-					print_tcstats_attr(fp, tb, buf, &stats);
-					buf[0] = '\0';
+					print_tcstats_attr(fp, tb, ind->buf,
+							   &stats);
+				} else {
+					fputs(ind->buf, fp);
 				}
-				if (cls->hlist.next || cls->nodes_count) {
-					strcat(buf, "\n");
-					graph_indent(buf, cls, 1, 0);
+				graph_indent_pop(ind, ind->len - base);
+
+				if (!last || cls->nodes_count) {
+					graph_indent_below(ind, cls, last, 0);
+					fprintf(fp, "\n%s", ind->buf);
+					graph_indent_pop(ind, ind->len - base);
 				}
 			}
 		}
-		free(cls->data);
-		fprintf(fp, "%s\n", buf);
-		buf[0] = '\0';
-
-		graph_cls_show(fp, buf, &children, level + 1);
-		if (!cls->hlist.next) {
-			graph_indent(buf, cls, 0, 0);
-			strcat(buf, "\n");
-		}
+		fprintf(fp, "\n");
+
+		graph_indent_push(ind, last ? "     " : "|    ");
+		graph_cls_show(fp, ind, cls->children, cls->nodes_count);
+		graph_indent_pop(ind, ind->len - base);
 
-		fprintf(fp, "%s", buf);
-		buf[0] = '\0';
-		free(cls);
+		if (last)
+			fprintf(fp, "%s\n", ind->buf);
 	}
 }
 
-int print_class(struct nlmsghdr *n, void *arg)
-{
-	FILE *fp = (FILE *)arg;
-	struct tcmsg *t = NLMSG_DATA(n);
-	int len = n->nlmsg_len;
-	struct rtattr *tb[TCA_MAX + 1];
-	struct qdisc_util *q;
-	char abuf[256];
+static int class_print_body(FILE *fp, struct nlmsghdr *n);
 
-	if (n->nlmsg_type != RTM_NEWTCLASS && n->nlmsg_type != RTM_DELTCLASS) {
-		fprintf(stderr, "Not a class\n");
-		return 0;
-	}
-	len -= NLMSG_LENGTH(sizeof(*t));
-	if (len < 0) {
-		fprintf(stderr, "Wrong len %d\n", len);
-		return -1;
+static void graph_cls_json(FILE *fp, struct graph_node **list, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		open_json_object(NULL);
+		class_print_body(fp, list[i]->msg);
+		open_json_array(PRINT_JSON, "children");
+		graph_cls_json(fp, list[i]->children, list[i]->nodes_count);
+		close_json_array(PRINT_JSON, NULL);
+		close_json_object();
 	}
+}
 
-	if (show_graph) {
-		graph_node_add(t->tcm_parent, t->tcm_handle, TCA_RTA(t), len);
-		return 0;
+static void graph_show(FILE *fp)
+{
+	struct graph_indent ind = {};
+	struct graph_node **roots;
+	int nroots;
+
+	roots = graph_build(&nroots);
+
+	if (is_json_context()) {
+		graph_cls_json(fp, roots, nroots);
+	} else {
+		graph_indent_reserve(&ind, 64);
+		ind.buf[0] = '\0';
+		graph_cls_show(fp, &ind, roots, nroots);
+		free(ind.buf);
 	}
 
-	if (filter_qdisc && TC_H_MAJ(t->tcm_handle^filter_qdisc))
-		return 0;
+	graph_free(roots);
+}
 
-	if (filter_classid && t->tcm_handle != filter_classid)
-		return 0;
+static int class_print_body(FILE *fp, struct nlmsghdr *n)
+{
+	struct tcmsg *t = NLMSG_DATA(n);
+	int len = n->nlmsg_len - NLMSG_LENGTH(sizeof(*t));
+	struct rtattr *tb[TCA_MAX + 1];
+	struct qdisc_util *q;
+	char abuf[256];
 
 	parse_rtattr_flags(tb, TCA_MAX, TCA_RTA(t), len, NLA_F_NESTED);
 
@@ -335,7 +500,6 @@ int print_class(struct nlmsghdr *n, void *arg)
 		return -1;
 	}
 
-	open_json_object(NULL);
 	if (n->nlmsg_type == RTM_DELTCLASS)
 		print_null(PRINT_ANY, "deleted", "deleted ", NULL);
 
@@ -385,17 +549,71 @@ int print_class(struct nlmsghdr *n, void *arg)
 		}
 		close_json_object();
 	}
+	return 0;
+}
+
+static int class_match(struct nlmsghdr *n)
+{
+	struct tcmsg *t = NLMSG_DATA(n);
+
+	if (filter_qdisc && TC_H_MAJ(t->tcm_handle^filter_qdisc))
+		return 0;
+
+	if (filter_classid && t->tcm_handle != filter_classid)
+		return 0;
+
+	return 1;
+}
+
+int print_class(struct nlmsghdr *n, void *arg)
+{
+	FILE *fp = (FILE *)arg;
+	struct tcmsg *t = NLMSG_DATA(n);
+	int len = n->nlmsg_len;
+	int ret;
+
+	if (n->nlmsg_type != RTM_NEWTCLASS && n->nlmsg_type != RTM_DELTCLASS) {
+		fprintf(stderr, "Not a class\n");
+		return 0;
+	}
+	len -= NLMSG_LENGTH(sizeof(*t));
+	if (len < 0) {
+		fprintf(stderr, "Wrong len %d\n", len);
+		return -1;
+	}
+
+	if (show_graph) {
+		graph_node_add(n);
+		return 0;
+	}
+
+	if (!class_match(n))
+		return 0;
+
+	if (brief && show_stats && n->nlmsg_type == RTM_NEWTCLASS) {
+		char abuf[64];
+
+		print_tc_classid(abuf, sizeof(abuf),
+				 filter_qdisc ? TC_H_MIN(t->tcm_handle) :
+				 t->tcm_handle);
+		return print_tcstats_brief(fp, "class", abuf,
+					   filter_ifindex ? 0 : t->tcm_ifindex,
+					   t, len);
+	}
+
+	open_json_object(NULL);
+	ret = class_print_body(fp, n);
 	close_json_object();
 	fflush(fp);
-	return 0;
+	return ret;
 }
 
 
 static int tc_class_list(int argc, char **argv)
 {
 	struct tcmsg t = { .tcm_family = AF_UNSPEC };
+	unsigned int interval = 0, count = 0;
 	char d[IFNAMSIZ] = {};
-	char buf[1024] = {0};
 
 	filter_qdisc = 0;
 	filter_classid = 0;
@@ -433,6 +651,14 @@ static int tc_class_list(int argc, char **argv)
 			if (get_tc_classid(&handle, *argv))
 				invarg("invalid parent ID", *argv);
 			t.tcm_parent = handle;
+		} else if (strcmp(*argv, "interval") == 0) {
+			NEXT_ARG();
+			if (get_unsigned(&interval, *argv, 0) || !interval)
+				invarg("invalid interval", *argv);
+		} else if (strcmp(*argv, "count") == 0) {
+			NEXT_ARG();
+			if (get_unsigned(&count, *argv, 0))
+				invarg("invalid count", *argv);
 		} else if (matches(*argv, "help") == 0) {
 			usage();
 		} else {
@@ -452,6 +678,15 @@ static int tc_class_list(int argc, char **argv)
 		filter_ifindex = t.tcm_ifindex;
 	}
 
+	if (interval) {
+		if (!show_stats) {
+			fprintf(stderr, "\"interval\" needs -s\n");
+			return -1;
+		}
+		return tc_sample_stats(RTM_GETTCLASS, &t, sizeof(t),
+				       class_match, interval, count);
+	}
+
 	if (rtnl_dump_request(&rth, RTM_GETTCLASS, &t, sizeof(t)) < 0) {
 		perror("Cannot send dump request");
 		return 1;
@@ -462,10 +697,9 @@ static int tc_class_list(int argc, char **argv)
 		delete_json_obj();
 		return 1;
 	}
-	delete_json_obj();
-
 	if (show_graph)
-		graph_cls_show(stdout, &buf[0], &root_cls_list, 0);
+		graph_show(stdout);
+	delete_json_obj();
 
 	return 0;
 }
@@ -476,13 +710,13 @@ int do_class(int argc, char **argv)
 		return tc_class_list(0, NULL);
 	if (matches(*argv, "add") == 0)
 		//实现class的修改添加
-		return tc_class_modify(RTM_NEWTCLASS, NLM_F_EXCL|NLM_F_CREATE, argc-1, argv+1);
+		return tc_class_modify(RTM_NEWTCLASS, NLM_F_EXCL|NLM_F_CREATE, argc-1, argv+1, NULL);
 	if (matches(*argv, "change") == 0)
-		return tc_class_modify(RTM_NEWTCLASS, 0, argc-1, argv+1);
+		return tc_class_modify(RTM_NEWTCLASS, 0, argc-1, argv+1, NULL);
 	if (matches(*argv, "replace") == 0)
-		return tc_class_modify(RTM_NEWTCLASS, NLM_F_CREATE, argc-1, argv+1);
+		return tc_class_modify(RTM_NEWTCLASS, NLM_F_CREATE, argc-1, argv+1, NULL);
 	if (matches(*argv, "delete") == 0)
-		return tc_class_modify(RTM_DELTCLASS, 0,  argc-1, argv+1);
+		return tc_class_modify(RTM_DELTCLASS, 0,  argc-1, argv+1, NULL);
 	if (matches(*argv, "list") == 0 || matches(*argv, "show") == 0
 	    || matches(*argv, "lst") == 0)
 		return tc_class_list(argc-1, argv+1);
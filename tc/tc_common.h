@@ -11,12 +11,27 @@ int do_chain(int argc, char **argv);
 int do_action(int argc, char **argv);
 int do_tcmonitor(int argc, char **argv);
 int do_exec(int argc, char **argv);
+int do_flower(int argc, char **argv);
+int do_tree(int argc, char **argv);
+int do_u32(int argc, char **argv);
+int tc_filter_analyze(int argc, char **argv);
 
 int print_action(struct nlmsghdr *n, void *arg);
 int print_filter(struct nlmsghdr *n, void *arg);
 int print_qdisc(struct nlmsghdr *n, void *arg);
 int print_class(struct nlmsghdr *n, void *arg);
+
+/* build the request into @out instead of sending it when @out is set */
+int tc_qdisc_modify(int cmd, unsigned int flags, int argc, char **argv,
+		    struct nlmsghdr *out);
+int tc_class_modify(int cmd, unsigned int flags, int argc, char **argv,
+		    struct nlmsghdr *out);
+int tc_filter_modify(int cmd, unsigned int flags, int argc, char **argv,
+		     struct nlmsghdr *out);
 void print_size_table(struct rtattr *rta);
+int tc_sample_stats(int type, void *req, int len,
+		    int (*match)(struct nlmsghdr *n),
+		    unsigned int interval, unsigned int count);
 
 struct tc_estimator;
 int parse_estimator(int *p_argc, char ***p_argv, struct tc_estimator *est);
@@ -122,35 +122,30 @@ int tc_calc_rtable(struct tc_ratespec *r, __u32 *rtab,
 		   int cell_log, unsigned int mtu,
 		   enum link_layer linklayer)
 {
-	int i;
-	unsigned int sz;
-	unsigned int bps = r->rate;
-	unsigned int mpu = r->mpu;
-
-	if (mtu == 0)
-		mtu = 2047;
-
-	if (cell_log < 0) {
-		cell_log = 0;
-		while ((mtu >> cell_log) > 255)
-			cell_log++;
-	}
+	return tc_calc_rtable_64(r, rtab, cell_log, mtu, linklayer, r->rate);
+}
 
-	for (i = 0; i < 256; i++) {
-		sz = tc_adjust_size((i + 1) << cell_log, mpu, linklayer);
-		rtab[i] = tc_calc_xmittime(bps, sz);
-	}
+/*
+ * The classes of a big tree mostly share a handful of rates, so the last
+ * few tables are kept around and a batch or a tree apply does not redo
+ * the same 256 divisions for every class.
+ */
+#define RTAB_CACHE_SIZE	16
 
-	r->cell_align =  -1;
-	r->cell_log = cell_log;
-	r->linklayer = (linklayer & TC_LINKLAYER_MASK);
-	return cell_log;
-}
+static struct rtab_cache_entry {
+	__u64		rate;
+	unsigned int	mpu;
+	int		cell_log;
+	enum link_layer	linklayer;
+	bool		valid;
+	__u32		rtab[256];
+} rtab_cache[RTAB_CACHE_SIZE];
 
 int tc_calc_rtable_64(struct tc_ratespec *r, __u32 *rtab,
 		   int cell_log, unsigned int mtu,
 		   enum link_layer linklayer, __u64 rate)
 {
+	struct rtab_cache_entry *c;
 	int i;
 	unsigned int sz;
 	__u64 bps = rate;
@@ -165,9 +160,22 @@ int tc_calc_rtable_64(struct tc_ratespec *r, __u32 *rtab,
 			cell_log++;
 	}
 
-	for (i = 0; i < 256; i++) {
-		sz = tc_adjust_size((i + 1) << cell_log, mpu, linklayer);
-		rtab[i] = tc_calc_xmittime(bps, sz);
+	c = &rtab_cache[(rate ^ rate >> 20 ^ mpu ^ cell_log) % RTAB_CACHE_SIZE];
+	if (c->valid && c->rate == rate && c->mpu == mpu &&
+	    c->cell_log == cell_log && c->linklayer == linklayer) {
+		memcpy(rtab, c->rtab, sizeof(c->rtab));
+	} else {
+		for (i = 0; i < 256; i++) {
+			sz = tc_adjust_size((i + 1) << cell_log, mpu,
+					    linklayer);
+			rtab[i] = tc_calc_xmittime(bps, sz);
+		}
+		c->rate = rate;
+		c->mpu = mpu;
+		c->cell_log = cell_log;
+		c->linklayer = linklayer;
+		c->valid = true;
+		memcpy(c->rtab, rtab, sizeof(c->rtab));
 	}
 
 	r->cell_align = -1;
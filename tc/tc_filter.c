@@ -34,6 +34,8 @@ static void usage(void)
 		"\n"
 		"       tc filter show [ dev STRING ] [ root | ingress | egress | parent CLASSID ]\n"
 		"       tc filter show [ block BLOCK_INDEX ]\n"
+		"       tc filter analyze dev STRING [ root | ingress | egress | parent CLASSID ]\n"
+		"       [ chain CHAIN_INDEX ]\n"
 		"Where:\n"
 		"FILTER_TYPE := { rsvp | u32 | bpf | fw | route | etc. }\n"
 		"FILTERID := ... format depends on classifier, see there\n"
@@ -53,7 +55,8 @@ struct tc_filter_req {
 	char			buf[MAX_MSG];
 };
 
-static int tc_filter_modify(int cmd, unsigned int flags, int argc, char **argv)
+int tc_filter_modify(int cmd, unsigned int flags, int argc, char **argv,
+		     struct nlmsghdr *out)
 {
 	struct {
 		struct nlmsghdr	n;
@@ -238,6 +241,11 @@ static int tc_filter_modify(int cmd, unsigned int flags, int argc, char **argv)
 	if (est.ewma_log)
 		addattr_l(&req.n, sizeof(req), TCA_RATE, &est, sizeof(est));
 
+	if (out) {
+		memcpy(out, &req.n, req.n.nlmsg_len);
+		return 0;
+	}
+
 	//已完成netlink消息填充，向kernel执行netlink通信
 	if (rtnl_talk(&rth, &req.n, NULL/*未提取响应*/) < 0) {
 		fprintf(stderr, "We have an error talking to the kernel\n");
@@ -772,20 +780,22 @@ int do_filter(int argc, char **argv)
 	if (matches(*argv, "add") == 0)
 		//做filter添加工作
 		return tc_filter_modify(RTM_NEWTFILTER, NLM_F_EXCL|NLM_F_CREATE,
-					argc-1, argv+1);
+					argc-1, argv+1, NULL);
 	if (matches(*argv, "change") == 0)
-		return tc_filter_modify(RTM_NEWTFILTER, 0, argc-1, argv+1);
+		return tc_filter_modify(RTM_NEWTFILTER, 0, argc-1, argv+1, NULL);
 	if (matches(*argv, "replace") == 0)
 		return tc_filter_modify(RTM_NEWTFILTER, NLM_F_CREATE, argc-1,
-					argv+1);
+					argv+1, NULL);
 	if (matches(*argv, "delete") == 0)
-		return tc_filter_modify(RTM_DELTFILTER, 0,  argc-1, argv+1);
+		return tc_filter_modify(RTM_DELTFILTER, 0,  argc-1, argv+1, NULL);
 	if (matches(*argv, "get") == 0)
 		return tc_filter_get(RTM_GETTFILTER, 0,  argc-1, argv+1);
 	//显示为tc下发的filter
 	if (matches(*argv, "list") == 0 || matches(*argv, "show") == 0
 	    || matches(*argv, "lst") == 0)
 		return tc_filter_list(RTM_GETTFILTER, argc-1, argv+1);
+	if (strcmp(*argv, "analyze") == 0)
+		return tc_filter_analyze(argc-1, argv+1);
 	if (matches(*argv, "help") == 0) {
 		usage();
 		return 0;
@@ -801,10 +811,10 @@ int do_chain(int argc, char **argv)
 		return tc_filter_list(RTM_GETCHAIN, 0, NULL);
 	if (matches(*argv, "add") == 0) {
 		return tc_filter_modify(RTM_NEWCHAIN, NLM_F_EXCL | NLM_F_CREATE,
-					argc - 1, argv + 1);
+					argc - 1, argv + 1, NULL);
 	} else if (matches(*argv, "delete") == 0) {
 		return tc_filter_modify(RTM_DELCHAIN, 0,
-					argc - 1, argv + 1);
+					argc - 1, argv + 1, NULL);
 	} else if (matches(*argv, "get") == 0) {
 		return tc_filter_get(RTM_GETCHAIN, 0,
 				     argc - 1, argv + 1);
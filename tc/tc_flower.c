@@ -0,0 +1,1302 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * tc_flower.c		"tc flower compile": install a flower rule table with
+ *			as few masks per chain as possible.
+ *
+ * The cost of a flower lookup grows with the number of distinct masks
+ * that have to be tried in a chain.  The compiler parses every rule with
+ * the regular flower parser, derives its kernel mask, and then
+ *
+ *  - splits IPv4/IPv6 rules by ip_proto into per-protocol chains, reached
+ *    from the entry chain through a single-mask goto dispatch (rules that
+ *    leave ip_proto open are copied into every branch),
+ *  - stacks the rules of each chain into priorities holding one mask
+ *    each, moving a rule to a later priority only when it overlaps an
+ *    earlier rule with a different mask,
+ *  - drops rules that are completely covered by an earlier rule,
+ *  - gives single-mask chains a chain template,
+ *
+ * and installs the result with pipelined requests.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/pkt_cls.h>
+
+#include "rt_names.h"
+#include "utils.h"
+#include "tc_util.h"
+#include "tc_common.h"
+#include "tc_flower.h"
+
+struct flower_keydesc {
+	__u16	key;
+	__u16	mask;	/* 0: implicit full mask */
+	__u16	len;
+};
+
+static const struct flower_keydesc flower_keys[] = {
+	{ TCA_FLOWER_KEY_ETH_DST, TCA_FLOWER_KEY_ETH_DST_MASK, 6 },
+	{ TCA_FLOWER_KEY_ETH_SRC, TCA_FLOWER_KEY_ETH_SRC_MASK, 6 },
+	{ TCA_FLOWER_KEY_ETH_TYPE, 0, 2 },
+	{ TCA_FLOWER_KEY_IP_PROTO, 0, 1 },
+	{ TCA_FLOWER_KEY_IPV4_SRC, TCA_FLOWER_KEY_IPV4_SRC_MASK, 4 },
+	{ TCA_FLOWER_KEY_IPV4_DST, TCA_FLOWER_KEY_IPV4_DST_MASK, 4 },
+	{ TCA_FLOWER_KEY_IPV6_SRC, TCA_FLOWER_KEY_IPV6_SRC_MASK, 16 },
+	{ TCA_FLOWER_KEY_IPV6_DST, TCA_FLOWER_KEY_IPV6_DST_MASK, 16 },
+	{ TCA_FLOWER_KEY_TCP_SRC, TCA_FLOWER_KEY_TCP_SRC_MASK, 2 },
+	{ TCA_FLOWER_KEY_TCP_DST, TCA_FLOWER_KEY_TCP_DST_MASK, 2 },
+	{ TCA_FLOWER_KEY_UDP_SRC, TCA_FLOWER_KEY_UDP_SRC_MASK, 2 },
+	{ TCA_FLOWER_KEY_UDP_DST, TCA_FLOWER_KEY_UDP_DST_MASK, 2 },
+	{ TCA_FLOWER_KEY_SCTP_SRC, TCA_FLOWER_KEY_SCTP_SRC_MASK, 2 },
+	{ TCA_FLOWER_KEY_SCTP_DST, TCA_FLOWER_KEY_SCTP_DST_MASK, 2 },
+	{ TCA_FLOWER_KEY_VLAN_ID, 0, 2 },
+	{ TCA_FLOWER_KEY_VLAN_PRIO, 0, 1 },
+	{ TCA_FLOWER_KEY_VLAN_ETH_TYPE, 0, 2 },
+	{ TCA_FLOWER_KEY_CVLAN_ID, 0, 2 },
+	{ TCA_FLOWER_KEY_CVLAN_PRIO, 0, 1 },
+	{ TCA_FLOWER_KEY_CVLAN_ETH_TYPE, 0, 2 },
+	{ TCA_FLOWER_KEY_ENC_KEY_ID, 0, 4 },
+	{ TCA_FLOWER_KEY_ENC_IPV4_SRC, TCA_FLOWER_KEY_ENC_IPV4_SRC_MASK, 4 },
+	{ TCA_FLOWER_KEY_ENC_IPV4_DST, TCA_FLOWER_KEY_ENC_IPV4_DST_MASK, 4 },
+	{ TCA_FLOWER_KEY_ENC_IPV6_SRC, TCA_FLOWER_KEY_ENC_IPV6_SRC_MASK, 16 },
+	{ TCA_FLOWER_KEY_ENC_IPV6_DST, TCA_FLOWER_KEY_ENC_IPV6_DST_MASK, 16 },
+	{ TCA_FLOWER_KEY_ENC_UDP_SRC_PORT,
+	  TCA_FLOWER_KEY_ENC_UDP_SRC_PORT_MASK, 2 },
+	{ TCA_FLOWER_KEY_ENC_UDP_DST_PORT,
+	  TCA_FLOWER_KEY_ENC_UDP_DST_PORT_MASK, 2 },
+	{ TCA_FLOWER_KEY_ENC_IP_TOS, TCA_FLOWER_KEY_ENC_IP_TOS_MASK, 1 },
+	{ TCA_FLOWER_KEY_ENC_IP_TTL, TCA_FLOWER_KEY_ENC_IP_TTL_MASK, 1 },
+	{ TCA_FLOWER_KEY_FLAGS, TCA_FLOWER_KEY_FLAGS_MASK, 4 },
+	{ TCA_FLOWER_KEY_ICMPV4_CODE, TCA_FLOWER_KEY_ICMPV4_CODE_MASK, 1 },
+	{ TCA_FLOWER_KEY_ICMPV4_TYPE, TCA_FLOWER_KEY_ICMPV4_TYPE_MASK, 1 },
+	{ TCA_FLOWER_KEY_ICMPV6_CODE, TCA_FLOWER_KEY_ICMPV6_CODE_MASK, 1 },
+	{ TCA_FLOWER_KEY_ICMPV6_TYPE, TCA_FLOWER_KEY_ICMPV6_TYPE_MASK, 1 },
+	{ TCA_FLOWER_KEY_ARP_SIP, TCA_FLOWER_KEY_ARP_SIP_MASK, 4 },
+	{ TCA_FLOWER_KEY_ARP_TIP, TCA_FLOWER_KEY_ARP_TIP_MASK, 4 },
+	{ TCA_FLOWER_KEY_ARP_OP, TCA_FLOWER_KEY_ARP_OP_MASK, 1 },
+	{ TCA_FLOWER_KEY_ARP_SHA, TCA_FLOWER_KEY_ARP_SHA_MASK, 6 },
+	{ TCA_FLOWER_KEY_ARP_THA, TCA_FLOWER_KEY_ARP_THA_MASK, 6 },
+	{ TCA_FLOWER_KEY_MPLS_TTL, 0, 1 },
+	{ TCA_FLOWER_KEY_MPLS_BOS, 0, 1 },
+	{ TCA_FLOWER_KEY_MPLS_TC, 0, 1 },
+	{ TCA_FLOWER_KEY_MPLS_LABEL, 0, 4 },
+	{ TCA_FLOWER_KEY_TCP_FLAGS, TCA_FLOWER_KEY_TCP_FLAGS_MASK, 2 },
+	{ TCA_FLOWER_KEY_IP_TOS, TCA_FLOWER_KEY_IP_TOS_MASK, 1 },
+	{ TCA_FLOWER_KEY_IP_TTL, TCA_FLOWER_KEY_IP_TTL_MASK, 1 },
+	{ TCA_FLOWER_KEY_CT_STATE, TCA_FLOWER_KEY_CT_STATE_MASK, 2 },
+	{ TCA_FLOWER_KEY_CT_ZONE, TCA_FLOWER_KEY_CT_ZONE_MASK, 2 },
+	{ TCA_FLOWER_KEY_CT_MARK, TCA_FLOWER_KEY_CT_MARK_MASK, 4 },
+	{ TCA_FLOWER_KEY_CT_LABELS, TCA_FLOWER_KEY_CT_LABELS_MASK, 16 },
+	{ TCA_FLOWER_KEY_HASH, TCA_FLOWER_KEY_HASH_MASK, 4 },
+	{ TCA_FLOWER_KEY_NUM_OF_VLANS, 0, 1 },
+	{ TCA_FLOWER_KEY_PPPOE_SID, 0, 2 },
+	{ TCA_FLOWER_KEY_PPP_PROTO, 0, 2 },
+	{ TCA_FLOWER_KEY_L2TPV3_SID, 0, 4 },
+};
+
+/* attribute type -> index into flower_keys, for keys and for masks */
+static signed char flower_key_idx[TCA_FLOWER_MAX + 1];
+static signed char flower_mask_idx[TCA_FLOWER_MAX + 1];
+static __u16 flower_key_off[ARRAY_SIZE(flower_keys)];
+static int flower_keyvec_used;
+
+static void flower_keyvec_init(void)
+{
+	int i, off = 0;
+
+	if (flower_keyvec_used)
+		return;
+
+	memset(flower_key_idx, -1, sizeof(flower_key_idx));
+	memset(flower_mask_idx, -1, sizeof(flower_mask_idx));
+	for (i = 0; i < ARRAY_SIZE(flower_keys); i++) {
+		flower_key_idx[flower_keys[i].key] = i;
+		if (flower_keys[i].mask)
+			flower_mask_idx[flower_keys[i].mask] = i;
+		flower_key_off[i] = off;
+		off += flower_keys[i].len;
+	}
+	if (off > FLOWER_KEYVEC_LEN) {
+		fprintf(stderr, "BUG: flower key vector too small (%d)\n", off);
+		exit(1);
+	}
+	flower_keyvec_used = off;
+}
+
+/* Bytes of the key vector that are in use */
+int flower_keyvec_len(void)
+{
+	flower_keyvec_init();
+	return flower_keyvec_used;
+}
+
+static void flower_keyvec_extra(struct flower_keyvec *kv, __u16 type,
+				const void *data, __u16 len)
+{
+	if (kv->extra_len + 4 + len > sizeof(kv->extra))
+		len = 0;
+	if (kv->extra_len + 4 > sizeof(kv->extra))
+		return;
+
+	memcpy(kv->extra + kv->extra_len, &type, 2);
+	memcpy(kv->extra + kv->extra_len + 2, &len, 2);
+	if (len)
+		memcpy(kv->extra + kv->extra_len + 4, data, len);
+	kv->extra_len += 4 + len;
+	kv->inexact = true;
+}
+
+int flower_keyvec_parse(struct rtattr *opts, struct flower_keyvec *kv)
+{
+	struct rtattr *tb[TCA_FLOWER_MAX + 1];
+	int type, i;
+
+	flower_keyvec_init();
+
+	memset(kv->key, 0, sizeof(kv->key));
+	memset(kv->mask, 0, sizeof(kv->mask));
+	kv->extra_len = 0;
+	kv->inexact = false;
+
+	if (!opts)
+		return 0;
+	parse_rtattr_nested(tb, TCA_FLOWER_MAX, opts);
+
+	for (type = 1; type <= TCA_FLOWER_MAX; type++) {
+		const struct flower_keydesc *d;
+		int len, off;
+
+		if (!tb[type])
+			continue;
+
+		if (flower_key_idx[type] >= 0) {
+			d = &flower_keys[flower_key_idx[type]];
+			off = flower_key_off[flower_key_idx[type]];
+			len = RTA_PAYLOAD(tb[type]);
+			if (len > d->len)
+				len = d->len;
+
+			memcpy(kv->key + off, RTA_DATA(tb[type]), len);
+			if (d->mask && tb[d->mask])
+				memcpy(kv->mask + off, RTA_DATA(tb[d->mask]),
+				       min(len, (int)RTA_PAYLOAD(tb[d->mask])));
+			else
+				memset(kv->mask + off, 0xff, len);
+			for (i = off; i < off + len; i++)
+				kv->key[i] &= kv->mask[i];
+			continue;
+		}
+		if (flower_mask_idx[type] >= 0)
+			continue;
+
+		switch (type) {
+		case TCA_FLOWER_ACT:
+		case TCA_FLOWER_CLASSID:
+		case TCA_FLOWER_FLAGS:
+		case TCA_FLOWER_IN_HW_COUNT:
+			break;
+		case TCA_FLOWER_INDEV:
+		case TCA_FLOWER_KEY_PORT_SRC_MIN:
+		case TCA_FLOWER_KEY_PORT_SRC_MAX:
+		case TCA_FLOWER_KEY_PORT_DST_MIN:
+		case TCA_FLOWER_KEY_PORT_DST_MAX:
+			/* full mask whatever the value */
+			flower_keyvec_extra(kv, type, NULL, 0);
+			break;
+		default:
+			flower_keyvec_extra(kv, type, RTA_DATA(tb[type]),
+					    RTA_PAYLOAD(tb[type]));
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/* Can a packet match both (k1, m1) and (k2, m2)? */
+bool flower_keyvec_overlap(const __u8 *k1, const __u8 *m1,
+			   const __u8 *k2, const __u8 *m2)
+{
+	int i;
+
+	for (i = 0; i < flower_keyvec_used; i++)
+		if ((k1[i] ^ k2[i]) & m1[i] & m2[i])
+			return false;
+	return true;
+}
+
+/* Does mask m1 only look at bits that m2 looks at too? */
+bool flower_keyvec_subset(const __u8 *m1, const __u8 *m2)
+{
+	int i;
+
+	for (i = 0; i < flower_keyvec_used; i++)
+		if (m1[i] & ~m2[i])
+			return false;
+	return true;
+}
+
+#define FC_WINDOW	1024
+#define FC_SIG_HASH	1024
+
+struct fc_rule {
+	unsigned int	line;
+	__u16		protocol;
+	bool		terminal;
+	int		ip_proto;
+	int		argc;
+	int		tmpl_argc;
+	char		**argv;
+	struct nlmsghdr	*n;
+	__u8		*key;
+	int		sig;
+	int		placed;
+	int		shadowed;
+	unsigned int	shadowed_by;
+};
+
+struct fc_sig {
+	__u16		protocol;
+	unsigned int	hash;
+	int		next;
+	struct flower_keyvec kv;
+};
+
+/* rules of a group projected on a common mask, for overlap lookups */
+struct fc_proj {
+	__u8		cmask[FLOWER_KEYVEC_LEN];
+	int		*slot;
+	unsigned int	size;
+	unsigned int	count;
+};
+
+struct fc_group {
+	int		sig;
+	__u32		chain;
+	__u32		prio;
+	int		*rules;
+	int		nrules;
+	int		alloc;
+	struct fc_proj	*proj;
+	int		nproj;
+};
+
+struct fc_bucket {
+	__u16		protocol;
+	int		ip_proto;	/* -1: catch all */
+	__u32		chain;
+	__u32		prio;		/* of the goto in the entry chain */
+	int		*groups;
+	int		ngroups;
+	int		alloc;
+};
+
+struct fc_ctx {
+	struct filter_util *q;
+	int		ifindex;
+	__u32		parent;
+	const char	*dev;
+	const char	*parent_str;
+	__u32		chain;
+	__u32		chain_base;
+	__u32		prio;
+	__u16		protocol;
+	bool		dry_run;
+
+	struct fc_rule	*rules;
+	int		nrules;
+	int		rules_alloc;
+
+	struct fc_sig	*sigs;
+	int		nsigs;
+	int		sigs_alloc;
+	int		sig_head[FC_SIG_HASH];
+
+	struct fc_group	*groups;
+	int		ngroups;
+	int		groups_alloc;
+
+	struct fc_bucket *buckets;
+	int		nbuckets;
+
+	struct rtnl_pipe *pipe;
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: tc flower compile dev STRING { ingress | egress | root | parent CLASSID }\n"
+		"	file FILE [ protocol PROTO ] [ chain CHAIN_INDEX ] [ chain-base CHAIN_INDEX ]\n"
+		"	[ prio PRIO ] [ window NUMBER ] [ dry-run ]\n"
+		"\n"
+		"FILE is a CSV table with a header line naming the columns. \"protocol\"\n"
+		"and \"action\" are special, \"flags\" is passed as is, every other column\n"
+		"is a flower match keyword and an empty cell leaves the key unmatched.\n");
+}
+
+static int fc_sig_get(struct fc_ctx *ctx, __u16 protocol,
+		      const struct flower_keyvec *kv)
+{
+	unsigned int h = tc_masked_hash(kv->mask, kv->mask,
+					flower_keyvec_used) ^ protocol;
+	struct fc_sig *s;
+	int i;
+
+	h ^= kv->extra_len;
+	for (i = 0; i < kv->extra_len; i++)
+		h = (h ^ kv->extra[i]) * 16777619U;
+
+	for (i = ctx->sig_head[h % FC_SIG_HASH]; i >= 0; i = s->next) {
+		s = &ctx->sigs[i];
+		if (s->hash == h && s->protocol == protocol &&
+		    s->kv.extra_len == kv->extra_len &&
+		    !memcmp(s->kv.mask, kv->mask, flower_keyvec_used) &&
+		    !memcmp(s->kv.extra, kv->extra, kv->extra_len))
+			return i;
+	}
+
+	ctx->sigs = tc_grow(ctx->sigs, &ctx->sigs_alloc, ctx->nsigs + 1,
+			    sizeof(*ctx->sigs));
+	s = &ctx->sigs[ctx->nsigs];
+	s->protocol = protocol;
+	s->hash = h;
+	s->kv = *kv;
+	s->next = ctx->sig_head[h % FC_SIG_HASH];
+	ctx->sig_head[h % FC_SIG_HASH] = ctx->nsigs;
+
+	return ctx->nsigs++;
+}
+
+static struct nlmsghdr *fc_build(struct fc_ctx *ctx, int cmd, __u16 protocol,
+				 __u32 chain, __u32 prio, int argc, char **argv)
+{
+	struct {
+		struct nlmsghdr	n;
+		struct tcmsg	t;
+		char		buf[MAX_MSG];
+	} req = {
+		.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg)),
+		.n.nlmsg_flags = NLM_F_REQUEST | NLM_F_EXCL | NLM_F_CREATE,
+		.n.nlmsg_type = cmd,
+		.t.tcm_family = AF_UNSPEC,
+		.t.tcm_ifindex = ctx->ifindex,
+		.t.tcm_parent = ctx->parent,
+		.t.tcm_info = TC_H_MAKE(prio << 16, protocol),
+	};
+	struct nlmsghdr *n;
+
+	/* TCA_CHAIN goes first so that it can be patched in place later */
+	addattr32(&req.n, sizeof(req), TCA_CHAIN, chain);
+	addattr_l(&req.n, sizeof(req), TCA_KIND, "flower", sizeof("flower"));
+
+	if (ctx->q->parse_fopt(ctx->q, NULL, argc, argv, &req.n))
+		return NULL;
+
+	n = malloc(req.n.nlmsg_len);
+	if (!n) {
+		perror("malloc");
+		exit(1);
+	}
+	memcpy(n, &req.n, req.n.nlmsg_len);
+	return n;
+}
+
+static void fc_set_place(struct nlmsghdr *n, __u32 chain, __u32 prio)
+{
+	struct tcmsg *t = NLMSG_DATA(n);
+
+	t->tcm_info = TC_H_MAKE(prio << 16, TC_H_MIN(t->tcm_info));
+	*(__u32 *)RTA_DATA(TCA_RTA(t)) = chain;
+}
+
+/* CSV field splitter: handles "quoted, fields" and "" escapes */
+static int fc_csv_split(char *line, char **fields, int max)
+{
+	char *p = line, *out;
+	int n = 0;
+
+	while (n < max) {
+		while (*p == ' ' || *p == '\t')
+			p++;
+		fields[n++] = out = p;
+
+		if (*p == '"') {
+			fields[n - 1] = out = ++p;
+			while (*p) {
+				if (*p == '"' && p[1] == '"') {
+					*out++ = '"';
+					p += 2;
+				} else if (*p == '"') {
+					p++;
+					break;
+				} else {
+					*out++ = *p++;
+				}
+			}
+			while (*p && *p != ',')
+				p++;
+		} else {
+			while (*p && *p != ',')
+				p++;
+			out = p;
+			while (out > fields[n - 1] && isspace(out[-1]))
+				out--;
+		}
+
+		if (*p == ',') {
+			*out = '\0';
+			p++;
+			continue;
+		}
+		*out = '\0';
+		break;
+	}
+	return n;
+}
+
+static void fc_push_words(char ***argv, int *argc, int *alloc, char *str)
+{
+	char *tok;
+
+	for (tok = strtok(str, " \t"); tok; tok = strtok(NULL, " \t")) {
+		*argv = tc_grow(*argv, alloc, *argc + 2, sizeof(char *));
+		(*argv)[(*argc)++] = strdup(tok);
+		(*argv)[*argc] = NULL;
+	}
+}
+
+static void fc_push_word(char ***argv, int *argc, int *alloc, const char *str)
+{
+	*argv = tc_grow(*argv, alloc, *argc + 2, sizeof(char *));
+	(*argv)[(*argc)++] = strdup(str);
+	(*argv)[*argc] = NULL;
+}
+
+static int fc_rule_add(struct fc_ctx *ctx, unsigned int line,
+		       char **cols, char **vals, int ncols)
+{
+	struct fc_rule *r;
+	struct flower_keyvec kv;
+	struct rtattr *tb[TCA_MAX + 1];
+	struct rtattr *ftb[TCA_FLOWER_MAX + 1];
+	struct tcmsg *t;
+	char *action = NULL, *flags = NULL;
+	int alloc = 0, i;
+
+	ctx->rules = tc_grow(ctx->rules, &ctx->rules_alloc, ctx->nrules + 1,
+			     sizeof(*ctx->rules));
+	r = &ctx->rules[ctx->nrules];
+	memset(r, 0, sizeof(*r));
+	r->line = line;
+	r->protocol = ctx->protocol;
+	r->terminal = true;
+
+	for (i = 0; i < ncols; i++) {
+		char *v = vals[i];
+
+		if (!v || !*v)
+			continue;
+
+		if (!strcmp(cols[i], "protocol")) {
+			__u16 id;
+
+			if (ll_proto_a2n(&id, v)) {
+				fprintf(stderr, "line %u: invalid protocol \"%s\"\n",
+					line, v);
+				return -1;
+			}
+			r->protocol = id;
+		} else if (!strcmp(cols[i], "action")) {
+			action = v;
+		} else if (!strcmp(cols[i], "flags")) {
+			flags = v;
+		} else {
+			fc_push_word(&r->argv, &r->argc, &alloc, cols[i]);
+			fc_push_words(&r->argv, &r->argc, &alloc, v);
+		}
+	}
+	r->tmpl_argc = r->argc;
+	if (flags)
+		fc_push_words(&r->argv, &r->argc, &alloc, flags);
+	if (action) {
+		fc_push_word(&r->argv, &r->argc, &alloc, "action");
+		fc_push_words(&r->argv, &r->argc, &alloc, action);
+		for (i = r->tmpl_argc; i < r->argc; i++)
+			if (!strcmp(r->argv[i], "continue") ||
+			    !strcmp(r->argv[i], "reclassify"))
+				r->terminal = false;
+	}
+
+	r->n = fc_build(ctx, RTM_NEWTFILTER, r->protocol, 0, 0,
+			r->argc, r->argv);
+	if (!r->n) {
+		fprintf(stderr, "line %u: cannot parse rule\n", line);
+		return -1;
+	}
+
+	t = NLMSG_DATA(r->n);
+	parse_rtattr(tb, TCA_MAX, TCA_RTA(t),
+		     r->n->nlmsg_len - NLMSG_LENGTH(sizeof(*t)));
+	flower_keyvec_parse(tb[TCA_OPTIONS], &kv);
+
+	r->ip_proto = -1;
+	if (tb[TCA_OPTIONS]) {
+		parse_rtattr_nested(ftb, TCA_FLOWER_MAX, tb[TCA_OPTIONS]);
+		if (ftb[TCA_FLOWER_KEY_IP_PROTO])
+			r->ip_proto = rta_getattr_u8(ftb[TCA_FLOWER_KEY_IP_PROTO]);
+		/* skip_sw rules are not there to stop the software lookup */
+		if (ftb[TCA_FLOWER_FLAGS] &&
+		    rta_getattr_u32(ftb[TCA_FLOWER_FLAGS]))
+			r->terminal = false;
+	}
+
+	r->key = malloc(flower_keyvec_used);
+	if (!r->key) {
+		perror("malloc");
+		exit(1);
+	}
+	memcpy(r->key, kv.key, flower_keyvec_used);
+	r->sig = fc_sig_get(ctx, r->protocol, &kv);
+
+	ctx->nrules++;
+	return 0;
+}
+
+static int fc_read(struct fc_ctx *ctx, const char *name)
+{
+	char *cols[256], *vals[256];
+	char *line = NULL, *header = NULL;
+	unsigned int lineno = 0;
+	int ncols = 0, nvals, i;
+	size_t len = 0;
+	FILE *fp;
+
+	fp = strcmp(name, "-") ? fopen(name, "r") : stdin;
+	if (!fp) {
+		fprintf(stderr, "Cannot open \"%s\": %s\n", name,
+			strerror(errno));
+		return -1;
+	}
+
+	while (getline(&line, &len, fp) > 0) {
+		char *p = line;
+
+		lineno++;
+		p[strcspn(p, "\r\n")] = '\0';
+		while (isspace(*p))
+			p++;
+		if (*p == '\0' || *p == '#')
+			continue;
+
+		if (!header) {
+			header = strdup(p);
+			ncols = fc_csv_split(header, cols, ARRAY_SIZE(cols));
+			for (i = 0; i < ncols; i++) {
+				char *c;
+
+				for (c = cols[i]; *c; c++)
+					*c = tolower(*c);
+				if (!strcmp(cols[i], "proto"))
+					cols[i] = "protocol";
+			}
+			continue;
+		}
+
+		nvals = fc_csv_split(p, vals, ARRAY_SIZE(vals));
+		if (nvals > ncols) {
+			fprintf(stderr, "line %u: %d fields, header has %d\n",
+				lineno, nvals, ncols);
+			goto err;
+		}
+		for (i = nvals; i < ncols; i++)
+			vals[i] = NULL;
+
+		if (fc_rule_add(ctx, lineno, cols, vals, ncols) < 0)
+			goto err;
+	}
+
+	free(line);
+	free(header);
+	if (fp != stdin)
+		fclose(fp);
+	return 0;
+err:
+	free(line);
+	free(header);
+	if (fp != stdin)
+		fclose(fp);
+	return -1;
+}
+
+static void fc_proj_insert(struct fc_ctx *ctx, struct fc_proj *p, int ri)
+{
+	unsigned int h;
+
+	if ((p->count + 1) * 2 > p->size) {
+		struct fc_proj old = *p;
+		unsigned int i;
+
+		p->size = p->size ? p->size * 2 : 16;
+		p->count = 0;
+		p->slot = malloc(p->size * sizeof(*p->slot));
+		if (!p->slot) {
+			perror("malloc");
+			exit(1);
+		}
+		memset(p->slot, -1, p->size * sizeof(*p->slot));
+		for (i = 0; i < old.size; i++)
+			if (old.slot[i] >= 0)
+				fc_proj_insert(ctx, p, old.slot[i]);
+		free(old.slot);
+	}
+
+	h = tc_masked_hash(ctx->rules[ri].key, p->cmask, flower_keyvec_used) &
+	    (p->size - 1);
+	while (p->slot[h] >= 0)
+		h = (h + 1) & (p->size - 1);
+	p->slot[h] = ri;
+	p->count++;
+}
+
+static int fc_proj_find(struct fc_ctx *ctx, struct fc_proj *p, const __u8 *key)
+{
+	unsigned int h = tc_masked_hash(key, p->cmask, flower_keyvec_used) &
+			 (p->size - 1);
+
+	for (; p->slot[h] >= 0; h = (h + 1) & (p->size - 1))
+		if (tc_masked_eq(ctx->rules[p->slot[h]].key, key, p->cmask,
+				 flower_keyvec_used))
+			return p->slot[h];
+	return -1;
+}
+
+/* First rule of @g that a packet matching rule @ri could also match */
+static int fc_group_overlap(struct fc_ctx *ctx, struct fc_group *g, int ri)
+{
+	const __u8 *gm = ctx->sigs[g->sig].kv.mask;
+	const __u8 *rm = ctx->sigs[ctx->rules[ri].sig].kv.mask;
+	__u8 cmask[FLOWER_KEYVEC_LEN];
+	struct fc_proj *p;
+	int i;
+
+	for (i = 0; i < flower_keyvec_used; i++)
+		cmask[i] = gm[i] & rm[i];
+
+	for (i = 0; i < g->nproj; i++)
+		if (!memcmp(g->proj[i].cmask, cmask, flower_keyvec_used))
+			break;
+
+	if (i == g->nproj) {
+		g->proj = realloc(g->proj, (g->nproj + 1) * sizeof(*g->proj));
+		if (!g->proj) {
+			perror("realloc");
+			exit(1);
+		}
+		p = &g->proj[g->nproj++];
+		memset(p, 0, sizeof(*p));
+		memcpy(p->cmask, cmask, flower_keyvec_used);
+		for (i = 0; i < g->nrules; i++)
+			fc_proj_insert(ctx, p, g->rules[i]);
+	} else {
+		p = &g->proj[i];
+	}
+
+	return fc_proj_find(ctx, p, ctx->rules[ri].key);
+}
+
+static void fc_group_add(struct fc_ctx *ctx, struct fc_group *g, int ri)
+{
+	int i;
+
+	g->rules = tc_grow(g->rules, &g->alloc, g->nrules + 1,
+			   sizeof(*g->rules));
+	g->rules[g->nrules++] = ri;
+	for (i = 0; i < g->nproj; i++)
+		fc_proj_insert(ctx, &g->proj[i], ri);
+}
+
+/*
+ * Put a rule into the first priority after every overlapping earlier
+ * rule that already holds its mask, or open a new priority.  A rule fully
+ * covered by an earlier one can never match and is dropped.
+ */
+static void fc_place(struct fc_ctx *ctx, struct fc_bucket *b, int ri)
+{
+	struct fc_rule *r = &ctx->rules[ri];
+	int g, low = 0, q;
+
+	r->placed++;
+
+	for (g = b->ngroups - 1; g >= 0; g--) {
+		struct fc_group *grp = &ctx->groups[b->groups[g]];
+		struct fc_sig *s = &ctx->sigs[grp->sig];
+
+		q = fc_group_overlap(ctx, grp, ri);
+		if (q < 0)
+			continue;
+
+		if (!s->kv.inexact && ctx->rules[q].terminal &&
+		    flower_keyvec_subset(s->kv.mask,
+					 ctx->sigs[r->sig].kv.mask)) {
+			r->shadowed++;
+			r->shadowed_by = ctx->rules[q].line;
+			return;
+		}
+		low = g + 1;
+		break;
+	}
+
+	for (g = b->ngroups - 1; g >= low; g--) {
+		if (ctx->groups[b->groups[g]].sig == r->sig) {
+			fc_group_add(ctx, &ctx->groups[b->groups[g]], ri);
+			return;
+		}
+	}
+
+	ctx->groups = tc_grow(ctx->groups, &ctx->groups_alloc,
+			      ctx->ngroups + 1, sizeof(*ctx->groups));
+	memset(&ctx->groups[ctx->ngroups], 0, sizeof(struct fc_group));
+	ctx->groups[ctx->ngroups].sig = r->sig;
+	fc_group_add(ctx, &ctx->groups[ctx->ngroups], ri);
+
+	b->groups = tc_grow(b->groups, &b->alloc, b->ngroups + 1,
+			    sizeof(*b->groups));
+	b->groups[b->ngroups++] = ctx->ngroups++;
+}
+
+static struct fc_bucket *fc_bucket_get(struct fc_ctx *ctx, __u16 protocol,
+				       int ip_proto)
+{
+	struct fc_bucket *b;
+	int i;
+
+	for (i = 0; i < ctx->nbuckets; i++)
+		if (ctx->buckets[i].protocol == protocol &&
+		    ctx->buckets[i].ip_proto == ip_proto)
+			return &ctx->buckets[i];
+
+	ctx->buckets = realloc(ctx->buckets,
+			       (ctx->nbuckets + 1) * sizeof(*ctx->buckets));
+	if (!ctx->buckets) {
+		perror("realloc");
+		exit(1);
+	}
+	b = &ctx->buckets[ctx->nbuckets++];
+	memset(b, 0, sizeof(*b));
+	b->protocol = protocol;
+	b->ip_proto = ip_proto;
+	b->chain = ctx->chain;
+	return b;
+}
+
+/* Does @protocol get a per ip_proto dispatch in the entry chain? */
+static bool fc_dispatched(struct fc_ctx *ctx, __u16 protocol)
+{
+	int i, first = -1;
+
+	if (protocol != htons(ETH_P_IP) && protocol != htons(ETH_P_IPV6))
+		return false;
+
+	for (i = 0; i < ctx->nrules; i++) {
+		struct fc_rule *r = &ctx->rules[i];
+
+		if (r->protocol == htons(ETH_P_ALL))
+			return false;
+		if (r->protocol != protocol || r->ip_proto < 0)
+			continue;
+		if (first < 0)
+			first = r->ip_proto;
+		else if (r->ip_proto != first)
+			return true;
+	}
+	return false;
+}
+
+static void fc_layout(struct fc_ctx *ctx)
+{
+	bool disp[2] = {
+		fc_dispatched(ctx, htons(ETH_P_IP)),
+		fc_dispatched(ctx, htons(ETH_P_IPV6)),
+	};
+	__u32 next_chain = ctx->chain_base;
+	int i, j;
+
+	for (i = 0; i < ctx->nrules; i++) {
+		struct fc_rule *r = &ctx->rules[i];
+		int d = r->protocol == htons(ETH_P_IPV6);
+		int nb = ctx->nbuckets;
+
+		if ((r->protocol != htons(ETH_P_IP) &&
+		     r->protocol != htons(ETH_P_IPV6)) || !disp[d]) {
+			/* the ethertype is part of the key, so one bucket will do */
+			fc_place(ctx, fc_bucket_get(ctx, 0, -1), i);
+			continue;
+		}
+
+		if (r->ip_proto >= 0) {
+			struct fc_bucket *b;
+
+			b = fc_bucket_get(ctx, r->protocol, r->ip_proto);
+			if (ctx->nbuckets != nb) {
+				/* a new branch starts with the wildcards so far */
+				b->chain = next_chain++;
+				for (j = 0; j < i; j++)
+					if (ctx->rules[j].protocol == r->protocol &&
+					    ctx->rules[j].ip_proto < 0)
+						fc_place(ctx, b, j);
+			}
+			fc_place(ctx, b, i);
+			continue;
+		}
+
+		/* no ip_proto: goes into every branch and the catch all */
+		fc_bucket_get(ctx, r->protocol, -1)->chain = ctx->chain;
+		for (j = 0; j < ctx->nbuckets; j++)
+			if (ctx->buckets[j].protocol == r->protocol)
+				fc_place(ctx, &ctx->buckets[j], i);
+	}
+
+	/* the catch all of a dispatched protocol gets its own chain too */
+	for (i = 0; i < ctx->nbuckets; i++) {
+		struct fc_bucket *b = &ctx->buckets[i];
+
+		if (b->ip_proto < 0 && (b->protocol == htons(ETH_P_IP) ||
+					b->protocol == htons(ETH_P_IPV6)) &&
+		    disp[b->protocol == htons(ETH_P_IPV6)])
+			b->chain = next_chain++;
+	}
+}
+
+static const char *fc_ip_proto_name(int ip_proto, char *buf, size_t len)
+{
+	switch (ip_proto) {
+	case IPPROTO_TCP:
+		return "tcp";
+	case IPPROTO_UDP:
+		return "udp";
+	case IPPROTO_SCTP:
+		return "sctp";
+	case IPPROTO_ICMP:
+		return "icmp";
+	case IPPROTO_ICMPV6:
+		return "icmpv6";
+	}
+	/* flower parses a bare ip_proto number as hex */
+	snprintf(buf, len, "0x%x", ip_proto);
+	return buf;
+}
+
+/* cookie: the chain's group for templates, the rule for rule filters and
+ * NULL for the dispatch filters in the entry chain
+ */
+static int fc_reply(struct nlmsghdr *n, int error, void *cookie, void *arg)
+{
+	struct fc_ctx *ctx = arg;
+	struct nlmsgerr *err = NLMSG_DATA(n);
+
+	if (n->nlmsg_type != NLMSG_ERROR || !error)
+		return 0;
+
+	if (err->msg.nlmsg_type == RTM_NEWCHAIN) {
+		struct fc_group *g = cookie;
+
+		fprintf(stderr, "chain %u: RTNETLINK answers: %s\n",
+			g->chain, strerror(-error));
+	} else if (cookie) {
+		struct fc_rule *r = cookie;
+
+		fprintf(stderr, "line %u: RTNETLINK answers: %s\n",
+			r->line, strerror(-error));
+	} else {
+		fprintf(stderr, "chain %u: RTNETLINK answers: %s\n",
+			ctx->chain, strerror(-error));
+	}
+	return 0;
+}
+
+static void fc_print_cmd(struct fc_ctx *ctx, const char *obj, __u32 chain,
+			 __u32 prio, __u16 protocol, int argc, char **argv)
+{
+	SPRINT_BUF(b1);
+	int i;
+
+	printf("%s add dev %s %s chain %u", obj, ctx->dev, ctx->parent_str,
+	       chain);
+	if (prio)
+		printf(" prio %u", prio);
+	printf(" protocol %s flower", ll_proto_n2a(protocol, b1, sizeof(b1)));
+	for (i = 0; i < argc; i++)
+		printf(" %s", argv[i]);
+	printf("\n");
+}
+
+static void fc_emit(struct fc_ctx *ctx, struct nlmsghdr *n, void *cookie,
+		    const char *obj, int argc, char **argv)
+{
+	struct tcmsg *t = NLMSG_DATA(n);
+	__u32 chain = *(__u32 *)RTA_DATA(TCA_RTA(t));
+
+	if (ctx->dry_run) {
+		fc_print_cmd(ctx, obj, chain, TC_H_MAJ(t->tcm_info) >> 16,
+			     TC_H_MIN(t->tcm_info), argc, argv);
+		return;
+	}
+
+	if (rtnl_pipe_send(ctx->pipe, n, cookie) < 0)
+		exit(2);
+}
+
+static void fc_emit_template(struct fc_ctx *ctx, struct fc_group *g)
+{
+	struct fc_rule *r = &ctx->rules[g->rules[0]];
+	struct nlmsghdr *n;
+
+	n = fc_build(ctx, RTM_NEWCHAIN, r->protocol, g->chain, 0,
+		     r->tmpl_argc, r->argv);
+	if (!n)
+		exit(1);
+	fc_emit(ctx, n, g, "chain", r->tmpl_argc, r->argv);
+	free(n);
+}
+
+static void fc_emit_dispatch(struct fc_ctx *ctx, struct fc_bucket *b,
+			     __u32 prio)
+{
+	char proto[16], chain[16];
+	char *argv[8];
+	int argc = 0;
+	struct nlmsghdr *n;
+
+	snprintf(chain, sizeof(chain), "%u", b->chain);
+	if (b->ip_proto >= 0) {
+		argv[argc++] = "ip_proto";
+		argv[argc++] = (char *)fc_ip_proto_name(b->ip_proto, proto,
+							sizeof(proto));
+	}
+	argv[argc++] = "action";
+	argv[argc++] = "goto";
+	argv[argc++] = "chain";
+	argv[argc++] = chain;
+	argv[argc] = NULL;
+
+	n = fc_build(ctx, RTM_NEWTFILTER, b->protocol, ctx->chain, prio,
+		     argc, argv);
+	if (!n)
+		exit(1);
+	fc_emit(ctx, n, NULL, "filter", argc, argv);
+	free(n);
+}
+
+struct fc_chain_stats {
+	__u32		chain;
+	unsigned int	filters;
+	unsigned int	prios;
+	unsigned int	masks;
+};
+
+static struct fc_chain_stats *fc_stats_get(struct fc_chain_stats **st,
+					   int *nst, __u32 chain)
+{
+	int i;
+
+	for (i = 0; i < *nst; i++)
+		if ((*st)[i].chain == chain)
+			return &(*st)[i];
+
+	*st = realloc(*st, (*nst + 1) * sizeof(**st));
+	if (!*st) {
+		perror("realloc");
+		exit(1);
+	}
+	memset(&(*st)[*nst], 0, sizeof(**st));
+	(*st)[*nst].chain = chain;
+	return &(*st)[(*nst)++];
+}
+
+static int fc_install(struct fc_ctx *ctx)
+{
+	struct fc_chain_stats *st = NULL, *cs;
+	unsigned int shadowed = 0, filters = 0;
+	__u32 prio = ctx->prio;
+	int nst = 0, i, j, k;
+
+	fc_stats_get(&st, &nst, ctx->chain);
+
+	/* entry chain: the ip_proto dispatch and its catch all go first */
+	for (i = 0; i < 2; i++) {
+		__u16 proto = htons(i ? ETH_P_IPV6 : ETH_P_IP);
+		bool any = false;
+
+		for (j = 0; j < ctx->nbuckets; j++) {
+			struct fc_bucket *b = &ctx->buckets[j];
+
+			if (b->protocol == proto && b->ip_proto >= 0) {
+				b->prio = prio;
+				st[0].filters++;
+				any = true;
+			}
+		}
+		if (!any)
+			continue;
+		st[0].prios++;
+		st[0].masks++;
+		prio++;
+
+		for (j = 0; j < ctx->nbuckets; j++) {
+			struct fc_bucket *b = &ctx->buckets[j];
+
+			if (b->protocol == proto && b->ip_proto < 0) {
+				b->prio = prio++;
+				st[0].filters++;
+				st[0].prios++;
+				st[0].masks++;
+			}
+		}
+	}
+
+	/* priorities inside every chain, one mask each */
+	for (i = 0; i < ctx->nbuckets; i++) {
+		struct fc_bucket *b = &ctx->buckets[i];
+		__u32 p = b->chain == ctx->chain ? prio : ctx->prio;
+
+		cs = fc_stats_get(&st, &nst, b->chain);
+		for (j = 0; j < b->ngroups; j++) {
+			struct fc_group *g = &ctx->groups[b->groups[j]];
+
+			for (k = 0; k < j; k++)
+				if (ctx->groups[b->groups[k]].sig == g->sig)
+					break;
+			if (k == j)
+				cs->masks++;
+			g->chain = b->chain;
+			g->prio = p++;
+			cs->prios++;
+			cs->filters += g->nrules;
+			filters += g->nrules;
+		}
+		if (p > 0xffff) {
+			fprintf(stderr, "Out of priorities in chain %u\n",
+				b->chain);
+			return -1;
+		}
+		if (b->chain == ctx->chain)
+			prio = p;
+	}
+
+	/* templates for single mask branch chains */
+	for (i = 0; i < ctx->nbuckets; i++) {
+		struct fc_bucket *b = &ctx->buckets[i];
+
+		if (b->chain != ctx->chain && b->ngroups == 1 &&
+		    !ctx->sigs[ctx->groups[b->groups[0]].sig].kv.inexact)
+			fc_emit_template(ctx, &ctx->groups[b->groups[0]]);
+	}
+
+	/* branch chains first so that nothing is dispatched to a partial one */
+	for (k = 0; k < 2; k++) {
+		for (i = 0; i < ctx->nbuckets; i++) {
+			struct fc_bucket *b = &ctx->buckets[i];
+
+			if ((b->chain == ctx->chain) != k)
+				continue;
+			for (j = 0; j < b->ngroups; j++) {
+				struct fc_group *g = &ctx->groups[b->groups[j]];
+				int l;
+
+				for (l = 0; l < g->nrules; l++) {
+					struct fc_rule *r = &ctx->rules[g->rules[l]];
+
+					fc_set_place(r->n, g->chain, g->prio);
+					fc_emit(ctx, r->n, r, "filter",
+						r->argc, r->argv);
+				}
+			}
+		}
+	}
+
+	for (i = 0; i < ctx->nbuckets; i++) {
+		struct fc_bucket *b = &ctx->buckets[i];
+
+		if (b->chain != ctx->chain)
+			fc_emit_dispatch(ctx, b, b->prio);
+	}
+
+	if (!ctx->dry_run && rtnl_pipe_flush(ctx->pipe) < 0)
+		return -1;
+
+	for (i = 0; i < ctx->nrules; i++) {
+		struct fc_rule *r = &ctx->rules[i];
+
+		if (!r->placed || r->shadowed < r->placed)
+			continue;
+		shadowed++;
+		if (show_stats)
+			fprintf(stderr, "line %u: shadowed by line %u, not installed\n",
+				r->line, r->shadowed_by);
+	}
+
+	new_json_obj(json);
+	open_json_object(NULL);
+	open_json_array(PRINT_JSON, "chains");
+	for (i = 0; i < nst; i++) {
+		open_json_object(NULL);
+		print_uint(PRINT_ANY, "chain", "chain %u: ", st[i].chain);
+		print_uint(PRINT_ANY, "filters", "%u filters, ", st[i].filters);
+		print_uint(PRINT_ANY, "priorities", "%u priorities, ",
+			   st[i].prios);
+		print_uint(PRINT_ANY, "masks", "%u masks", st[i].masks);
+		print_nl();
+		close_json_object();
+	}
+	close_json_array(PRINT_JSON, NULL);
+
+	print_uint(PRINT_ANY, "rules", "%u rules, ", ctx->nrules);
+	print_uint(PRINT_ANY, "installed", "%u filters, ", filters);
+	print_uint(PRINT_ANY, "shadowed", "%u shadowed", shadowed);
+	if (!ctx->dry_run)
+		print_uint(PRINT_ANY, "failed", ", %u failed",
+			   ctx->pipe->errors);
+	print_nl();
+	close_json_object();
+	delete_json_obj();
+
+	free(st);
+	return ctx->dry_run || !ctx->pipe->errors ? 0 : -1;
+}
+
+static int flower_compile(int argc, char **argv)
+{
+	struct fc_ctx ctx = {
+		.protocol = htons(ETH_P_ALL),
+		.prio = 1,
+	};
+	struct rtnl_pipe pipe;
+	const char *file = NULL;
+	bool chain_base_set = false;
+	unsigned int window = FC_WINDOW;
+	char parent_buf[32];
+
+	while (argc > 0) {
+		if (strcmp(*argv, "dev") == 0) {
+			NEXT_ARG();
+			if (ctx.dev)
+				duparg("dev", *argv);
+			ctx.dev = *argv;
+		} else if (strcmp(*argv, "ingress") == 0 ||
+			   strcmp(*argv, "egress") == 0) {
+			if (ctx.parent)
+				duparg("parent", *argv);
+			ctx.parent = TC_H_MAKE(TC_H_CLSACT,
+					       strcmp(*argv, "ingress") == 0 ?
+					       TC_H_MIN_INGRESS :
+					       TC_H_MIN_EGRESS);
+			ctx.parent_str = *argv;
+		} else if (strcmp(*argv, "root") == 0) {
+			if (ctx.parent)
+				duparg("parent", *argv);
+			ctx.parent = TC_H_ROOT;
+			ctx.parent_str = "root";
+		} else if (strcmp(*argv, "parent") == 0) {
+			NEXT_ARG();
+			if (ctx.parent)
+				duparg("parent", *argv);
+			if (get_tc_classid(&ctx.parent, *argv))
+				invarg("Invalid parent ID", *argv);
+			snprintf(parent_buf, sizeof(parent_buf), "parent %s",
+				 *argv);
+			ctx.parent_str = parent_buf;
+		} else if (strcmp(*argv, "file") == 0) {
+			NEXT_ARG();
+			file = *argv;
+		} else if (strcmp(*argv, "protocol") == 0) {
+			__u16 id;
+
+			NEXT_ARG();
+			if (ll_proto_a2n(&id, *argv))
+				invarg("invalid protocol", *argv);
+			ctx.protocol = id;
+		} else if (strcmp(*argv, "chain") == 0) {
+			NEXT_ARG();
+			if (get_u32(&ctx.chain, *argv, 0))
+				invarg("invalid chain index value", *argv);
+		} else if (strcmp(*argv, "chain-base") == 0) {
+			NEXT_ARG();
+			if (get_u32(&ctx.chain_base, *argv, 0))
+				invarg("invalid chain index value", *argv);
+			chain_base_set = true;
+		} else if (strcmp(*argv, "prio") == 0 ||
+			   strcmp(*argv, "priority") == 0) {
+			NEXT_ARG();
+			if (get_u32(&ctx.prio, *argv, 0) || !ctx.prio ||
+			    ctx.prio > 0xffff)
+				invarg("invalid priority value", *argv);
+		} else if (strcmp(*argv, "window") == 0) {
+			NEXT_ARG();
+			if (get_unsigned(&window, *argv, 0) || !window)
+				invarg("invalid window", *argv);
+		} else if (strcmp(*argv, "dry-run") == 0) {
+			ctx.dry_run = true;
+		} else if (strcmp(*argv, "help") == 0) {
+			usage();
+			return 0;
+		} else {
+			fprintf(stderr, "What is \"%s\"? Try \"tc flower help\".\n",
+				*argv);
+			return -1;
+		}
+		argc--; argv++;
+	}
+
+	if (!ctx.dev || !ctx.parent || !file) {
+		fprintf(stderr, "\"dev\", a parent and \"file\" are required.\n");
+		return -1;
+	}
+	if (!chain_base_set)
+		ctx.chain_base = ctx.chain + 1;
+
+	ctx.q = get_filter_kind("flower");
+	if (!ctx.q) {
+		fprintf(stderr, "flower classifier is not available\n");
+		return -1;
+	}
+
+	if (!ctx.dry_run) {
+		ctx.ifindex = ll_name_to_index(ctx.dev);
+		if (!ctx.ifindex)
+			return -nodev(ctx.dev);
+	}
+
+	memset(ctx.sig_head, -1, sizeof(ctx.sig_head));
+	if (fc_read(&ctx, file) < 0)
+		return -1;
+
+	fc_layout(&ctx);
+
+	if (!ctx.dry_run) {
+		rtnl_pipe_init(&pipe, &rth, window, fc_reply, &ctx);
+		ctx.pipe = &pipe;
+	}
+
+	return fc_install(&ctx);
+}
+
+int do_flower(int argc, char **argv)
+{
+	if (argc < 1 || matches(*argv, "help") == 0) {
+		usage();
+		return 0;
+	}
+
+	if (matches(*argv, "compile") == 0)
+		return flower_compile(argc - 1, argv + 1);
+
+	fprintf(stderr, "Command \"%s\" is unknown, try \"tc flower help\".\n",
+		*argv);
+	return -1;
+}
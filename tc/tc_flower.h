@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _TC_FLOWER_H_
+#define _TC_FLOWER_H_
+
+#include <stdbool.h>
+#include <linux/types.h>
+#include <libnetlink.h>
+
+/*
+ * Canonical form of a flower match.  Keys with a fixed size are laid out
+ * in a flat vector (value and mask, mask all ones when the kernel applies
+ * an implicit full mask), so that two rules share a kernel mask exactly
+ * when their mask vectors and extra blobs compare equal.  Keys that do not
+ * fit the vector (port ranges, tunnel options, indev, ...) are recorded
+ * in the extra blob and flag the match as inexact.
+ */
+#define FLOWER_KEYVEC_LEN	256
+#define FLOWER_KEYVEC_EXTRA	1024
+
+struct flower_keyvec {
+	__u8	key[FLOWER_KEYVEC_LEN];
+	__u8	mask[FLOWER_KEYVEC_LEN];
+	__u8	extra[FLOWER_KEYVEC_EXTRA];
+	int	extra_len;
+	bool	inexact;
+};
+
+int flower_keyvec_len(void);
+int flower_keyvec_parse(struct rtattr *opts, struct flower_keyvec *kv);
+bool flower_keyvec_overlap(const __u8 *k1, const __u8 *m1,
+			   const __u8 *k2, const __u8 *m2);
+bool flower_keyvec_subset(const __u8 *m1, const __u8 *m2);
+
+#endif
@@ -32,6 +32,7 @@ static int usage(void)
 		"       [ [ QDISC_KIND ] [ help | OPTIONS ] ]\n"
 		"\n"
 		"       tc qdisc { show | list } [ dev STRING ] [ QDISC_ID ] [ invisible ]\n"
+		"       tc -s qdisc show [ dev STRING ] [ QDISC_ID ] interval SECS [ count N ]\n"
 		"Where:\n"
 		"QDISC_KIND := { [p|b]fifo | tbf | prio | cbq | red | etc. }\n"
 		"OPTIONS := ... try tc qdisc add <desired QDISC_KIND> help\n"
@@ -42,7 +43,8 @@ static int usage(void)
 
 //处理类型“tc qdisc add dev enp4s0f0 ingress”这样的命令行，增加修改qdisc
 //tc qdisc add dev eth0 root handle 1: htb default 11
-static int tc_qdisc_modify(int cmd, unsigned int flags, int argc, char **argv)
+int tc_qdisc_modify(int cmd, unsigned int flags, int argc, char **argv,
+		    struct nlmsghdr *out)
 {
 	struct qdisc_util *q = NULL;
 	struct tc_estimator est = {};
@@ -215,6 +217,11 @@ static int tc_qdisc_modify(int cmd, unsigned int flags, int argc, char **argv)
 		req.t.tcm_ifindex = idx;
 	}
 
+	if (out) {
+		memcpy(out, &req.n, req.n.nlmsg_len);
+		return 0;
+	}
+
 	if (rtnl_talk(&rth, &req.n, NULL) < 0)
 		return 2;
 
@@ -225,6 +232,22 @@ static int filter_ifindex;
 static __u32 filter_parent;
 static __u32 filter_handle;
 
+static int qdisc_match(struct nlmsghdr *n)
+{
+	struct tcmsg *t = NLMSG_DATA(n);
+
+	if (filter_ifindex && filter_ifindex != t->tcm_ifindex)
+		return 0;
+
+	if (filter_handle && filter_handle != t->tcm_handle)
+		return 0;
+
+	if (filter_parent && filter_parent != t->tcm_parent)
+		return 0;
+
+	return 1;
+}
+
 int print_qdisc(struct nlmsghdr *n, void *arg)
 {
 	FILE *fp = (FILE *)arg;
@@ -244,14 +267,15 @@ int print_qdisc(struct nlmsghdr *n, void *arg)
 		return -1;
 	}
 
-	if (filter_ifindex && filter_ifindex != t->tcm_ifindex)
-		return 0;
-
-	if (filter_handle && filter_handle != t->tcm_handle)
+	if (!qdisc_match(n))
 		return 0;
 
-	if (filter_parent && filter_parent != t->tcm_parent)
-		return 0;
+	if (brief && show_stats && n->nlmsg_type == RTM_NEWQDISC) {
+		sprintf(abuf, "%x:", t->tcm_handle >> 16);
+		return print_tcstats_brief(fp, "qdisc", abuf,
+					   filter_ifindex ? 0 : t->tcm_ifindex,
+					   t, len);
+	}
 
 	parse_rtattr_flags(tb, TCA_MAX, TCA_RTA(t), len, NLA_F_NESTED);
 
@@ -382,6 +406,7 @@ static int tc_qdisc_list(int argc, char **argv)
 
 	char d[IFNAMSIZ] = {};
 	bool dump_invisible = false;
+	unsigned int interval = 0, count = 0;
 	__u32 handle;
 
 	while (argc > 0) {
@@ -423,6 +448,14 @@ static int tc_qdisc_list(int argc, char **argv)
 			usage();
 		} else if (strcmp(*argv, "invisible") == 0) {
 			dump_invisible = true;
+		} else if (strcmp(*argv, "interval") == 0) {
+			NEXT_ARG();
+			if (get_unsigned(&interval, *argv, 0) || !interval)
+				invarg("invalid interval", *argv);
+		} else if (strcmp(*argv, "count") == 0) {
+			NEXT_ARG();
+			if (get_unsigned(&count, *argv, 0))
+				invarg("invalid count", *argv);
 		} else {
 			fprintf(stderr, "What is \"%s\"? Try \"tc qdisc help\".\n", *argv);
 			return -1;
@@ -445,6 +478,16 @@ static int tc_qdisc_list(int argc, char **argv)
 		addattr(&req.n, 256, TCA_DUMP_INVISIBLE);
 	}
 
+	if (interval) {
+		if (!show_stats) {
+			fprintf(stderr, "\"interval\" needs -s\n");
+			return -1;
+		}
+		return tc_sample_stats(RTM_GETQDISC, &req.t,
+				       req.n.nlmsg_len - NLMSG_HDRLEN,
+				       qdisc_match, interval, count);
+	}
+
 	if (rtnl_dump_request_n(&rth, &req.n) < 0) {
 		perror("Cannot send request");
 		return 1;
@@ -468,15 +511,15 @@ int do_qdisc(int argc, char **argv)
 		return tc_qdisc_list(0, NULL);
 	if (matches(*argv, "add") == 0)
 		//qdisc队列添加，容许创建，容许已存在
-		return tc_qdisc_modify(RTM_NEWQDISC, NLM_F_EXCL|NLM_F_CREATE, argc-1, argv+1);
+		return tc_qdisc_modify(RTM_NEWQDISC, NLM_F_EXCL|NLM_F_CREATE, argc-1, argv+1, NULL);
 	if (matches(*argv, "change") == 0)
-		return tc_qdisc_modify(RTM_NEWQDISC, 0, argc-1, argv+1);
+		return tc_qdisc_modify(RTM_NEWQDISC, 0, argc-1, argv+1, NULL);
 	if (matches(*argv, "replace") == 0)
-		return tc_qdisc_modify(RTM_NEWQDISC, NLM_F_CREATE|NLM_F_REPLACE, argc-1, argv+1);
+		return tc_qdisc_modify(RTM_NEWQDISC, NLM_F_CREATE|NLM_F_REPLACE, argc-1, argv+1, NULL);
 	if (matches(*argv, "link") == 0)
-		return tc_qdisc_modify(RTM_NEWQDISC, NLM_F_REPLACE, argc-1, argv+1);
+		return tc_qdisc_modify(RTM_NEWQDISC, NLM_F_REPLACE, argc-1, argv+1, NULL);
 	if (matches(*argv, "delete") == 0)
-		return tc_qdisc_modify(RTM_DELQDISC, 0,  argc-1, argv+1);
+		return tc_qdisc_modify(RTM_DELQDISC, 0,  argc-1, argv+1, NULL);
 	if (matches(*argv, "list") == 0 || matches(*argv, "show") == 0
 	    || matches(*argv, "lst") == 0)
 		return tc_qdisc_list(argc-1, argv+1);
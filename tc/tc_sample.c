@@ -0,0 +1,420 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * tc_sample.c		"tc -s {qdisc|class|actions} ... interval N": re-dump
+ *			the statistics every N seconds over one netlink
+ *			socket and print what changed.
+ *
+ * Every object is kept in a table keyed by (ifindex, parent, handle, kind)
+ * holding the counters of the previous dump, so each tick prints counter
+ * deltas, byte and packet rates over the measured interval and flags a
+ * drop or overlimit count well above its running average.  The first dump
+ * only fills the table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <linux/gen_stats.h>
+
+#include "utils.h"
+#include "tc_util.h"
+#include "tc_common.h"
+
+#define SAMPLE_HASH_BITS	14
+#define SAMPLE_HASH_SIZE	(1 << SAMPLE_HASH_BITS)
+
+struct sample_counters {
+	__u64	bytes;
+	__u64	packets;
+	__u32	drops;
+	__u32	overlimits;
+	__u32	requeues;
+	__u32	backlog;
+	__u32	qlen;
+};
+
+struct sample_entry {
+	struct sample_entry	*next;
+	int			ifindex;
+	__u32			parent;
+	__u32			handle;
+	char			kind[FILTER_NAMESZ];
+	char			id[16];
+	unsigned int		gen;
+	unsigned int		ticks;
+	struct sample_counters	c;
+	/* running averages of the per tick drop and overlimit deltas, x8 */
+	__u64			drops_avg;
+	__u64			overlimits_avg;
+};
+
+static struct sample_entry *sample_hash[SAMPLE_HASH_SIZE];
+static unsigned int sample_gen;
+static double sample_elapsed;
+static int sample_type;
+static int (*sample_match)(struct nlmsghdr *n);
+
+static unsigned int sample_hashfn(int ifindex, __u32 parent, __u32 handle)
+{
+	__u32 h = ifindex * 0x9e3779b1U ^ parent * 0x85ebca6bU ^
+		  handle * 0xc2b2ae35U;
+
+	return (h ^ h >> 16) & (SAMPLE_HASH_SIZE - 1);
+}
+
+static struct sample_entry *sample_lookup(int ifindex, __u32 parent,
+					  __u32 handle, const char *kind,
+					  bool *created)
+{
+	unsigned int h = sample_hashfn(ifindex, parent, handle);
+	struct sample_entry *e;
+
+	for (e = sample_hash[h]; e; e = e->next)
+		if (e->ifindex == ifindex && e->parent == parent &&
+		    e->handle == handle && !strcmp(e->kind, kind)) {
+			*created = false;
+			return e;
+		}
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return NULL;
+	e->ifindex = ifindex;
+	e->parent = parent;
+	e->handle = handle;
+	strlcpy(e->kind, kind, sizeof(e->kind));
+	e->next = sample_hash[h];
+	sample_hash[h] = e;
+	*created = true;
+	return e;
+}
+
+/* Drop the objects that were not in the last dump */
+static void sample_expire(void)
+{
+	int i;
+
+	for (i = 0; i < SAMPLE_HASH_SIZE; i++) {
+		struct sample_entry **pe = &sample_hash[i];
+
+		while (*pe) {
+			struct sample_entry *e = *pe;
+
+			if (e->gen != sample_gen) {
+				*pe = e->next;
+				free(e);
+			} else {
+				pe = &e->next;
+			}
+		}
+	}
+}
+
+static void sample_flush(void)
+{
+	sample_gen++;
+	sample_expire();
+}
+
+static void sample_get_stats2(struct rtattr *rta, struct sample_counters *c)
+{
+	struct rtattr *tbs[TCA_STATS_MAX + 1];
+
+	parse_rtattr_nested(tbs, TCA_STATS_MAX, rta);
+
+	if (tbs[TCA_STATS_BASIC]) {
+		struct gnet_stats_basic bs = {0};
+
+		memcpy(&bs, RTA_DATA(tbs[TCA_STATS_BASIC]),
+		       MIN(RTA_PAYLOAD(tbs[TCA_STATS_BASIC]), sizeof(bs)));
+		c->bytes = bs.bytes;
+		c->packets = bs.packets;
+	}
+	if (tbs[TCA_STATS_PKT64])
+		c->packets = rta_getattr_u64(tbs[TCA_STATS_PKT64]);
+	if (tbs[TCA_STATS_QUEUE]) {
+		struct gnet_stats_queue q = {0};
+
+		memcpy(&q, RTA_DATA(tbs[TCA_STATS_QUEUE]),
+		       MIN(RTA_PAYLOAD(tbs[TCA_STATS_QUEUE]), sizeof(q)));
+		c->drops = q.drops;
+		c->overlimits = q.overlimits;
+		c->requeues = q.requeues;
+		c->backlog = q.backlog;
+		c->qlen = q.qlen;
+	}
+}
+
+static void sample_get_stats(struct rtattr *tb[], struct sample_counters *c)
+{
+	if (tb[TCA_STATS2]) {
+		sample_get_stats2(tb[TCA_STATS2], c);
+	} else if (tb[TCA_STATS]) {
+		struct tc_stats st = {};
+
+		memcpy(&st, RTA_DATA(tb[TCA_STATS]),
+		       MIN(RTA_PAYLOAD(tb[TCA_STATS]), sizeof(st)));
+		c->bytes = st.bytes;
+		c->packets = st.packets;
+		c->drops = st.drops;
+		c->overlimits = st.overlimits;
+		c->backlog = st.backlog;
+		c->qlen = st.qlen;
+	}
+}
+
+/* A counter that went backwards belongs to a recreated object */
+static __u64 sample_delta(__u64 cur, __u64 prev)
+{
+	return cur >= prev ? cur - prev : cur;
+}
+
+/*
+ * Flag a delta above twice its running average and update the average,
+ * which starts out at the first delta seen.
+ */
+static bool sample_spike(__u64 delta, __u64 *avg, bool first)
+{
+	bool spike = !first && delta && delta * 8 > 2 * *avg;
+
+	if (first)
+		*avg = delta * 8;
+	else
+		*avg += delta - (*avg >> 3);
+	return spike;
+}
+
+static void sample_print(struct sample_entry *e,
+			 const struct sample_counters *c)
+{
+	__u64 bytes = sample_delta(c->bytes, e->c.bytes);
+	__u64 packets = sample_delta(c->packets, e->c.packets);
+	__u64 drops = sample_delta(c->drops, e->c.drops);
+	__u64 overlimits = sample_delta(c->overlimits, e->c.overlimits);
+	__u64 requeues = sample_delta(c->requeues, e->c.requeues);
+	bool first = !e->ticks++;
+	bool drop_spike = sample_spike(drops, &e->drops_avg, first);
+	bool over_spike = sample_spike(overlimits, &e->overlimits_avg, first);
+	char abuf[64];
+
+	if (!bytes && !packets && !drops && !overlimits && !requeues &&
+	    c->backlog == e->c.backlog && c->qlen == e->c.qlen)
+		return;
+
+	open_json_object(NULL);
+	switch (sample_type) {
+	case RTM_NEWQDISC:
+		print_string(PRINT_ANY, "kind", "qdisc %s", e->kind);
+		print_string(PRINT_ANY, "handle", " %s ", e->id);
+		break;
+	case RTM_NEWTCLASS:
+		print_string(PRINT_ANY, "class", "class %s", e->kind);
+		print_string(PRINT_ANY, "handle", " %s ", e->id);
+		break;
+	default:
+		print_string(PRINT_ANY, "kind", "action %s", e->kind);
+		print_uint(PRINT_ANY, "index", " index %u ", e->handle);
+		break;
+	}
+	if (e->ifindex)
+		print_devname(PRINT_ANY, e->ifindex);
+	if (sample_type != RTM_NEWACTION) {
+		if (e->parent == TC_H_ROOT) {
+			print_bool(PRINT_ANY, "root", "root ", true);
+		} else if (e->parent) {
+			print_tc_classid(abuf, sizeof(abuf), e->parent);
+			print_string(PRINT_ANY, "parent", "parent %s ", abuf);
+		}
+	}
+
+	print_lluint(PRINT_ANY, "bytes", "bytes +%llu", bytes);
+	tc_print_rate(PRINT_ANY, "rate", " (%s)", bytes / sample_elapsed);
+	print_lluint(PRINT_ANY, "packets", " pkts +%llu", packets);
+	print_lluint(PRINT_ANY, "pps", " (%llupps)", packets / sample_elapsed);
+	print_lluint(PRINT_ANY, "drops", " drops +%llu", drops);
+	if (drop_spike)
+		print_bool(PRINT_ANY, "drop_spike", " spike", true);
+	print_lluint(PRINT_ANY, "overlimits", " overlimits +%llu", overlimits);
+	if (over_spike)
+		print_bool(PRINT_ANY, "overlimit_spike", " spike", true);
+	print_lluint(PRINT_ANY, "requeues", " requeues +%llu", requeues);
+	if (sample_type != RTM_NEWACTION) {
+		print_size(PRINT_ANY, "backlog", " backlog %s", c->backlog);
+		print_uint(PRINT_ANY, "qlen", " %up", c->qlen);
+	}
+	print_string(PRINT_FP, NULL, "\n", NULL);
+	close_json_object();
+}
+
+static void sample_update(int ifindex, __u32 parent, __u32 handle,
+			  const char *kind, const char *id,
+			  const struct sample_counters *c)
+{
+	struct sample_entry *e;
+	bool created;
+
+	e = sample_lookup(ifindex, parent, handle, kind, &created);
+	if (!e)
+		return;
+	if (created)
+		strlcpy(e->id, id, sizeof(e->id));
+	else if (e->gen == sample_gen - 1)
+		sample_print(e, c);
+	e->c = *c;
+	e->gen = sample_gen;
+}
+
+static void sample_actions(struct rtattr *tab)
+{
+	struct rtattr *tb[TCA_ACT_MAX_PRIO + 1];
+	int i;
+
+	parse_rtattr_nested(tb, TCA_ACT_MAX_PRIO, tab);
+
+	for (i = 0; i <= TCA_ACT_MAX_PRIO; i++) {
+		struct rtattr *ta[TCA_ACT_MAX + 1];
+		struct sample_counters c = {};
+
+		if (!tb[i])
+			continue;
+		parse_rtattr_nested(ta, TCA_ACT_MAX, tb[i]);
+		if (!ta[TCA_ACT_KIND] || !ta[TCA_ACT_INDEX])
+			continue;
+		if (ta[TCA_ACT_STATS])
+			sample_get_stats2(ta[TCA_ACT_STATS], &c);
+		sample_update(0, 0, rta_getattr_u32(ta[TCA_ACT_INDEX]),
+			      rta_getattr_str(ta[TCA_ACT_KIND]), "", &c);
+	}
+}
+
+static int sample_one(struct nlmsghdr *n, void *arg)
+{
+	struct sample_counters c = {};
+	struct tcmsg *t = NLMSG_DATA(n);
+	int len = n->nlmsg_len - NLMSG_LENGTH(sizeof(*t));
+	struct rtattr *tb[TCA_MAX + 1];
+	char abuf[64];
+
+	if (n->nlmsg_type == RTM_NEWACTION) {
+		struct tcamsg *ta = NLMSG_DATA(n);
+		struct rtattr *tab;
+
+		len = n->nlmsg_len - NLMSG_LENGTH(sizeof(*ta));
+		if (len < 0)
+			return -1;
+		parse_rtattr(tb, TCA_ROOT_MAX, TCA_RTA(ta), len);
+		tab = tb[TCA_ACT_TAB];
+		if (tab)
+			sample_actions(tab);
+		return 0;
+	}
+
+	if (n->nlmsg_type != sample_type)
+		return 0;
+	if (len < 0)
+		return -1;
+	if (sample_match && !sample_match(n))
+		return 0;
+
+	parse_rtattr_flags(tb, TCA_MAX, TCA_RTA(t), len, NLA_F_NESTED);
+	if (!tb[TCA_KIND])
+		return 0;
+
+	if (n->nlmsg_type == RTM_NEWQDISC)
+		snprintf(abuf, sizeof(abuf), "%x:", t->tcm_handle >> 16);
+	else
+		print_tc_classid(abuf, sizeof(abuf), t->tcm_handle);
+
+	sample_get_stats(tb, &c);
+	sample_update(t->tcm_ifindex, t->tcm_parent, t->tcm_handle,
+		      rta_getattr_str(tb[TCA_KIND]), abuf, &c);
+	return 0;
+}
+
+static double sample_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Dump @req (the payload of a @type dump request, @len bytes) every
+ * @interval seconds, @count times or forever if zero.  @match, if set,
+ * picks the objects to follow out of each qdisc or class dump.
+ */
+int tc_sample_stats(int type, void *req, int len,
+		    int (*match)(struct nlmsghdr *n),
+		    unsigned int interval, unsigned int count)
+{
+	double last = 0, now;
+	unsigned int tick;
+	int ret = 0;
+
+	switch (type) {
+	case RTM_GETQDISC:
+		sample_type = RTM_NEWQDISC;
+		break;
+	case RTM_GETTCLASS:
+		sample_type = RTM_NEWTCLASS;
+		break;
+	default:
+		sample_type = RTM_NEWACTION;
+		break;
+	}
+	sample_match = match;
+	sample_gen = 1;
+
+	for (tick = 0; !count || tick <= count; tick++) {
+		if (tick) {
+			double left = last + interval - sample_now();
+
+			if (left > 0) {
+				struct timespec ts = {
+					.tv_sec = left,
+					.tv_nsec = (left - (time_t)left) * 1e9,
+				};
+
+				while (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts,
+						       &ts) == EINTR)
+					;
+			}
+		}
+
+		if (rtnl_dump_request(&rth, type, req, len) < 0) {
+			perror("Cannot send dump request");
+			ret = 1;
+			break;
+		}
+		now = sample_now();
+		sample_elapsed = tick ? now - last : 1;
+		last = now;
+
+		if (tick) {
+			if (timestamp)
+				print_timestamp(stdout);
+			new_json_obj(json);
+		}
+		if (rtnl_dump_filter(&rth, sample_one, NULL) < 0) {
+			fprintf(stderr, "Dump terminated\n");
+			ret = 1;
+		}
+		if (tick) {
+			delete_json_obj();
+			if (!json)
+				printf("\n");
+			fflush(stdout);
+		}
+		if (ret)
+			break;
+		sample_expire();
+		sample_gen++;
+	}
+
+	sample_flush();
+	return ret;
+}
@@ -0,0 +1,877 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * tc_tree.c		"tc tree apply": bring the qdisc/class/filter
+ *			hierarchy of a device in line with a description.
+ *
+ * The description holds "qdisc", "class" and "filter" lines in the syntax
+ * of the matching tc commands, minus the verb and the device.  It is
+ * parsed with the regular parsers, the qdiscs and classes of the device
+ * are dumped once, and the difference is sent as pipelined requests:
+ *
+ *  - filter priorities the description sets again are flushed first, so
+ *    that no filter keeps a class that goes away busy,
+ *  - objects whose kind or parent changed (and with "prune" those the
+ *    description does not mention) are deleted, deepest first, leaving
+ *    out what goes away with a deleted qdisc,
+ *  - the described qdiscs and classes are created or changed parents
+ *    first, so one socket carries the whole tree in order,
+ *  - the filters are added last.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <linux/pkt_sched.h>
+
+#include "utils.h"
+#include "tc_util.h"
+#include "tc_common.h"
+
+#define TREE_WINDOW	256
+#define TREE_HASH_SIZE	4096
+
+struct tree_obj {
+	struct tree_obj	*next;		/* hash chain */
+	struct tree_obj	*up;		/* parent in the same set */
+	__u32		id;		/* X:0 for qdiscs, X:Y for classes */
+	__u32		parent;
+	bool		qdisc;
+	bool		gone;		/* kernel: deleted by the apply */
+	bool		del;		/* kernel: needs its own delete */
+	bool		exists;		/* desired: kernel has it as is */
+	int		depth;
+	unsigned int	line;
+	char		kind[FILTER_NAMESZ];
+	char		*text;		/* desired: description line */
+};
+
+struct tree_set {
+	struct tree_obj	**objs;
+	int		n;
+	int		alloc;
+	struct tree_obj	*hash[TREE_HASH_SIZE];
+};
+
+struct tree_prio {
+	__u32		parent;
+	__u32		chain;
+	__u32		prio;
+};
+
+struct tree_filter {
+	struct tree_prio	key;
+	unsigned int		line;
+	char			*text;
+};
+
+struct tree_ctx {
+	const char		*dev;
+	int			ifindex;
+	bool			prune;
+	bool			dry_run;
+	struct tree_set		want;
+	struct tree_set		have;
+	struct tree_filter	*filters;
+	int			nfilters;
+	struct tree_prio	*prios;	/* kernel filter priorities */
+	int			nprios;
+	int			prios_alloc;
+	__u32			dump_parent;
+	struct rtnl_pipe	*pipe;
+	unsigned int		created, changed, deleted, flushed;
+	unsigned int		errors;
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: tc tree apply dev DEV file FILE [ prune ] [ window NUMBER ]\n"
+		"                     [ dry-run ]\n"
+		"Where: FILE holds one object per line:\n"
+		"       qdisc { root | ingress | clsact | parent CLASSID } handle QHANDLE\n"
+		"             QDISC_KIND [ OPTIONS ]\n"
+		"       class parent CLASSID classid CLASSID QDISC_KIND [ OPTIONS ]\n"
+		"       filter [ parent CLASSID ] [ chain N ] prio N protocol PROTO\n"
+		"             FILTER_KIND [ OPTIONS ]\n");
+}
+
+static unsigned int tree_hashfn(__u32 id)
+{
+	return (id * 0x9e3779b1U) >> 20 & (TREE_HASH_SIZE - 1);
+}
+
+static struct tree_obj *tree_find(struct tree_set *s, __u32 id)
+{
+	struct tree_obj *o;
+
+	for (o = s->hash[tree_hashfn(id)]; o; o = o->next)
+		if (o->id == id)
+			return o;
+	return NULL;
+}
+
+static struct tree_obj *tree_add(struct tree_set *s, __u32 id)
+{
+	struct tree_obj *o;
+
+	if (s->n == s->alloc) {
+		s->alloc = s->alloc ? s->alloc * 2 : 256;
+		s->objs = realloc(s->objs, s->alloc * sizeof(*s->objs));
+		if (!s->objs) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	o = calloc(1, sizeof(*o));
+	if (!o) {
+		perror("calloc");
+		exit(1);
+	}
+	o->id = id;
+	o->next = s->hash[tree_hashfn(id)];
+	s->hash[tree_hashfn(id)] = o;
+	s->objs[s->n++] = o;
+	return o;
+}
+
+static void tree_set_free(struct tree_set *s)
+{
+	int i;
+
+	for (i = 0; i < s->n; i++) {
+		free(s->objs[i]->text);
+		free(s->objs[i]);
+	}
+	free(s->objs);
+}
+
+/*
+ * Top level classes are dumped with the root as parent, the description
+ * names their qdisc: use the qdisc in both.
+ */
+static __u32 tree_class_parent(__u32 id, __u32 parent)
+{
+	return parent == TC_H_ROOT ? TC_H_MAJ(id) : parent;
+}
+
+/* The object a qdisc hangs from is a class, the one of a class X:Y is X: */
+static void tree_link(struct tree_set *s)
+{
+	int i;
+
+	for (i = 0; i < s->n; i++) {
+		struct tree_obj *o = s->objs[i];
+
+		o->up = NULL;
+		if (o->qdisc && (o->parent == TC_H_ROOT ||
+				 o->parent == TC_H_INGRESS))
+			continue;
+		o->up = tree_find(s, o->parent);
+	}
+}
+
+static int tree_depth(struct tree_set *s)
+{
+	int i;
+
+	for (i = 0; i < s->n; i++) {
+		struct tree_obj *o;
+		int depth = 0;
+
+		for (o = s->objs[i]->up; o; o = o->up)
+			if (++depth > s->n) {
+				fprintf(stderr, "line %u: parent loop\n",
+					s->objs[i]->line);
+				return -1;
+			}
+		s->objs[i]->depth = depth;
+	}
+	return 0;
+}
+
+/*
+ * Parse one description line into @n.  The parsers exit on most errors
+ * with a message of their own, so only a few cases return -1 here.
+ */
+static int tree_build(struct tree_ctx *ctx, const char *text,
+		      unsigned int line, struct nlmsghdr *n)
+{
+	char *argv[256] = { NULL, "dev", (char *)ctx->dev };
+	char *str, *tok;
+	int argc = 1, ret = -1;
+
+	str = strdup(text);
+	if (!str) {
+		perror("strdup");
+		exit(1);
+	}
+	tok = strtok(str, " \t");
+	if (!tok)
+		goto out;
+	argc = 3;
+	for (tok = strtok(NULL, " \t"); tok; tok = strtok(NULL, " \t")) {
+		if (argc == ARRAY_SIZE(argv) - 1) {
+			fprintf(stderr, "line %u: too many arguments\n", line);
+			goto out;
+		}
+		argv[argc++] = tok;
+	}
+	argv[argc] = NULL;
+
+	if (strcmp(str, "qdisc") == 0)
+		ret = tc_qdisc_modify(RTM_NEWQDISC, 0, argc - 1, argv + 1, n);
+	else if (strcmp(str, "class") == 0)
+		ret = tc_class_modify(RTM_NEWTCLASS, 0, argc - 1, argv + 1, n);
+	else if (strcmp(str, "filter") == 0)
+		ret = tc_filter_modify(RTM_NEWTFILTER, 0, argc - 1, argv + 1,
+				       n);
+	else
+		fprintf(stderr, "line %u: unknown object \"%s\"\n", line, str);
+	if (ret > 0)
+		ret = -1;
+out:
+	free(str);
+	return ret;
+}
+
+static const char *tree_kind(struct nlmsghdr *n, struct rtattr **tb)
+{
+	struct tcmsg *t = NLMSG_DATA(n);
+
+	parse_rtattr_flags(tb, TCA_MAX, TCA_RTA(t),
+			   n->nlmsg_len - NLMSG_LENGTH(sizeof(*t)),
+			   NLA_F_NESTED);
+	return tb[TCA_KIND] ? rta_getattr_str(tb[TCA_KIND]) : NULL;
+}
+
+static int tree_add_line(struct tree_ctx *ctx, char *text, unsigned int line)
+{
+	struct {
+		struct nlmsghdr	n;
+		char		buf[TCA_BUF_MAX];
+	} req;
+	struct rtattr *tb[TCA_MAX + 1];
+	struct tcmsg *t = NLMSG_DATA(&req.n);
+	struct tree_obj *o;
+	const char *kind;
+	__u32 id;
+
+	if (tree_build(ctx, text, line, &req.n) < 0)
+		return -1;
+
+	kind = tree_kind(&req.n, tb);
+	if (!kind) {
+		fprintf(stderr, "line %u: no kind\n", line);
+		return -1;
+	}
+
+	if (req.n.nlmsg_type == RTM_NEWTFILTER) {
+		struct tree_filter *f;
+
+		if (!TC_H_MAJ(t->tcm_info)) {
+			fprintf(stderr, "line %u: filters need a \"prio\"\n",
+				line);
+			return -1;
+		}
+		if (ctx->nfilters % 256 == 0) {
+			ctx->filters = realloc(ctx->filters,
+					       (ctx->nfilters + 256) *
+					       sizeof(*ctx->filters));
+			if (!ctx->filters) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+		f = &ctx->filters[ctx->nfilters++];
+		f->key.parent = t->tcm_parent;
+		f->key.chain = tb[TCA_CHAIN] ? rta_getattr_u32(tb[TCA_CHAIN]) : 0;
+		f->key.prio = TC_H_MAJ(t->tcm_info) >> 16;
+		f->line = line;
+		f->text = strdup(text);
+		return 0;
+	}
+
+	id = t->tcm_handle;
+	if (req.n.nlmsg_type == RTM_NEWQDISC) {
+		if (!TC_H_MAJ(id) || TC_H_MIN(id)) {
+			fprintf(stderr, "line %u: qdiscs need a \"handle\"\n",
+				line);
+			return -1;
+		}
+	} else if (!TC_H_MIN(id)) {
+		fprintf(stderr, "line %u: classes need a \"classid\"\n", line);
+		return -1;
+	}
+	if (!t->tcm_parent) {
+		fprintf(stderr, "line %u: no parent\n", line);
+		return -1;
+	}
+
+	o = tree_find(&ctx->want, id);
+	if (o) {
+		fprintf(stderr, "line %u: %x:%x already set on line %u\n",
+			line, TC_H_MAJ(id) >> 16, TC_H_MIN(id), o->line);
+		return -1;
+	}
+	o = tree_add(&ctx->want, id);
+	o->qdisc = req.n.nlmsg_type == RTM_NEWQDISC;
+	o->parent = o->qdisc ? t->tcm_parent :
+		    tree_class_parent(id, t->tcm_parent);
+	o->line = line;
+	strlcpy(o->kind, kind, sizeof(o->kind));
+	o->text = strdup(text);
+	return 0;
+}
+
+static int tree_read(struct tree_ctx *ctx, const char *name)
+{
+	unsigned int lineno = 0;
+	char *line = NULL;
+	size_t len = 0;
+	int ret = 0;
+	FILE *fp;
+
+	fp = strcmp(name, "-") ? fopen(name, "r") : stdin;
+	if (!fp) {
+		fprintf(stderr, "Cannot open \"%s\": %s\n", name,
+			strerror(errno));
+		return -1;
+	}
+
+	while (getline(&line, &len, fp) > 0) {
+		char *p = line;
+
+		lineno++;
+		p[strcspn(p, "#\r\n")] = '\0';
+		while (isspace(*p))
+			p++;
+		if (*p == '\0')
+			continue;
+
+		ret = tree_add_line(ctx, p, lineno);
+		if (ret < 0)
+			break;
+	}
+
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+	return ret;
+}
+
+static int tree_dump_obj(struct nlmsghdr *n, void *arg)
+{
+	struct tree_ctx *ctx = arg;
+	struct tcmsg *t = NLMSG_DATA(n);
+	struct rtattr *tb[TCA_MAX + 1];
+	struct tree_obj *o;
+	const char *kind;
+
+	if (n->nlmsg_type != RTM_NEWQDISC && n->nlmsg_type != RTM_NEWTCLASS)
+		return 0;
+	if (t->tcm_ifindex != ctx->ifindex)
+		return 0;
+	/* default qdiscs come and go with their parents */
+	if (n->nlmsg_type == RTM_NEWQDISC &&
+	    (!TC_H_MAJ(t->tcm_handle) ||
+	     (t->tcm_handle >= 0x80000000U &&
+	      TC_H_MAJ(t->tcm_handle) != TC_H_MAJ(TC_H_INGRESS))))
+		return 0;
+	kind = tree_kind(n, tb);
+	if (!kind || tree_find(&ctx->have, t->tcm_handle))
+		return 0;
+
+	o = tree_add(&ctx->have, t->tcm_handle);
+	o->qdisc = n->nlmsg_type == RTM_NEWQDISC;
+	o->parent = o->qdisc ? t->tcm_parent :
+		    tree_class_parent(t->tcm_handle, t->tcm_parent);
+	strlcpy(o->kind, kind, sizeof(o->kind));
+	return 0;
+}
+
+static int tree_dump_prio(struct nlmsghdr *n, void *arg)
+{
+	struct tree_ctx *ctx = arg;
+	struct tcmsg *t = NLMSG_DATA(n);
+	struct rtattr *tb[TCA_MAX + 1];
+	struct tree_prio p;
+	int i;
+
+	if (n->nlmsg_type != RTM_NEWTFILTER)
+		return 0;
+
+	tree_kind(n, tb);
+	p.parent = ctx->dump_parent;
+	p.chain = tb[TCA_CHAIN] ? rta_getattr_u32(tb[TCA_CHAIN]) : 0;
+	p.prio = TC_H_MAJ(t->tcm_info) >> 16;
+
+	/* a dump lists every filter, the priorities of one parent are few */
+	for (i = ctx->nprios - 1; i >= 0; i--)
+		if (!memcmp(&ctx->prios[i], &p, sizeof(p)))
+			return 0;
+
+	if (ctx->nprios == ctx->prios_alloc) {
+		ctx->prios_alloc = ctx->prios_alloc ? ctx->prios_alloc * 2 : 64;
+		ctx->prios = realloc(ctx->prios,
+				     ctx->prios_alloc * sizeof(*ctx->prios));
+		if (!ctx->prios) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	ctx->prios[ctx->nprios++] = p;
+	return 0;
+}
+
+static int tree_dump(struct tree_ctx *ctx, int type, __u32 parent,
+		     rtnl_filter_t filter)
+{
+	struct tcmsg t = {
+		.tcm_family = AF_UNSPEC,
+		.tcm_ifindex = ctx->ifindex,
+		.tcm_parent = parent,
+	};
+
+	if (rtnl_dump_request(&rth, type, &t, sizeof(t)) < 0) {
+		perror("Cannot send dump request");
+		return -1;
+	}
+	if (rtnl_dump_filter(&rth, filter, ctx) < 0) {
+		fprintf(stderr, "Dump terminated\n");
+		return -1;
+	}
+	return 0;
+}
+
+/* The root level qdisc an object sits under */
+static struct tree_obj *tree_top(struct tree_obj *o)
+{
+	while (o->up)
+		o = o->up;
+	return o;
+}
+
+static bool tree_same(const struct tree_obj *a, const struct tree_obj *b)
+{
+	return a->qdisc == b->qdisc && a->parent == b->parent &&
+	       !strcmp(a->kind, b->kind);
+}
+
+/*
+ * Work out which kernel objects go and which of them need a delete of
+ * their own: deleting a qdisc takes everything below it, deleting a class
+ * takes its leaf qdisc, but a class with child classes cannot be deleted.
+ */
+static void tree_diff(struct tree_ctx *ctx)
+{
+	int i;
+
+	for (i = 0; i < ctx->have.n; i++) {
+		struct tree_obj *k = ctx->have.objs[i];
+		struct tree_obj *w = tree_find(&ctx->want, k->id);
+
+		if (w)
+			k->gone = !tree_same(k, w);
+		else if (ctx->prune)
+			k->gone = tree_find(&ctx->want, tree_top(k)->id) != NULL;
+	}
+
+	for (i = 0; i < ctx->have.n; i++) {
+		struct tree_obj *k = ctx->have.objs[i], *a;
+		bool below_qdisc = k->qdisc;
+
+		k->del = k->gone;
+		for (a = k->up; a; a = a->up) {
+			if (a->gone) {
+				k->gone = true;
+				if (below_qdisc || a->qdisc) {
+					k->del = false;
+					break;
+				}
+				k->del = true;
+			}
+			below_qdisc |= a->qdisc;
+		}
+	}
+
+	for (i = 0; i < ctx->want.n; i++) {
+		struct tree_obj *w = ctx->want.objs[i];
+		struct tree_obj *k = tree_find(&ctx->have, w->id);
+
+		w->exists = k && !k->gone && tree_same(k, w);
+	}
+}
+
+static int tree_cmp_deepest(const void *a, const void *b)
+{
+	const struct tree_obj *x = *(const struct tree_obj **)a;
+	const struct tree_obj *y = *(const struct tree_obj **)b;
+
+	return y->depth - x->depth;
+}
+
+static int tree_cmp_parents_first(const void *a, const void *b)
+{
+	const struct tree_obj *x = *(const struct tree_obj **)a;
+	const struct tree_obj *y = *(const struct tree_obj **)b;
+
+	if (x->depth != y->depth)
+		return x->depth - y->depth;
+	return x->line - y->line;
+}
+
+/*
+ * Qdisc kinds whose kernel ops have no change callback: a change request
+ * is refused with -EINVAL, they keep the options they were created with.
+ */
+static const char * const tree_fixed_kinds[] = {
+	"atm", "cbq", "clsact", "drr", "dsmark", "etf", "htb", "ingress",
+	"mq", "mqprio", "pfifo_fast", "qfq",
+};
+
+static bool tree_kind_fixed(const char *kind)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(tree_fixed_kinds); i++)
+		if (!strcmp(kind, tree_fixed_kinds[i]))
+			return true;
+	return false;
+}
+
+/*
+ * The cookie of a request is what it was built from: the tree_obj of a
+ * qdisc or class change or delete, the tree_filter of a filter add and
+ * the tree_prio of a filter flush.
+ */
+static int tree_reply(struct nlmsghdr *n, int error, void *cookie, void *arg)
+{
+	struct tree_ctx *ctx = arg;
+	struct nlmsgerr *err = NLMSG_DATA(n);
+	const struct tree_filter *f = cookie;
+	const struct tree_prio *p = cookie;
+	const struct tree_obj *o = cookie;
+
+	if (n->nlmsg_type != NLMSG_ERROR || !error)
+		return 0;
+
+	if (err->msg.nlmsg_type == RTM_NEWQDISC &&
+	    !(err->msg.nlmsg_flags & NLM_F_CREATE) &&
+	    (error == -EINVAL || error == -EOPNOTSUPP) &&
+	    tree_kind_fixed(o->kind)) {
+		if (show_stats)
+			fprintf(stderr, "line %u: qdisc options kept: RTNETLINK answers: %s\n",
+				o->line, strerror(-error));
+		return 0;
+	}
+
+	ctx->errors++;
+	switch (err->msg.nlmsg_type) {
+	case RTM_NEWQDISC:
+	case RTM_NEWTCLASS:
+		fprintf(stderr, "line %u: RTNETLINK answers: %s\n",
+			o->line, strerror(-error));
+		break;
+	case RTM_NEWTFILTER:
+		fprintf(stderr, "line %u: RTNETLINK answers: %s\n",
+			f->line, strerror(-error));
+		break;
+	case RTM_DELTFILTER:
+		fprintf(stderr, "flush filters prio %u: RTNETLINK answers: %s\n",
+			p->prio, strerror(-error));
+		break;
+	default:
+		fprintf(stderr, "delete %s %x:%x: RTNETLINK answers: %s\n",
+			o->qdisc ? "qdisc" : "class",
+			TC_H_MAJ(o->id) >> 16, TC_H_MIN(o->id),
+			strerror(-error));
+		break;
+	}
+	return 0;
+}
+
+static int tree_send_del(struct tree_ctx *ctx, int type, __u32 parent,
+			 __u32 handle, __u32 info, __u32 chain, void *cookie)
+{
+	struct {
+		struct nlmsghdr	n;
+		struct tcmsg	t;
+		char		buf[64];
+	} req = {
+		.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg)),
+		.n.nlmsg_type = type,
+		.t.tcm_family = AF_UNSPEC,
+		.t.tcm_ifindex = ctx->ifindex,
+		.t.tcm_parent = parent,
+		.t.tcm_handle = handle,
+		.t.tcm_info = info,
+	};
+
+	if (type == RTM_DELTFILTER)
+		addattr32(&req.n, sizeof(req), TCA_CHAIN, chain);
+	return rtnl_pipe_send(ctx->pipe, &req.n, cookie);
+}
+
+static bool tree_prio_wanted(struct tree_ctx *ctx, const struct tree_prio *p)
+{
+	int i;
+
+	for (i = 0; i < ctx->nfilters; i++)
+		if (!memcmp(&ctx->filters[i].key, p, sizeof(*p)))
+			return true;
+	return false;
+}
+
+/* The filter priorities to flush: the ones set again, with prune all */
+static int tree_flush_prios(struct tree_ctx *ctx)
+{
+	SPRINT_BUF(b1);
+	int i, j;
+
+	for (i = 0; i < ctx->nfilters; i++) {
+		__u32 parent = ctx->filters[i].key.parent;
+		struct tree_obj *k;
+
+		for (j = 0; j < i; j++)
+			if (ctx->filters[j].key.parent == parent)
+				break;
+		if (j < i)
+			continue;
+
+		/* filters of a qdisc that goes away go with it */
+		k = tree_find(&ctx->have, TC_H_MAJ(parent));
+		if (parent && (!k || k->gone))
+			continue;
+
+		ctx->dump_parent = parent;
+		if (tree_dump(ctx, RTM_GETTFILTER, parent, tree_dump_prio) < 0)
+			return -1;
+	}
+
+	for (i = 0; i < ctx->nprios; i++) {
+		struct tree_prio *p = &ctx->prios[i];
+
+		if (!ctx->prune && !tree_prio_wanted(ctx, p))
+			continue;
+		ctx->flushed++;
+		if (ctx->dry_run) {
+			printf("flush filters parent %s chain %u prio %u\n",
+			       sprint_tc_classid(p->parent, b1), p->chain,
+			       p->prio);
+			continue;
+		}
+		if (tree_send_del(ctx, RTM_DELTFILTER, p->parent, 0,
+				  TC_H_MAKE(p->prio << 16, 0), p->chain, p) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int tree_delete(struct tree_ctx *ctx)
+{
+	struct tree_obj **del;
+	int i, n = 0;
+
+	del = calloc(ctx->have.n + 1, sizeof(*del));
+	if (!del) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < ctx->have.n; i++)
+		if (ctx->have.objs[i]->del)
+			del[n++] = ctx->have.objs[i];
+	qsort(del, n, sizeof(*del), tree_cmp_deepest);
+
+	for (i = 0; i < n; i++) {
+		struct tree_obj *k = del[i];
+
+		ctx->deleted++;
+		if (ctx->dry_run) {
+			printf("delete %s %s %x:%x\n",
+			       k->qdisc ? "qdisc" : "class", k->kind,
+			       TC_H_MAJ(k->id) >> 16, TC_H_MIN(k->id));
+			continue;
+		}
+		if (tree_send_del(ctx, k->qdisc ? RTM_DELQDISC : RTM_DELTCLASS,
+				  k->qdisc ? k->parent : 0, k->id, 0, 0, k) < 0) {
+			free(del);
+			return -1;
+		}
+	}
+	free(del);
+	return 0;
+}
+
+static int tree_create(struct tree_ctx *ctx)
+{
+	struct {
+		struct nlmsghdr	n;
+		char		buf[TCA_BUF_MAX];
+	} req;
+	struct tree_obj **objs;
+	int i;
+
+	objs = malloc((ctx->want.n + 1) * sizeof(*objs));
+	if (!objs) {
+		perror("malloc");
+		exit(1);
+	}
+	memcpy(objs, ctx->want.objs, ctx->want.n * sizeof(*objs));
+	qsort(objs, ctx->want.n, sizeof(*objs), tree_cmp_parents_first);
+
+	for (i = 0; i < ctx->want.n; i++) {
+		struct tree_obj *w = objs[i];
+
+		if (w->exists)
+			ctx->changed++;
+		else
+			ctx->created++;
+		if (ctx->dry_run) {
+			printf("%s %s\n", w->exists ? "change" : "create",
+			       w->text);
+			continue;
+		}
+
+		if (tree_build(ctx, w->text, w->line, &req.n) < 0)
+			goto err;
+		/*
+		 * Classes are created or changed as the kernel finds them,
+		 * a new qdisc replaces the default one of its parent.
+		 */
+		if (!w->qdisc)
+			req.n.nlmsg_flags |= NLM_F_CREATE;
+		else if (!w->exists)
+			req.n.nlmsg_flags |= NLM_F_CREATE | NLM_F_REPLACE;
+		if (rtnl_pipe_send(ctx->pipe, &req.n, w) < 0)
+			goto err;
+	}
+
+	for (i = 0; i < ctx->nfilters; i++) {
+		struct tree_filter *f = &ctx->filters[i];
+
+		if (ctx->dry_run) {
+			printf("add %s\n", f->text);
+			continue;
+		}
+		if (tree_build(ctx, f->text, f->line, &req.n) < 0)
+			goto err;
+		req.n.nlmsg_flags |= NLM_F_CREATE | NLM_F_EXCL;
+		if (rtnl_pipe_send(ctx->pipe, &req.n, f) < 0)
+			goto err;
+	}
+
+	free(objs);
+	return 0;
+err:
+	free(objs);
+	return -1;
+}
+
+static int tree_apply(int argc, char **argv)
+{
+	struct tree_ctx ctx = {};
+	unsigned int window = TREE_WINDOW;
+	struct rtnl_pipe pipe;
+	const char *file = NULL;
+	struct timespec t0, t1;
+	int ret = -1;
+
+	while (argc > 0) {
+		if (strcmp(*argv, "dev") == 0) {
+			NEXT_ARG();
+			if (ctx.dev)
+				duparg("dev", *argv);
+			ctx.dev = *argv;
+		} else if (strcmp(*argv, "file") == 0) {
+			NEXT_ARG();
+			file = *argv;
+		} else if (strcmp(*argv, "prune") == 0) {
+			ctx.prune = true;
+		} else if (strcmp(*argv, "window") == 0) {
+			NEXT_ARG();
+			if (get_unsigned(&window, *argv, 0) || !window)
+				invarg("invalid window", *argv);
+		} else if (strcmp(*argv, "dry-run") == 0) {
+			ctx.dry_run = true;
+		} else if (strcmp(*argv, "help") == 0) {
+			usage();
+			return 0;
+		} else {
+			fprintf(stderr, "What is \"%s\"? Try \"tc tree help\".\n",
+				*argv);
+			return -1;
+		}
+		argc--; argv++;
+	}
+
+	if (!ctx.dev || !file) {
+		fprintf(stderr, "\"dev\" and \"file\" are required.\n");
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	ll_init_map(&rth);
+	ctx.ifindex = ll_name_to_index(ctx.dev);
+	if (!ctx.ifindex)
+		return -nodev(ctx.dev);
+
+	if (tree_read(&ctx, file) < 0)
+		goto out;
+	if (tree_dump(&ctx, RTM_GETQDISC, 0, tree_dump_obj) < 0 ||
+	    tree_dump(&ctx, RTM_GETTCLASS, 0, tree_dump_obj) < 0)
+		goto out;
+
+	tree_link(&ctx.want);
+	tree_link(&ctx.have);
+	if (tree_depth(&ctx.want) < 0 || tree_depth(&ctx.have) < 0)
+		goto out;
+	tree_diff(&ctx);
+
+	if (!ctx.dry_run) {
+		rtnl_pipe_init(&pipe, &rth, window, tree_reply, &ctx);
+		ctx.pipe = &pipe;
+	}
+
+	if (tree_flush_prios(&ctx) < 0 || tree_delete(&ctx) < 0 ||
+	    tree_create(&ctx) < 0)
+		goto out;
+
+	ret = 0;
+	if (!ctx.dry_run && (rtnl_pipe_flush(&pipe) < 0 || ctx.errors))
+		ret = -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if (show_stats || ctx.dry_run)
+		printf("%u created, %u changed, %u deleted, %u filter priorities flushed, %d filters, %.3fs\n",
+		       ctx.created, ctx.changed, ctx.deleted, ctx.flushed,
+		       ctx.nfilters, t1.tv_sec - t0.tv_sec +
+		       (t1.tv_nsec - t0.tv_nsec) / 1e9);
+out:
+	tree_set_free(&ctx.want);
+	tree_set_free(&ctx.have);
+	while (ctx.nfilters--)
+		free(ctx.filters[ctx.nfilters].text);
+	free(ctx.filters);
+	free(ctx.prios);
+	return ret;
+}
+
+int do_tree(int argc, char **argv)
+{
+	if (argc < 1 || matches(*argv, "help") == 0) {
+		usage();
+		return 0;
+	}
+
+	if (matches(*argv, "apply") == 0)
+		return tree_apply(argc - 1, argv + 1);
+
+	fprintf(stderr, "Command \"%s\" is unknown, try \"tc tree help\".\n",
+		*argv);
+	return -1;
+}
@@ -0,0 +1,681 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * tc_u32.c		"tc u32 bulk": install a file of u32 rules through
+ *			hash tables built on the fly.
+ *
+ * The rules all match on a common key word and are spread over hash
+ * tables created on the fly.  The tables are sized to the rule count (at
+ * most 256 buckets), hashed on the 8 bit window of the key that spreads
+ * the rules best, and buckets that still hold more than "threshold" rules
+ * are split again on another window.  Rules keep their file order inside
+ * every bucket, so the result matches what a linear table would.  The
+ * hash tables and rules are installed first, the filter that links the
+ * root table to them is sent last, so nothing is reachable early.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/pkt_cls.h>
+
+#include "rt_names.h"
+#include "utils.h"
+#include "tc_util.h"
+#include "tc_common.h"
+
+#define U32_BULK_WINDOW		256
+#define U32_BULK_THRESHOLD	8
+#define U32_BULK_DEPTH		3
+#define U32_BULK_PLACEHOLDER	0x00100000	/* "ht 1:0:" */
+
+struct u32_bulk_rule {
+	unsigned int		line;
+	struct nlmsghdr		*n;
+	struct tc_u32_sel	*sel;
+	__u32			*hash;
+};
+
+struct u32_bulk_table {
+	__u32			htid;
+	unsigned int		divisor;
+};
+
+struct u32_bulk_link {
+	__u32			ht;	/* htid and bucket of the link */
+	__u32			child;
+	__u32			hmask;
+	int			hoff;
+};
+
+struct u32_bulk_win {
+	int			off;
+	int			shift;
+	unsigned int		divisor;
+	unsigned int		max;
+};
+
+struct u32_bulk {
+	struct filter_util	*qu;
+	struct nlmsghdr		*prefix;
+	unsigned int		threshold;
+
+	struct u32_bulk_rule	*rules;
+	int			nrules;
+	int			rules_alloc;
+	struct u32_bulk_table	*tables;
+	int			ntables;
+	int			tables_alloc;
+	struct u32_bulk_link	*links;
+	int			nlinks;
+	int			links_alloc;
+
+	__u8			used[0x1000 / 8];
+	unsigned int		next_htid;
+
+	struct rtnl_pipe	*pipe;
+};
+
+/* Run the regular u32 parser on top of the headers of the bulk request */
+static int u32_bulk_parse(struct u32_bulk *b, char *handle, int argc,
+			  char **argv, struct nlmsghdr *n)
+{
+	memcpy(n, b->prefix, b->prefix->nlmsg_len);
+	return b->qu->parse_fopt(b->qu, handle, argc, argv, n);
+}
+
+static int u32_bulk_rule_add(struct u32_bulk *b, unsigned int line, char *str)
+{
+	struct {
+		struct nlmsghdr	n;
+		char		buf[MAX_MSG];
+	} req;
+	struct rtattr *tb[TCA_MAX + 1], *opt[TCA_U32_MAX + 1];
+	struct u32_bulk_rule *r;
+	char *argv[256] = { "ht", "1:0:", "order", "1" };
+	int argc = 4;
+	struct tcmsg *t;
+	char *tok;
+
+	for (tok = strtok(str, " \t"); tok; tok = strtok(NULL, " \t")) {
+		if (argc == ARRAY_SIZE(argv) - 1) {
+			fprintf(stderr, "line %u: too many arguments\n", line);
+			return -1;
+		}
+		argv[argc++] = tok;
+	}
+	argv[argc] = NULL;
+
+	if (u32_bulk_parse(b, NULL, argc, argv, &req.n)) {
+		fprintf(stderr, "line %u: cannot parse rule\n", line);
+		return -1;
+	}
+
+	t = NLMSG_DATA(&req.n);
+	parse_rtattr(tb, TCA_MAX, TCA_RTA(t),
+		     req.n.nlmsg_len - NLMSG_LENGTH(sizeof(*t)));
+	if (!tb[TCA_OPTIONS])
+		return -1;
+	parse_rtattr_nested(opt, TCA_U32_MAX, tb[TCA_OPTIONS]);
+	if (!opt[TCA_U32_SEL]) {
+		fprintf(stderr, "line %u: rule has no \"match\"\n", line);
+		return -1;
+	}
+	if (opt[TCA_U32_LINK] || opt[TCA_U32_DIVISOR] ||
+	    rta_getattr_u32(opt[TCA_U32_HASH]) != U32_BULK_PLACEHOLDER ||
+	    TC_U32_NODE(t->tcm_handle) != 1) {
+		fprintf(stderr,
+			"line %u: \"ht\", \"order\", \"link\" and \"divisor\" are set by \"bulk\"\n",
+			line);
+		return -1;
+	}
+
+	b->rules = tc_grow(b->rules, &b->rules_alloc, b->nrules + 1,
+			   sizeof(*b->rules));
+	r = &b->rules[b->nrules++];
+	r->line = line;
+	r->n = malloc(req.n.nlmsg_len);
+	if (!r->n) {
+		perror("malloc");
+		exit(1);
+	}
+	memcpy(r->n, &req.n, req.n.nlmsg_len);
+	r->sel = (void *)r->n + ((void *)RTA_DATA(opt[TCA_U32_SEL]) - (void *)&req);
+	r->hash = (void *)r->n + ((void *)RTA_DATA(opt[TCA_U32_HASH]) - (void *)&req);
+	return 0;
+}
+
+static int u32_bulk_read(struct u32_bulk *b, const char *name)
+{
+	unsigned int lineno = 0;
+	char *line = NULL;
+	size_t len = 0;
+	int ret = 0;
+	FILE *fp;
+
+	fp = strcmp(name, "-") ? fopen(name, "r") : stdin;
+	if (!fp) {
+		fprintf(stderr, "Cannot open \"%s\": %s\n", name,
+			strerror(errno));
+		return -1;
+	}
+
+	while (getline(&line, &len, fp) > 0) {
+		char *p = line;
+
+		lineno++;
+		p[strcspn(p, "#\r\n")] = '\0';
+		while (isspace(*p))
+			p++;
+		if (*p == '\0')
+			continue;
+
+		ret = u32_bulk_rule_add(b, lineno, p);
+		if (ret < 0)
+			break;
+	}
+
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+	return ret;
+}
+
+static struct tc_u32_key *u32_bulk_key(struct tc_u32_sel *sel, int off)
+{
+	int i;
+
+	for (i = 0; i < sel->nkeys; i++)
+		if (sel->keys[i].off == off && !sel->keys[i].offmask)
+			return &sel->keys[i];
+	return NULL;
+}
+
+static unsigned int u32_bulk_hash(struct tc_u32_sel *sel,
+				  const struct u32_bulk_win *w)
+{
+	return (ntohl(u32_bulk_key(sel, w->off)->val) >> w->shift) &
+	       (w->divisor - 1);
+}
+
+/*
+ * Find the key word and bit window all rules match exactly on that leaves
+ * the fullest bucket emptiest.  Fails unless it beats a single bucket.
+ */
+static int u32_bulk_window(struct u32_bulk *b, int *idx, int n,
+			   struct u32_bulk_win *best)
+{
+	struct tc_u32_sel *first = b->rules[idx[0]].sel;
+	unsigned int divisor = 2, *count;
+	int i, k, bits, shift;
+
+	while (divisor < 0x100 && divisor < n)
+		divisor <<= 1;
+	bits = ffs(divisor) - 1;
+
+	count = malloc(divisor * sizeof(*count));
+	if (!count) {
+		perror("malloc");
+		exit(1);
+	}
+
+	best->max = n;
+	for (k = 0; k < first->nkeys; k++) {
+		struct tc_u32_key *key = &first->keys[k];
+		__u32 common;
+
+		if (key->offmask)
+			continue;
+
+		common = ntohl(key->mask);
+		for (i = 1; i < n && common; i++) {
+			struct tc_u32_key *o;
+
+			o = u32_bulk_key(b->rules[idx[i]].sel, key->off);
+			common = o ? common & ntohl(o->mask) : 0;
+		}
+
+		for (shift = 0; shift + bits <= 32; shift++) {
+			struct u32_bulk_win w = {
+				.off = key->off,
+				.shift = shift,
+				.divisor = divisor,
+			};
+			__u32 win = (divisor - 1) << shift;
+
+			if ((common & win) != win)
+				continue;
+
+			memset(count, 0, divisor * sizeof(*count));
+			for (i = 0; i < n && w.max < best->max; i++) {
+				unsigned int h;
+
+				h = u32_bulk_hash(b->rules[idx[i]].sel, &w);
+				if (++count[h] > w.max)
+					w.max = count[h];
+			}
+			if (w.max < best->max)
+				*best = w;
+		}
+	}
+
+	free(count);
+	return best->max < n ? 0 : -1;
+}
+
+static int u32_bulk_htid(struct u32_bulk *b, __u32 *htid)
+{
+	/* stay clear of the IDs the kernel hands out from 0x800 */
+	for (; b->next_htid < 0x800; b->next_htid++) {
+		if (b->used[b->next_htid / 8] & (1 << (b->next_htid % 8)))
+			continue;
+		*htid = b->next_htid++ << 20;
+		return 0;
+	}
+	fprintf(stderr, "Out of free hash table IDs\n");
+	return -1;
+}
+
+/*
+ * Spread the rules @idx over a new hash table.  Returns 1 if no key window
+ * does better than a linear list.
+ */
+static int u32_bulk_table(struct u32_bulk *b, int *idx, int n, int depth,
+			  struct u32_bulk_win *w, __u32 *htid)
+{
+	unsigned int *start, h;
+	int *sorted, i, ret;
+
+	if (n < 2 || u32_bulk_window(b, idx, n, w) < 0)
+		return 1;
+	if (u32_bulk_htid(b, htid) < 0)
+		return -1;
+
+	b->tables = tc_grow(b->tables, &b->tables_alloc, b->ntables + 1,
+			    sizeof(*b->tables));
+	b->tables[b->ntables].htid = *htid;
+	b->tables[b->ntables].divisor = w->divisor;
+	b->ntables++;
+
+	/* stable counting sort into buckets keeps the file order */
+	start = calloc(w->divisor + 1, sizeof(*start));
+	sorted = malloc(n * sizeof(*sorted));
+	if (!start || !sorted) {
+		perror("malloc");
+		exit(1);
+	}
+	for (i = 0; i < n; i++)
+		start[u32_bulk_hash(b->rules[idx[i]].sel, w) + 1]++;
+	for (h = 0; h < w->divisor; h++)
+		start[h + 1] += start[h];
+	for (i = 0; i < n; i++)
+		sorted[start[u32_bulk_hash(b->rules[idx[i]].sel, w)]++] = idx[i];
+	for (h = w->divisor; h > 0; h--)
+		start[h] = start[h - 1];
+	start[0] = 0;
+
+	for (h = 0, ret = 0; h < w->divisor && ret >= 0; h++) {
+		int m = start[h + 1] - start[h];
+		int *sub = sorted + start[h];
+
+		if (!m)
+			continue;
+
+		if (m > b->threshold && depth + 1 < U32_BULK_DEPTH) {
+			struct u32_bulk_win cw;
+			__u32 child;
+
+			ret = u32_bulk_table(b, sub, m, depth + 1, &cw, &child);
+			if (ret < 0)
+				break;
+			if (ret == 0) {
+				b->links = tc_grow(b->links, &b->links_alloc,
+						   b->nlinks + 1,
+						   sizeof(*b->links));
+				b->links[b->nlinks++] = (struct u32_bulk_link) {
+					.ht = *htid | h << 12,
+					.child = child,
+					.hmask = (cw.divisor - 1) << cw.shift,
+					.hoff = cw.off,
+				};
+				continue;
+			}
+		}
+
+		if (m > 0xfff) {
+			fprintf(stderr, "More than %d rules share a hash bucket\n",
+				0xfff);
+			ret = -1;
+			break;
+		}
+		for (i = 0; i < m; i++) {
+			struct u32_bulk_rule *r = &b->rules[sub[i]];
+			struct tcmsg *t = NLMSG_DATA(r->n);
+
+			*r->hash = *htid | h << 12;
+			t->tcm_handle = *htid | h << 12 | (i + 1);
+		}
+		ret = 0;
+	}
+
+	free(start);
+	free(sorted);
+	return ret < 0 ? -1 : 0;
+}
+
+static int u32_bulk_used(struct nlmsghdr *n, void *arg)
+{
+	struct u32_bulk *b = arg;
+	struct tcmsg *t = NLMSG_DATA(n);
+	struct rtattr *tb[TCA_MAX + 1];
+	__u32 id;
+
+	if (n->nlmsg_type != RTM_NEWTFILTER)
+		return 0;
+
+	parse_rtattr(tb, TCA_MAX, TCA_RTA(t),
+		     n->nlmsg_len - NLMSG_LENGTH(sizeof(*t)));
+	if (!tb[TCA_KIND] || strcmp(rta_getattr_str(tb[TCA_KIND]), "u32"))
+		return 0;
+
+	id = TC_U32_USERHTID(t->tcm_handle);
+	b->used[id / 8] |= 1 << (id % 8);
+	return 0;
+}
+
+/* Hash table IDs are shared by every u32 instance under the parent */
+static int u32_bulk_scan(struct u32_bulk *b)
+{
+	struct {
+		struct nlmsghdr	n;
+		struct tcmsg	t;
+	} req = {
+		.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg)),
+		.n.nlmsg_type = RTM_GETTFILTER,
+	};
+	struct tcmsg *t = NLMSG_DATA(b->prefix);
+
+	req.t.tcm_family = AF_UNSPEC;
+	req.t.tcm_ifindex = t->tcm_ifindex;
+	req.t.tcm_parent = t->tcm_parent;
+
+	if (rtnl_dump_request_n(&rth, &req.n) < 0) {
+		perror("Cannot send dump request");
+		return -1;
+	}
+	if (rtnl_dump_filter(&rth, u32_bulk_used, b) < 0) {
+		fprintf(stderr, "Dump terminated\n");
+		return -1;
+	}
+	return 0;
+}
+
+/* The cookie of a request is its rule, or the handle of the hash table
+ * (htid) or link (ht) it belongs to for the filters u32_bulk adds itself.
+ */
+static int u32_bulk_reply(struct nlmsghdr *n, int error, void *cookie,
+			  void *arg)
+{
+	struct u32_bulk *b = arg;
+	struct u32_bulk_rule *r = cookie;
+
+	if (n->nlmsg_type != NLMSG_ERROR || !error)
+		return 0;
+
+	if (r >= b->rules && r < b->rules + b->nrules)
+		fprintf(stderr, "line %u: RTNETLINK answers: %s\n",
+			r->line, strerror(-error));
+	else
+		fprintf(stderr, "u32 ht %x:%x: RTNETLINK answers: %s\n",
+			TC_U32_USERHTID(*(__u32 *)cookie),
+			TC_U32_HASH(*(__u32 *)cookie), strerror(-error));
+	return 0;
+}
+
+static int u32_bulk_install(struct u32_bulk *b)
+{
+	struct {
+		struct nlmsghdr	n;
+		char		buf[MAX_MSG];
+	} req;
+	char handle[16], divisor[16], ht[16], link[16], mask[16], off[16];
+	int i;
+
+	for (i = 0; i < b->ntables; i++) {
+		char *argv[] = { "divisor", divisor, NULL };
+
+		snprintf(handle, sizeof(handle), "%x:",
+			 TC_U32_USERHTID(b->tables[i].htid));
+		snprintf(divisor, sizeof(divisor), "%u", b->tables[i].divisor);
+		if (u32_bulk_parse(b, handle, 2, argv, &req.n) ||
+		    rtnl_pipe_send(b->pipe, &req.n, &b->tables[i].htid) < 0)
+			return -1;
+	}
+
+	for (i = 0; i < b->nrules; i++)
+		if (rtnl_pipe_send(b->pipe, b->rules[i].n, &b->rules[i]) < 0)
+			return -1;
+
+	/* links were recorded bottom up, so no table is reachable early */
+	for (i = 0; i < b->nlinks; i++) {
+		struct u32_bulk_link *l = &b->links[i];
+		char *argv[] = {
+			"ht", ht, "order", "1", "match", "u32", "0", "0",
+			"link", link, "hashkey", "mask", mask, "at", off,
+			NULL
+		};
+
+		snprintf(ht, sizeof(ht), "%x:%x:", TC_U32_USERHTID(l->ht),
+			 TC_U32_HASH(l->ht));
+		snprintf(link, sizeof(link), "%x:", TC_U32_USERHTID(l->child));
+		snprintf(mask, sizeof(mask), "0x%08x", l->hmask);
+		snprintf(off, sizeof(off), "%d", l->hoff);
+		if (u32_bulk_parse(b, NULL, ARRAY_SIZE(argv) - 1, argv,
+				   &req.n) ||
+		    rtnl_pipe_send(b->pipe, &req.n, &l->ht) < 0)
+			return -1;
+	}
+
+	return rtnl_pipe_flush(b->pipe) < 0 || b->pipe->errors ? -1 : 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: tc u32 bulk dev STRING { ingress | egress | root | parent CLASSID }\n"
+		"	prio PRIO file FILE [ protocol PROTO ] [ chain CHAIN_INDEX ]\n"
+		"	[ threshold NUMBER ] [ window NUMBER ]\n"
+		"\n"
+		"FILE holds one rule per line with the options of a single u32 filter.\n");
+}
+
+/* Headers and kind every request of the bulk shares */
+static void u32_bulk_prefix(struct nlmsghdr *n, int ifindex, __u32 parent,
+			    __u32 prio, __u16 protocol, __u32 *chain)
+{
+	struct tcmsg *t = NLMSG_DATA(n);
+
+	n->nlmsg_len = NLMSG_LENGTH(sizeof(*t));
+	n->nlmsg_flags = NLM_F_REQUEST | NLM_F_EXCL | NLM_F_CREATE;
+	n->nlmsg_type = RTM_NEWTFILTER;
+	memset(t, 0, sizeof(*t));
+	t->tcm_family = AF_UNSPEC;
+	t->tcm_ifindex = ifindex;
+	t->tcm_parent = parent;
+	t->tcm_info = TC_H_MAKE(prio << 16, protocol);
+
+	if (chain)
+		addattr32(n, MAX_MSG, TCA_CHAIN, *chain);
+	addattr_l(n, MAX_MSG, TCA_KIND, "u32", sizeof("u32"));
+}
+
+static int u32_bulk(int argc, char **argv)
+{
+	struct {
+		struct nlmsghdr	n;
+		char		buf[MAX_MSG];
+	} prefix, req;
+	struct u32_bulk b = {
+		.prefix = &prefix.n,
+		.threshold = U32_BULK_THRESHOLD,
+		.next_htid = 1,
+	};
+	unsigned int window = U32_BULK_WINDOW;
+	__u16 protocol = htons(ETH_P_ALL);
+	__u32 parent = 0, prio = 0, chain, root = 0x80000000;
+	bool chain_set = false;
+	const char *dev = NULL, *file = NULL;
+	struct u32_bulk_win w;
+	struct rtnl_pipe pipe;
+	char link[16], mask[16], off[16];
+	char *largv[] = {
+		"match", "u32", "0", "0", "link", link,
+		"hashkey", "mask", mask, "at", off, NULL
+	};
+	int *idx, i, ifindex, ret = -1;
+	__u32 htid;
+
+	while (argc > 0) {
+		if (strcmp(*argv, "dev") == 0) {
+			NEXT_ARG();
+			if (dev)
+				duparg("dev", *argv);
+			dev = *argv;
+		} else if (strcmp(*argv, "ingress") == 0 ||
+			   strcmp(*argv, "egress") == 0) {
+			if (parent)
+				duparg("parent", *argv);
+			parent = TC_H_MAKE(TC_H_CLSACT,
+					   strcmp(*argv, "ingress") == 0 ?
+					   TC_H_MIN_INGRESS : TC_H_MIN_EGRESS);
+		} else if (strcmp(*argv, "root") == 0) {
+			if (parent)
+				duparg("parent", *argv);
+			parent = TC_H_ROOT;
+		} else if (strcmp(*argv, "parent") == 0) {
+			NEXT_ARG();
+			if (parent)
+				duparg("parent", *argv);
+			if (get_tc_classid(&parent, *argv))
+				invarg("Invalid parent ID", *argv);
+		} else if (strcmp(*argv, "file") == 0) {
+			NEXT_ARG();
+			file = *argv;
+		} else if (strcmp(*argv, "protocol") == 0) {
+			NEXT_ARG();
+			if (ll_proto_a2n(&protocol, *argv))
+				invarg("invalid protocol", *argv);
+		} else if (strcmp(*argv, "chain") == 0) {
+			NEXT_ARG();
+			if (get_u32(&chain, *argv, 0))
+				invarg("invalid chain index value", *argv);
+			chain_set = true;
+		} else if (strcmp(*argv, "prio") == 0 ||
+			   strcmp(*argv, "priority") == 0) {
+			NEXT_ARG();
+			if (get_u32(&prio, *argv, 0) || !prio || prio > 0xffff)
+				invarg("invalid priority value", *argv);
+		} else if (strcmp(*argv, "threshold") == 0) {
+			NEXT_ARG();
+			if (get_unsigned(&b.threshold, *argv, 0) ||
+			    !b.threshold)
+				invarg("invalid threshold", *argv);
+		} else if (strcmp(*argv, "window") == 0) {
+			NEXT_ARG();
+			if (get_unsigned(&window, *argv, 0) || !window)
+				invarg("invalid window", *argv);
+		} else if (strcmp(*argv, "help") == 0) {
+			usage();
+			return 0;
+		} else {
+			fprintf(stderr, "What is \"%s\"? Try \"tc u32 help\".\n",
+				*argv);
+			return -1;
+		}
+		argc--; argv++;
+	}
+
+	/* the tables must end up in the instance the link is added to */
+	if (!dev || !parent || !prio || !file) {
+		fprintf(stderr, "\"dev\", a parent, \"prio\" and \"file\" are required.\n");
+		return -1;
+	}
+
+	b.qu = get_filter_kind("u32");
+	if (!b.qu) {
+		fprintf(stderr, "u32 classifier is not available\n");
+		return -1;
+	}
+
+	ifindex = ll_name_to_index(dev);
+	if (!ifindex)
+		return -nodev(dev);
+	u32_bulk_prefix(&prefix.n, ifindex, parent, prio, protocol,
+			chain_set ? &chain : NULL);
+
+	if (u32_bulk_read(&b, file) < 0)
+		goto out;
+	if (b.nrules < 2) {
+		fprintf(stderr, "\"bulk\" needs at least two rules\n");
+		goto out;
+	}
+	if (u32_bulk_scan(&b) < 0)
+		goto out;
+
+	idx = malloc(b.nrules * sizeof(*idx));
+	if (!idx) {
+		perror("malloc");
+		exit(1);
+	}
+	for (i = 0; i < b.nrules; i++)
+		idx[i] = i;
+	ret = u32_bulk_table(&b, idx, b.nrules, 0, &w, &htid);
+	free(idx);
+	if (ret) {
+		if (ret > 0)
+			fprintf(stderr,
+				"Rules share no exact match key to hash on\n");
+		ret = -1;
+		goto out;
+	}
+
+	rtnl_pipe_init(&pipe, &rth, window, u32_bulk_reply, &b);
+	b.pipe = &pipe;
+	ret = u32_bulk_install(&b);
+	if (ret < 0)
+		goto out;
+
+	/* the link from the root table goes last */
+	snprintf(link, sizeof(link), "%x:", TC_U32_USERHTID(htid));
+	snprintf(mask, sizeof(mask), "0x%08x", (w.divisor - 1) << w.shift);
+	snprintf(off, sizeof(off), "%d", w.off);
+	if (u32_bulk_parse(&b, NULL, ARRAY_SIZE(largv) - 1, largv, &req.n) ||
+	    rtnl_pipe_send(&pipe, &req.n, &root) < 0 ||
+	    rtnl_pipe_flush(&pipe) < 0 || pipe.errors)
+		ret = -1;
+out:
+	for (i = 0; i < b.nrules; i++)
+		free(b.rules[i].n);
+	free(b.rules);
+	free(b.tables);
+	free(b.links);
+	return ret;
+}
+
+int do_u32(int argc, char **argv)
+{
+	if (argc < 1 || matches(*argv, "help") == 0) {
+		usage();
+		return 0;
+	}
+
+	if (matches(*argv, "bulk") == 0)
+		return u32_bulk(argc - 1, argv + 1);
+
+	fprintf(stderr, "Command \"%s\" is unknown, try \"tc u32 help\".\n",
+		*argv);
+	return -1;
+}
@@ -814,6 +814,96 @@ compat_xstats:
 		*xstats = tb[TCA_XSTATS];
 }
 
+/*
+ * One line per qdisc or class for "tc -s -brief ... show": only TCA_KIND
+ * and the basic, queue and rate estimator parts of TCA_STATS2 are looked
+ * at, options and xstats are never decoded.  Returns -1 if the message
+ * carries no kind.
+ */
+int print_tcstats_brief(FILE *fp, const char *type, const char *handle,
+			int ifindex, struct tcmsg *t, int len)
+{
+	struct rtattr *tbs[TCA_STATS_MAX + 1];
+	struct rtattr *kind = NULL, *stats = NULL;
+	struct rtattr *rta;
+
+	for (rta = TCA_RTA(t); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		switch (rta->rta_type & NLA_TYPE_MASK) {
+		case TCA_KIND:
+			kind = rta;
+			break;
+		case TCA_STATS2:
+			stats = rta;
+			break;
+		}
+	}
+	if (!kind)
+		return -1;
+
+	/* same keys as the full dump: "kind" for qdiscs, "class" for classes */
+	open_json_object(NULL);
+	print_string(PRINT_FP, NULL, "%s ", type);
+	print_string(PRINT_ANY, strcmp(type, "qdisc") ? type : "kind", "%s",
+		     rta_getattr_str(kind));
+	print_string(PRINT_ANY, "handle", " %s ", handle);
+	if (ifindex)
+		print_devname(PRINT_ANY, ifindex);
+
+	if (stats) {
+		parse_rtattr_nested(tbs, TCA_STATS_MAX, stats);
+
+		if (tbs[TCA_STATS_BASIC]) {
+			struct gnet_stats_basic bs = {0};
+			__u64 packets;
+
+			memcpy(&bs, RTA_DATA(tbs[TCA_STATS_BASIC]),
+			       MIN(RTA_PAYLOAD(tbs[TCA_STATS_BASIC]),
+				   sizeof(bs)));
+			packets = tbs[TCA_STATS_PKT64] ?
+				  rta_getattr_u64(tbs[TCA_STATS_PKT64]) :
+				  bs.packets;
+			print_lluint(PRINT_ANY, "bytes", "bytes %llu", bs.bytes);
+			print_lluint(PRINT_ANY, "packets", " pkts %llu",
+				     packets);
+		}
+		if (tbs[TCA_STATS_QUEUE]) {
+			struct gnet_stats_queue q = {0};
+
+			memcpy(&q, RTA_DATA(tbs[TCA_STATS_QUEUE]),
+			       MIN(RTA_PAYLOAD(tbs[TCA_STATS_QUEUE]),
+				   sizeof(q)));
+			print_uint(PRINT_ANY, "drops", " drops %u", q.drops);
+			print_uint(PRINT_ANY, "overlimits", " overlimits %u",
+				   q.overlimits);
+			print_uint(PRINT_ANY, "requeues", " requeues %u",
+				   q.requeues);
+			print_uint(PRINT_ANY, "backlog", " backlog %u",
+				   q.backlog);
+			print_uint(PRINT_ANY, "qlen", " qlen %u", q.qlen);
+		}
+		if (tbs[TCA_STATS_RATE_EST64]) {
+			struct gnet_stats_rate_est64 re = {0};
+
+			memcpy(&re, RTA_DATA(tbs[TCA_STATS_RATE_EST64]),
+			       MIN(RTA_PAYLOAD(tbs[TCA_STATS_RATE_EST64]),
+				   sizeof(re)));
+			print_lluint(PRINT_ANY, "rate", " rate %llu", re.bps);
+			print_lluint(PRINT_ANY, "pps", " pps %llu", re.pps);
+		} else if (tbs[TCA_STATS_RATE_EST]) {
+			struct gnet_stats_rate_est re = {0};
+
+			memcpy(&re, RTA_DATA(tbs[TCA_STATS_RATE_EST]),
+			       MIN(RTA_PAYLOAD(tbs[TCA_STATS_RATE_EST]),
+				   sizeof(re)));
+			print_uint(PRINT_ANY, "rate", " rate %u", re.bps);
+			print_uint(PRINT_ANY, "pps", " pps %u", re.pps);
+		}
+	}
+	print_string(PRINT_FP, NULL, "\n", NULL);
+	close_json_object();
+	return 0;
+}
+
 static void print_masked_type(__u32 type_max,
 			      __u32 (*rta_getattr_type)(const struct rtattr *),
 			      const char *name, struct rtattr *attr,
@@ -893,3 +983,41 @@ void print_ext_msg(struct rtattr **tb)
 	print_string(PRINT_ANY, "warn", "%s", rta_getattr_str(tb[TCA_EXT_WARN_MSG]));
 	print_nl();
 }
+
+/* Make room for @need elements of @size in an array of @alloc, doubling */
+void *tc_grow(void *ptr, int *alloc, int need, size_t size)
+{
+	if (need <= *alloc)
+		return ptr;
+
+	*alloc = *alloc ? *alloc * 2 : 64;
+	if (*alloc < need)
+		*alloc = need;
+	ptr = realloc(ptr, *alloc * size);
+	if (!ptr) {
+		perror("realloc");
+		exit(1);
+	}
+	return ptr;
+}
+
+/* FNV-1a of the bits of @key under @mask */
+unsigned int tc_masked_hash(const __u8 *key, const __u8 *mask, int len)
+{
+	unsigned int h = 2166136261U;
+	int i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ (key[i] & mask[i])) * 16777619U;
+	return h;
+}
+
+bool tc_masked_eq(const __u8 *k1, const __u8 *k2, const __u8 *mask, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		if ((k1[i] ^ k2[i]) & mask[i])
+			return false;
+	return true;
+}
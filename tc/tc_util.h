@@ -97,6 +97,8 @@ void print_tcstats_attr(FILE *fp, struct rtattr *tb[],
 			const char *prefix, struct rtattr **xstats);
 void print_tcstats2_attr(FILE *fp, struct rtattr *rta,
 			 const char *prefix, struct rtattr **xstats);
+int print_tcstats_brief(FILE *fp, const char *type, const char *handle,
+			int ifindex, struct tcmsg *t, int len);
 
 int get_tc_classid(__u32 *h, const char *str);
 int print_tc_classid(char *buf, int len, __u32 h);
@@ -139,4 +141,8 @@ void print_masked_be16(const char *name, struct rtattr *attr,
 		       struct rtattr *mask_attr, bool newline);
 
 void print_ext_msg(struct rtattr **tb);
+
+void *tc_grow(void *ptr, int *alloc, int need, size_t size);
+unsigned int tc_masked_hash(const __u8 *key, const __u8 *mask, int len);
+bool tc_masked_eq(const __u8 *k1, const __u8 *k2, const __u8 *mask, int len);
 #endif
@@ -0,0 +1,49 @@
+#!/bin/sh
+
+. lib/generic.sh
+
+# % ./misc/ss -Htna
+# LISTEN  0    128    0.0.0.0:22       0.0.0.0:*
+# ESTAB   0    0     10.0.0.1:22      10.0.0.1:36266
+# ESTAB   0    0     10.0.0.1:36266   10.0.0.1:22
+# ESTAB   0    0     10.0.0.1:22      10.0.0.2:50312
+export TCPDIAG_FILE="$(dirname $0)/ss1.dump"
+
+ts_log "[Testing --count-by]"
+
+ts_ss "$0" "Count by state" -Htna --count-by state
+test_on "^ESTAB  3$"
+test_on "^LISTEN 1$"
+test_lines_count 2
+
+ts_ss "$0" "Count by sport, largest first" -Htna --count-by sport
+test_on "^22    3$"
+test_on "^36266 1$"
+test_lines_count 2
+
+ts_ss "$0" "Count by dst/24" -Htna --count-by dst/24
+test_on "^10.0.0.0/24 3$"
+test_on "^0.0.0.0/24  1$"
+test_lines_count 2
+
+ts_ss "$0" "Count by dst/24 and sport" -Htna --count-by dst/24,sport
+test_on "^10.0.0.0/24 22    2$"
+test_on "^10.0.0.0/24 36266 1$"
+test_on "^0.0.0.0/24  22    1$"
+test_lines_count 3
+
+ts_ss "$0" "Count with header" -tna --count-by state
+test_on "^State  Count$"
+test_lines_count 3
+
+ts_ss "$0" "Count with filter" -Htna --count-by state sport = 22
+test_on "^ESTAB  2$"
+test_on "^LISTEN 1$"
+test_lines_count 2
+
+ts_ss "$0" "Count with dev filter" -Htna --count-by state dev lo
+test_lines_count 0
+
+ts_ss "$0" "Count with dev filter in expression" -Htna --count-by state '( dev lo or sport = 36266 )'
+test_on "^ESTAB 1$"
+test_lines_count 1
@@ -0,0 +1,27 @@
+#!/bin/sh
+
+. lib/generic.sh
+
+# % ./misc/ss -Htna
+# LISTEN  0    128    0.0.0.0:22       0.0.0.0:*
+# ESTAB   0    0     10.0.0.1:22      10.0.0.1:36266
+# ESTAB   0    0     10.0.0.1:36266   10.0.0.1:22
+# ESTAB   0    0     10.0.0.1:22      10.0.0.2:50312
+export TCPDIAG_FILE="$(dirname $0)/ss1.dump"
+
+ts_log "[Testing --stream]"
+
+ts_ss "$0" "Widths from all rows" -Htna --stream
+test_on "^LISTEN 0      128     0.0.0.0:22     0.0.0.0:\*    $"
+test_on "^ESTAB  0      0      10.0.0.1:36266 10.0.0.1:22   $"
+test_lines_count 4
+
+ts_ss "$0" "Widths from the first row" -Htna --stream=1
+test_on "^LISTEN 0      128    0.0.0.0:22 0.0.0.0:\*$"
+test_on "^ESTAB  0      0      10.0.0.1:22 10.0.0.1:36266$"
+test_lines_count 4
+
+ts_ss "$0" "Widths from the first two rows" -Htna --stream=2
+test_on "^LISTEN 0      128     0.0.0.0:22  0.0.0.0:\*    $"
+test_on "^ESTAB  0      0      10.0.0.1:36266 10.0.0.1:22   $"
+test_lines_count 4
@@ -0,0 +1,27 @@
+#!/bin/sh
+
+. lib/generic.sh
+
+# % ./misc/ss -Htna
+# LISTEN  0    128    0.0.0.0:22       0.0.0.0:*
+# ESTAB   0    0     10.0.0.1:22      10.0.0.1:36266
+# ESTAB   0    0     10.0.0.1:36266   10.0.0.1:22
+# ESTAB   0    0     10.0.0.1:22      10.0.0.2:50312
+export TCPDIAG_FILE="$(dirname $0)/ss1.dump"
+
+ts_log "[Testing --top/--by]"
+
+ts_ss "$0" "Top 1 by sendq" -Htna --top 1 --by sendq
+test_on "^LISTEN 0      128    0.0.0.0:22 0.0.0.0:\*$"
+test_lines_count 1
+
+ts_ss "$0" "Top N larger than the table" -Htna --top 9 --by sendq
+test_on "^LISTEN "
+test_lines_count 4
+
+ts_ss "$0" "Top with filter" -Htna --top 1 --by sendq sport = 36266
+test_on "^ESTAB 0      0      10.0.0.1:36266 10.0.0.1:22$"
+test_lines_count 1
+
+ts_ss "$0" "Top by tcp_info metric without tcp_info" -Htna --top 2 --by rtt
+test_lines_count 0
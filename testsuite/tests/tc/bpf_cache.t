@@ -0,0 +1,37 @@
+#!/bin/sh
+. lib/generic.sh
+
+# Programs loaded from an object are cached across batch lines.  A graft
+# closes the program fd it loads, so it must not take it from the cache
+# and leave a closed fd behind for the next line using the same section.
+
+SRC="../examples/bpf/legacy/bpf_graft.c"
+
+command -v clang > /dev/null || ts_skip
+OBJ="$(mktemp)"
+clang -O2 -target bpf -c "$SRC" -o "$OBJ" 2> /dev/null || ts_skip
+
+DEV="$(rand_dev)"
+ts_ip "$0" "Add $DEV dummy interface" link add dev $DEV type dummy
+ts_ip "$0" "Enable $DEV" link set $DEV up
+ts_tc "$0" "Add clsact qdisc" qdisc add dev $DEV clsact
+
+"$TC" filter add dev $DEV ingress pref 1 bpf da obj "$OBJ" 2>&1 |
+	grep -q "No ELF library support" && ts_skip
+
+TMP="$(mktemp)"
+echo exec bpf graft m:globals/jmp_tc key 0 obj "$OBJ" sec aaa >> "$TMP"
+echo filter add dev $DEV ingress pref 2 bpf da obj "$OBJ" sec aaa >> "$TMP"
+echo exec bpf graft m:globals/jmp_tc key 0 obj "$OBJ" sec bbb >> "$TMP"
+echo filter add dev $DEV ingress pref 3 bpf da obj "$OBJ" sec aaa >> "$TMP"
+echo filter add dev $DEV ingress pref 4 bpf da obj "$OBJ" sec bbb >> "$TMP"
+ts_tc "$0" "Graft and load the same sections in a batch" -b "$TMP"
+
+ts_tc "$0" "Show filters" filter show dev $DEV ingress
+test_on "pref 2 bpf .*:\[aaa\] direct-action"
+test_on "pref 3 bpf .*:\[aaa\] direct-action"
+test_on "pref 4 bpf .*:\[bbb\] direct-action"
+
+rm "$TMP" "$OBJ"
+rm -f /sys/fs/bpf/tc/globals/jmp_tc
+ts_ip "$0" "Del $DEV dummy interface" link del dev $DEV
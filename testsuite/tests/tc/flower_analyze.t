@@ -0,0 +1,33 @@
+#!/bin/sh
+
+. lib/generic.sh
+
+DEV="$(rand_dev)"
+ts_ip "$0" "Add $DEV dummy interface" link add dev $DEV up type dummy
+ts_tc "$0" "Add clsact qdisc" qdisc add dev $DEV clsact
+
+ts_log "[Testing flower analyze shadowing]"
+
+add_filter()
+{
+	prio=$1
+	shift
+	ts_tc "$0" "Add prio $prio filter" filter add dev $DEV ingress \
+		prio $prio protocol ip flower "$@"
+}
+
+# a last action that continues hands the packet on, whatever its kind
+add_filter 1 dst_ip 10.0.0.1 action skbedit mark 1 continue
+add_filter 2 dst_ip 10.0.0.1 action drop
+add_filter 3 dst_ip 10.0.0.1 action pass
+# a policer reclassifies what exceeds its rate by default
+add_filter 4 dst_ip 10.0.0.2 action police rate 1mbit burst 10k
+add_filter 5 dst_ip 10.0.0.2 action drop
+
+ts_tc "$0" "Analyze ingress filters" filter analyze dev $DEV ingress
+test_on "shadowed 1$"
+test_on "shadowed: prio 3 handle 0x1 by prio 2 handle 0x1"
+test_on_not "by prio 1 "
+test_on_not "by prio 4 "
+
+ts_ip "$0" "Del $DEV dummy interface" link del dev $DEV
@@ -0,0 +1,36 @@
+#!/bin/sh
+
+. lib/generic.sh
+
+# dry-run prints the plan without touching a device
+TMP="$(mktemp)"
+cat > "$TMP" <<CSV
+protocol,ip_proto,dst_ip,dst_port,action
+ip,tcp,10.0.0.1,80,drop
+ip,tcp,10.0.0.2,80,drop
+ip,tcp,10.0.0.0/24,,pass
+ip,tcp,10.0.1.3,443,drop
+ip,udp,10.0.0.4,53,pass
+ip,udp,10.0.0.5,53,pass
+ip,tcp,10.0.0.1,80,pass
+CSV
+
+ts_log "[Testing flower compile mask grouping]"
+
+ts_tc "$0" "Compile rule table" flower compile dev lo ingress file "$TMP" dry-run
+# rules with the same mask share a priority, past the /24 that overlaps them
+test_on "^filter add dev lo ingress chain 1 prio 1 protocol ip flower ip_proto tcp dst_ip 10.0.0.1 dst_port 80 action drop$"
+test_on "^filter add dev lo ingress chain 1 prio 1 protocol ip flower ip_proto tcp dst_ip 10.0.1.3 dst_port 443 action drop$"
+test_on "^filter add dev lo ingress chain 1 prio 2 protocol ip flower ip_proto tcp dst_ip 10.0.0.0/24 action pass$"
+# one chain per ip_proto, reached from a single-mask dispatch
+test_on "^filter add dev lo ingress chain 0 prio 1 protocol ip flower ip_proto tcp action goto chain 1$"
+test_on "^filter add dev lo ingress chain 0 prio 1 protocol ip flower ip_proto udp action goto chain 2$"
+# a single-mask chain gets a template
+test_on "^chain add dev lo ingress chain 2 protocol ip flower ip_proto udp dst_ip 10.0.0.4 dst_port 53$"
+test_on_not "^chain add dev lo ingress chain 1 "
+test_on "^chain 1: 4 filters, 2 priorities, 2 masks$"
+test_on "^chain 2: 2 filters, 1 priorities, 1 masks$"
+# the last rule can never match
+test_on "^7 rules, 6 filters, 1 shadowed$"
+
+rm "$TMP"
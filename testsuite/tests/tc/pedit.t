@@ -43,6 +43,55 @@ test_on "key #0  at 12: val 00000000 mask ff00ffff"
 do_pedit offset 13 u8 preserve
 test_on "key #0  at 12: val 00000000 mask ffffffff"
 
+# edits of the same word are folded into one key
+do_pedit offset 12 u8 set 0x11 munge offset 13 u8 set 0x22
+test_on "key #0  at 12: val 11220000 mask 0000ffff"
+test_on_not "key #1"
+do_pedit offset 12 u16 set 0x1234 munge offset 14 u16 set 0x5678
+test_on "key #0  at 12: val 12345678 mask 00000000"
+test_on_not "key #1"
+do_pedit offset 12 u16 set 0x1234 munge offset 12 u8 set 0xab
+test_on "key #0  at 12: val ab340000 mask 0000ffff"
+test_on_not "key #1"
+do_pedit offset 12 u8 set 0x11 munge offset 16 u32 set 0x01020304 \
+	munge offset 15 u8 set 0x44
+test_on "key #0  at 12: val 11000044 mask 00ffff00"
+test_on "key #1  at 16: val 01020304 mask 00000000"
+test_on_not "key #2"
+do_pedit ip sport set 0x1234 munge ip dport set 0x5678
+test_on "key #0  at 20: val 12345678 mask 00000000"
+test_on_not "key #1"
+ts_tc "pedit" "Show folded key counts" -s filter show dev $DEV parent ffff:
+test_on "keys 1"
+test_on_not "folded"
+
+do_pedit_ex() {
+	ts_tc "pedit" "Drop ingress qdisc" \
+		qdisc del dev $DEV ingress
+	ts_tc "pedit" "Add ingress qdisc" \
+		qdisc add dev $DEV ingress
+	ts_tc "pedit" "Add pedit action ex $*" \
+		filter add dev $DEV parent ffff: \
+		u32 match u32 0 0 \
+		action pedit ex munge $@
+	ts_tc "pedit" "Show ingress filters" \
+		filter show dev $DEV parent ffff:
+}
+
+do_pedit_ex ip ttl set 10 munge ip protocol set 6
+test_on "key #0  at ipv4\+8: val 0a060000 mask 0000ffff"
+test_on_not "key #1"
+# a key of a higher header in between does not overlap the IPv4 header
+do_pedit_ex ip ttl set 10 munge tcp dport set 80 munge ip protocol set 6
+test_on "key #0  at ipv4\+8: val 0a060000 mask 0000ffff"
+test_on "key #1  at tcp\+0: val 00000050 mask ffff0000"
+test_on_not "key #2"
+# "add" keys are never folded and keep later edits of their word apart
+do_pedit_ex ip ttl set 10 munge ip ttl add 1 munge ip protocol set 6
+test_on "key #0  at ipv4\+8: val 0a000000 mask 00ffffff"
+test_on "key #1  at ipv4\+8: add 01000000 mask 00ffffff"
+test_on "key #2  at ipv4\+8: val 00060000 mask ff00ffff"
+
 # the following set of tests has been auto-generated by running this little
 # shell script:
 #
@@ -0,0 +1,40 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0
+#
+# Time "ip vrf exec" with and without the pinned cgroup/sock program.
+#
+# usage: vrf_exec_bench.sh [ ITERATIONS ]
+#
+# Needs root, VRF support and bpffs mounted on /sys/fs/bpf. IP selects
+# the ip binary (default: the one of this tree).
+
+IP=${IP:-$(dirname "$0")/../../ip/ip}
+N=${1:-1000}
+VRF=vrf-bench$$
+PINS=/sys/fs/bpf/ip/vrf
+
+now()
+{
+	date +%s%N
+}
+
+run()
+{
+	uncached=$1
+	i=0
+
+	start=$(now)
+	while [ $i -lt $N ]; do
+		[ "$uncached" = y ] && rm -f "$PINS"/sk_bind_*
+		"$IP" vrf exec $VRF true || exit 1
+		i=$((i + 1))
+	done
+	echo $(( ($(now) - start) / N / 1000 ))
+}
+
+"$IP" link add $VRF type vrf table 4242 || exit 1
+trap '"$IP" link del $VRF' EXIT
+
+echo "uncached: $(run y) us/exec"
+echo "cached:   $(run n) us/exec"
+ls "$PINS"